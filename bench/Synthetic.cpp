@@ -0,0 +1,425 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Synthetic.cpp
+* Procedures:
+* fourcc        -turns four characters into an atom type
+* nextRandom    -advances a xorshift generator, so generated files do not depend on the platform
+* fullAtom      -creates a leaf atom starting with a version and flags
+* buildTrak     -creates a trak atom around the sample tables of a track
+* writeZeros    -appends zero bytes to a file, or leaves them as a hole
+* writeAtom     -appends a serialized atom to a file
+* writeHeader   -appends the header of an atom whose payload is written separately
+* generateMp4   -generates a progressive mp4 with the moov behind the mdat, streamed to a file
+***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "Synthetic.hpp"
+#include "SampleTable.hpp"
+#include "Endian.hpp"
+
+#define MOVIE_TIMESCALE 1000
+#define VIDEO_TIMESCALE 30000
+#define VIDEO_DURATION  1001
+#define VIDEO_CHUNK     10      //samples per video chunk
+#define VIDEO_GOP       30      //samples per sync sample
+#define AUDIO_TIMESCALE 48000
+#define AUDIO_DURATION  1024
+#define AUDIO_CHUNK     20      //samples per audio chunk
+
+using QtFastStartSTD::Atom;
+using QtFastStartSTD::SampleTable;
+
+//unity transformation matrix of mvhd and tkhd
+static const uint32_t matrix[9] = {0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000};
+
+
+/***************************************************************************
+* static uint32_t fourcc(const char* c)
+* Description: turns four characters into an atom type, in the byte order of
+*               the *_ATOM definitions
+*
+* Parameters:
+*        c      I/P     const char*     four characters
+*        fourcc O/P     uint32_t        atom type
+**************************************************************************/
+static uint32_t fourcc(const char* c)
+{
+        uint32_t type;
+        memcpy(&type, c, 4);
+        return type;
+}
+
+/***************************************************************************
+* static uint32_t nextRandom(uint32_t *state)
+* Description: advances a xorshift generator, so generated files do not depend
+*               on the platform's rand()
+*
+* Parameters:
+*        state  I/O     uint32_t*       generator state, never 0
+*        nextRandom     O/P     uint32_t        next value
+**************************************************************************/
+static uint32_t nextRandom(uint32_t *state)
+{
+        uint32_t x = *state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *state = x;
+        return x;
+}
+
+/***************************************************************************
+* static Atom fullAtom(uint32_t type, uint8_t version, uint32_t flags)
+* Description: creates a leaf atom starting with a version and flags
+*
+* Parameters:
+*        type   I/P     uint32_t        atom type
+*        version        I/P     uint8_t version of the atom
+*        flags  I/P     uint32_t        24 bit flags of the atom
+*        fullAtom       O/P     Atom    the new atom
+**************************************************************************/
+static Atom fullAtom(uint32_t type, uint8_t version, uint32_t flags)
+{
+        Atom atom(type);
+        atom.putUint_32(((uint32_t)version << 24) | (flags & 0xffffff));
+        return atom;
+}
+
+/***************************************************************************
+* static Atom buildTrak(const SampleTable &table, bool co64)
+* Description: creates a trak atom around the sample tables of a track
+*
+* Parameters:
+*        table  I/P     const SampleTable&      samples and chunks of the track
+*        co64   I/P     bool    whether to write the chunk offsets as co64
+*        buildTrak      O/P     Atom    the new trak atom
+**************************************************************************/
+static Atom buildTrak(const SampleTable &table, bool co64)
+{
+        bool video = table.handler == VIDE_HANDLER;
+
+        Atom tkhd = fullAtom(TKHD_ATOM, 0, 3);
+        tkhd.putUint_32(0);                     //creation time
+        tkhd.putUint_32(0);                     //modification time
+        tkhd.putUint_32(table.trackId);
+        tkhd.putUint_32(0);
+        tkhd.putUint_32(0);                     //duration, set by updateDurations
+        tkhd.putUint_64(0);
+        tkhd.putUint_16(0);                     //layer
+        tkhd.putUint_16(video ? 0 : 1);         //alternate group
+        tkhd.putUint_16(video ? 0 : 0x0100);    //volume
+        tkhd.putUint_16(0);
+        for(uint32_t m : matrix)
+                tkhd.putUint_32(m);
+        tkhd.putUint_32(video ? 1920 << 16 : 0);
+        tkhd.putUint_32(video ? 1080 << 16 : 0);
+
+        Atom mdhd = fullAtom(MDHD_ATOM, 0, 0);
+        mdhd.putUint_32(0);
+        mdhd.putUint_32(0);
+        mdhd.putUint_32(table.timescale);
+        mdhd.putUint_32(0);                     //duration, set by updateDurations
+        mdhd.putUint_16(0x55c4);                //undetermined language
+        mdhd.putUint_16(0);
+
+        Atom hdlr = fullAtom(HDLR_ATOM, 0, 0);
+        hdlr.putUint_32(0);
+        hdlr.putUint_32(be32toh(table.handler));
+        hdlr.putUint_32(0);
+        hdlr.putUint_32(0);
+        hdlr.putUint_32(0);
+        hdlr.putUint_8(0);                      //empty name
+
+        Atom mediaHeader = video ? fullAtom(fourcc("vmhd"), 0, 1) : fullAtom(fourcc("smhd"), 0, 0);
+        if(video){
+                mediaHeader.putUint_16(0);
+                mediaHeader.putUint_16(0);
+                mediaHeader.putUint_16(0);
+                mediaHeader.putUint_16(0);
+        }
+        else
+                mediaHeader.putUint_32(0);
+
+        Atom dref = fullAtom(fourcc("dref"), 0, 0);
+        dref.putUint_32(1);
+        std::vector<byte> url;
+        fullAtom(fourcc("url "), 0, 1).serialize(url);
+        dref.data.insert(dref.data.end(), url.begin(), url.end());
+        Atom dinf(DINF_ATOM, true);
+        dinf.children.push_back(std::move(dref));
+
+        Atom stsd = fullAtom(STSD_ATOM, 0, 0);
+        stsd.putUint_32(0);
+        Atom stbl(STBL_ATOM, true);
+        stbl.children.push_back(std::move(stsd));
+
+        Atom minf(MINF_ATOM, true);
+        minf.children.push_back(std::move(mediaHeader));
+        minf.children.push_back(std::move(dinf));
+        minf.children.push_back(std::move(stbl));
+
+        Atom mdia(MDIA_ATOM, true);
+        mdia.children.push_back(std::move(mdhd));
+        mdia.children.push_back(std::move(hdlr));
+        mdia.children.push_back(std::move(minf));
+
+        Atom trak(TRAK_ATOM, true);
+        trak.children.push_back(std::move(tkhd));
+        trak.children.push_back(std::move(mdia));
+
+        table.build(trak);
+        table.updateDurations(trak, MOVIE_TIMESCALE);
+
+        Atom* stco = SampleTable::getStbl(trak)->find(STCO_ATOM);
+        if(co64 && stco){
+                Atom wide = fullAtom(CO64_ATOM, 0, 0);
+                wide.putUint_32(table.chunks.size());
+                for(const QtFastStartSTD::Chunk &c : table.chunks)
+                        wide.putUint_64(c.offset);
+                *stco = std::move(wide);
+        }
+        return trak;
+}
+
+/***************************************************************************
+* static bool writeZeros(FILE* out, uint64_t len, bool sparse)
+* Description: appends zero bytes to a file, or seeks over them so they stay
+*               a hole of a sparse file. A hole is only allocated once data is
+*               written behind it
+*
+* Parameters:
+*        out    I/O     FILE*   file to append to
+*        len    I/P     uint64_t        number of zero bytes
+*        sparse I/P     bool    seek instead of writing
+*        writeZeros     O/P     bool    false on an I/O error
+**************************************************************************/
+static bool writeZeros(FILE* out, uint64_t len, bool sparse)
+{
+        if(sparse)
+                return fseeko(out, (off_t)len, SEEK_CUR) == 0;
+        static const byte zeros[65536] = {0};
+        while(len){
+                size_t n = len < sizeof(zeros) ? (size_t)len : sizeof(zeros);
+                if(fwrite(zeros, 1, n, out) != n)
+                        return false;
+                len -= n;
+        }
+        return true;
+}
+
+/***************************************************************************
+* static bool writeAtom(FILE* out, const Atom &atom)
+* Description: appends a serialized atom to a file
+*
+* Parameters:
+*        out    I/O     FILE*   file to append to
+*        atom   I/P     const Atom&     atom to write
+*        writeAtom      O/P     bool    false on an I/O error
+**************************************************************************/
+static bool writeAtom(FILE* out, const Atom &atom)
+{
+        std::vector<byte> bytes;
+        atom.serialize(bytes);
+        return fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+}
+
+/***************************************************************************
+* static bool writeHeader(FILE* out, uint32_t type, uint64_t size, uint32_t headerSize)
+* Description: appends the header of an atom whose payload is written separately
+*
+* Parameters:
+*        out    I/O     FILE*   file to append to
+*        type   I/P     uint32_t        atom type
+*        size   I/P     uint64_t        size of the atom including its header
+*        headerSize     I/P     uint32_t        8, or 16 for a 64 bit size
+*        writeHeader    O/P     bool    false on an I/O error
+**************************************************************************/
+static bool writeHeader(FILE* out, uint32_t type, uint64_t size, uint32_t headerSize)
+{
+        byte header[16];
+        if(headerSize == 16){
+                uint32_t one = htobe32(1);
+                uint64_t large = htobe64(size);
+                memcpy(&header[0], &one, 4);
+                memcpy(&header[8], &large, 8);
+        }
+        else{
+                uint32_t small = htobe32((uint32_t)size);
+                memcpy(&header[0], &small, 4);
+        }
+        memcpy(&header[4], &type, 4);
+        return fwrite(header, 1, headerSize, out) == headerSize;
+}
+
+/***************************************************************************
+* bool generateMp4(const SyntheticOptions &options, const char* path, SyntheticInfo *info)
+* Description: generates a progressive mp4 laid out as ftyp, an optional free
+*               atom, mdat and moov, the worst case for a fast-start conversion.
+*               Chunks of the tracks are interleaved by decode time, sample
+*               sizes come from a seeded generator so the same options always
+*               give the same file. The file is streamed to disk a sample at a
+*               time, only the sample tables are kept in memory, so inputs of
+*               tens of gigabytes can be generated; sparse ones take no disk
+*               space for their media data
+*
+* Parameters:
+*        options        I/P     const SyntheticOptions& shape of the file
+*        path   I/P     const char*     file to create, replaced if it exists
+*        info   O/P     SyntheticInfo*  counts of what was generated, may be NULL
+*        generateMp4    O/P     bool    false if the file could not be written
+**************************************************************************/
+bool generateMp4(const SyntheticOptions &options, const char* path, SyntheticInfo *info)
+{
+        uint32_t state = options.seed ? options.seed : 1;
+        uint32_t trackCount = options.tracks ? options.tracks : 1;
+        std::vector<SampleTable> tables(trackCount);
+        std::vector<uint64_t> nextTime(trackCount, 0);
+        //chunks in the order they are laid out in the mdat, as track and chunk index
+        std::vector<std::pair<uint32_t, uint32_t>> layout;
+
+        for(uint32_t t = 0; t < trackCount; t++){
+                tables[t].trackId = t + 1;
+                tables[t].handler = t == 0 ? VIDE_HANDLER : SOUN_HANDLER;
+                tables[t].timescale = t == 0 ? VIDEO_TIMESCALE : AUDIO_TIMESCALE;
+                tables[t].hasSyncTable = t == 0;
+        }
+
+        //emit whole chunks, always from the track that is furthest behind in time
+        uint64_t payload = 0;
+        uint64_t sampleCount = 0;
+        while(options.samples ? sampleCount < options.samples : payload < options.mediaSize){
+                uint32_t t = 0;
+                for(uint32_t i = 1; i < trackCount; i++){
+                        if(nextTime[i] * tables[t].timescale < nextTime[t] * tables[i].timescale)
+                                t = i;
+                }
+                SampleTable &table = tables[t];
+                bool video = t == 0;
+                uint32_t count = video ? VIDEO_CHUNK : AUDIO_CHUNK;
+                uint32_t duration = video ? VIDEO_DURATION : AUDIO_DURATION;
+                if(options.samples && options.samples - sampleCount < count)
+                        count = options.samples - sampleCount;
+
+                layout.push_back({t, (uint32_t)table.chunks.size()});
+                table.chunks.push_back({payload, (uint32_t)table.samples.size(), count, 1});
+                for(uint32_t i = 0; i < count; i++){
+                        bool sync = !video || table.samples.size() % VIDEO_GOP == 0;
+                        uint32_t size;
+                        if(!video)
+                                size = 200 + nextRandom(&state) % 400;
+                        else if(sync)
+                                size = 20000 + nextRandom(&state) % 20000;
+                        else
+                                size = 2000 + nextRandom(&state) % 8000;
+                        table.samples.push_back({payload, nextTime[t], size, duration, 0, 1, sync});
+                        payload += size;
+                        nextTime[t] += duration;
+                }
+                sampleCount += count;
+        }
+
+        Atom ftyp(FTYP_ATOM);
+        const char brands[] = "isom\0\0\x02\0isomiso2mp41";
+        ftyp.data.assign(brands, brands + sizeof(brands) - 1);
+
+        //a free atom needs at least its header
+        uint64_t padding = options.padding && options.padding < ATOM_PREAMBLE_SIZE ? ATOM_PREAMBLE_SIZE : options.padding;
+        uint32_t paddingHeader = padding > UINT32_MAX ? 16 : ATOM_PREAMBLE_SIZE;
+        uint32_t mdatHeader = payload + ATOM_PREAMBLE_SIZE > UINT32_MAX ? 16 : ATOM_PREAMBLE_SIZE;
+        uint64_t base = ftyp.size() + padding + mdatHeader;
+        for(SampleTable &table : tables){
+                for(QtFastStartSTD::Chunk &c : table.chunks)
+                        c.offset += base;
+                for(QtFastStartSTD::Sample &s : table.samples)
+                        s.offset += base;
+        }
+
+        uint64_t movieDuration = 0;
+        for(const SampleTable &table : tables){
+                uint64_t d = table.duration() * MOVIE_TIMESCALE / table.timescale;
+                if(d > movieDuration)
+                        movieDuration = d;
+        }
+        Atom mvhd = fullAtom(MVHD_ATOM, 0, 0);
+        mvhd.putUint_32(0);
+        mvhd.putUint_32(0);
+        mvhd.putUint_32(MOVIE_TIMESCALE);
+        mvhd.putUint_32(movieDuration > UINT32_MAX ? UINT32_MAX : (uint32_t)movieDuration);
+        mvhd.putUint_32(0x00010000);            //rate
+        mvhd.putUint_16(0x0100);                //volume
+        mvhd.putUint_16(0);
+        mvhd.putUint_64(0);
+        for(uint32_t m : matrix)
+                mvhd.putUint_32(m);
+        for(int i = 0; i < 6; i++)
+                mvhd.putUint_32(0);
+        mvhd.putUint_32(trackCount + 1);        //next track id
+
+        Atom moov(MOOV_ATOM, true);
+        moov.children.push_back(std::move(mvhd));
+        for(const SampleTable &table : tables)
+                moov.children.push_back(buildTrak(table, options.co64));
+        if(options.moovSize > moov.size()){
+                uint64_t grow = options.moovSize - moov.size();
+                Atom filler(FREE_ATOM);
+                filler.data.resize(grow < ATOM_PREAMBLE_SIZE ? 0 : grow - ATOM_PREAMBLE_SIZE);
+                moov.children.push_back(std::move(filler));
+        }
+
+        //lay out ftyp, free, mdat and moov
+        FILE* out = fopen(path, "wb");
+        if(!out)
+                return false;
+        bool ok = writeAtom(out, ftyp);
+        if(ok && padding){
+                ok = writeHeader(out, FREE_ATOM, padding, paddingHeader)
+                        && writeZeros(out, padding - paddingHeader, options.sparse);
+        }
+        ok = ok && writeHeader(out, MDAT_ATOM, payload + mdatHeader, mdatHeader);
+
+        //every sample is filled with a byte derived from its track and index
+        if(ok && options.sparse)
+                ok = writeZeros(out, payload, true);
+        std::vector<byte> sample;
+        for(size_t n = 0; ok && !options.sparse && n < layout.size(); n++){
+                const SampleTable &table = tables[layout[n].first];
+                const QtFastStartSTD::Chunk &c = table.chunks[layout[n].second];
+                for(uint32_t i = c.firstSample; ok && i < c.firstSample + c.sampleCount; i++){
+                        const QtFastStartSTD::Sample &s = table.samples[i];
+                        sample.assign(s.size, (byte)((table.trackId * 31 + i) & 0xff));
+                        ok = fwrite(sample.data(), 1, sample.size(), out) == sample.size();
+                }
+        }
+        ok = ok && writeAtom(out, moov);
+        if(ok && info)
+                info->fileSize = (uint64_t)ftello(out);
+        if(fclose(out) != 0)
+                ok = false;
+        if(!ok)
+                return false;
+
+        if(info){
+                info->samples = sampleCount;
+                info->chunks = 0;
+                for(const SampleTable &table : tables)
+                        info->chunks += table.chunks.size();
+                info->moovSize = moov.size();
+                info->mdatSize = mdatHeader + payload;
+        }
+        return true;
+}
@@ -0,0 +1,48 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stdint.h>
+#include <vector>
+#include "QtFastStartCPP.hpp"
+
+
+/*Shape of a generated file. The same settings always produce the same bytes*/
+struct SyntheticOptions{
+        uint64_t mediaSize = 64 * 1024 * 1024;  //approximate size of the mdat payload
+        uint64_t samples = 0;                   //stop after this many samples instead of at mediaSize, 0 for no limit
+        uint32_t tracks = 2;                    //one video track, the rest audio
+        bool co64 = false;                      //write co64 even if every offset fits stco
+        uint64_t padding = 0;                   //size of a free atom in front of the mdat, 0 for none
+        uint64_t moovSize = 0;                  //pad the moov with a free atom up to at least this size, 0 leaves it as built
+        bool sparse = false;                    //leave the sample data and padding as holes of the file instead of writing them
+        uint32_t seed = 1;                      //seed of the sample size generator
+};
+
+/*What ended up in a generated file*/
+struct SyntheticInfo{
+        uint64_t samples = 0;
+        uint64_t chunks = 0;
+        uint64_t moovSize = 0;
+        uint64_t mdatSize = 0;
+        uint64_t fileSize = 0;
+};
+
+bool generateMp4(const SyntheticOptions &options, const char* path, SyntheticInfo *info);
+
+
+#endif // SYNTHETIC_H
@@ -0,0 +1,551 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <getopt.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "QtFastStartCPP.hpp"
+#include "Synthetic.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/*Allocation counters, fed by the malloc family (wrapped at link time) and by operator new*/
+static uint64_t allocCount = 0;
+static uint64_t allocBytes = 0;
+static int64_t liveBytes = 0;
+static int64_t peakBytes = 0;
+
+extern "C" {
+        void* __real_malloc(size_t size);
+        void* __real_calloc(size_t count, size_t size);
+        void* __real_realloc(void* ptr, size_t size);
+        void __real_free(void* ptr);
+
+/***************************************************************************
+* static void countAlloc(void* ptr)
+* Description: records a new allocation in the counters
+*
+* Parameters:
+*        ptr    I/P     void*   the allocation, may be NULL
+**************************************************************************/
+        static void countAlloc(void* ptr)
+        {
+                if(!ptr)
+                        return;
+                size_t usable = malloc_usable_size(ptr);
+                allocCount++;
+                allocBytes += usable;
+                liveBytes += usable;
+                if(liveBytes > peakBytes)
+                        peakBytes = liveBytes;
+        }
+
+        void* __wrap_malloc(size_t size)
+        {
+                void* ptr = __real_malloc(size);
+                countAlloc(ptr);
+                return ptr;
+        }
+
+        void* __wrap_calloc(size_t count, size_t size)
+        {
+                void* ptr = __real_calloc(count, size);
+                countAlloc(ptr);
+                return ptr;
+        }
+
+        void* __wrap_realloc(void* ptr, size_t size)
+        {
+                if(ptr)
+                        liveBytes -= malloc_usable_size(ptr);
+                void* res = __real_realloc(ptr, size);
+                if(!res && ptr)
+                        liveBytes += malloc_usable_size(ptr);
+                countAlloc(res);
+                return res;
+        }
+
+        void __wrap_free(void* ptr)
+        {
+                if(ptr)
+                        liveBytes -= malloc_usable_size(ptr);
+                __real_free(ptr);
+        }
+}
+
+void* operator new(size_t size)
+{
+        void* ptr = __wrap_malloc(size ? size : 1);
+        if(!ptr)
+                throw std::bad_alloc();
+        return ptr;
+}
+
+void* operator new[](size_t size)
+{
+        return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+        __wrap_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+        __wrap_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+        __wrap_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+        __wrap_free(ptr);
+}
+
+
+/*Measurements of one phase of the conversion over all iterations*/
+struct Phase{
+        const char* name;
+        uint64_t bytes = 0;             //bytes the phase works through
+        std::vector<uint64_t> ns;
+        uint64_t allocations = 0;       //per iteration
+        uint64_t allocatedBytes = 0;    //per iteration
+        int64_t peakBytes = 0;          //highest live heap growth during the phase
+        long rssKb = 0;                 //resident set after the phase
+
+        explicit Phase(const char* n) : name(n) {}
+};
+
+/*Start of a measurement of one phase*/
+struct Probe{
+        uint64_t allocCount;
+        uint64_t allocBytes;
+        int64_t liveBytes;
+};
+
+/*Phase of the conversion being measured, advanced by the progress callback*/
+struct Tracker{
+        std::vector<Phase> *phases;
+        int current = -1;
+        Probe probe;
+        int64_t peak = 0;               //highest live heap growth of the whole conversion so far
+        int64_t startBytes = 0;         //live heap when the conversion started
+};
+
+
+/***************************************************************************
+* static long readStatusKb(const char* key)
+* Description: reads a memory figure of this process from /proc/self/status
+*
+* Parameters:
+*        key    I/P     const char*     name of the line, as "VmRSS:"
+*        readStatusKb   O/P     long    value in kilobytes, 0 if unavailable
+**************************************************************************/
+static long readStatusKb(const char* key)
+{
+        FILE* f = fopen("/proc/self/status", "r");
+        if(!f)
+                return 0;
+        char line[256];
+        long value = 0;
+        size_t len = strlen(key);
+        while(fgets(line, sizeof(line), f)){
+                if(strncmp(line, key, len) == 0){
+                        value = strtol(&line[len], NULL, 10);
+                        break;
+                }
+        }
+        fclose(f);
+        return value;
+}
+
+/***************************************************************************
+* static Probe begin(void)
+* Description: starts measuring the heap of a phase
+*
+* Parameters:
+*        begin  O/P     Probe   allocation counters at the start
+**************************************************************************/
+static Probe begin(void)
+{
+        Probe p;
+        p.allocCount = allocCount;
+        p.allocBytes = allocBytes;
+        p.liveBytes = liveBytes;
+        peakBytes = liveBytes;
+        return p;
+}
+
+/***************************************************************************
+* static void end(const Probe &p, Phase &phase)
+* Description: finishes measuring the heap of a phase and records the results.
+*               The time of a phase comes from the conversion's own stats
+*
+* Parameters:
+*        p      I/P     const Probe&    start of the measurement
+*        phase  I/O     Phase&  phase to record into
+**************************************************************************/
+static void end(const Probe &p, Phase &phase)
+{
+        phase.allocations = allocCount - p.allocCount;
+        phase.allocatedBytes = allocBytes - p.allocBytes;
+        phase.peakBytes = peakBytes - p.liveBytes;
+        phase.rssKb = readStatusKb("VmRSS:");
+}
+
+/***************************************************************************
+* static void closePhase(Tracker *tracker)
+* Description: records the heap of the phase being measured, if any, and
+*               the peak of the conversion up to now
+*
+* Parameters:
+*        tracker        I/O     Tracker*        measurement of the running conversion
+**************************************************************************/
+static void closePhase(Tracker *tracker)
+{
+        int64_t peak = peakBytes - tracker->startBytes;
+        if(peak > tracker->peak)
+                tracker->peak = peak;
+        if(tracker->current < 0)
+                return;
+        end(tracker->probe, (*tracker->phases)[tracker->current]);
+        tracker->current = -1;
+}
+
+/***************************************************************************
+* static void onProgress(QtFastStartSTD::StatsPhase phase, uint64_t done, uint64_t total, void* user)
+* Description: progress callback of the conversion, moves the heap
+*               measurement on to the next phase when one starts
+*
+* Parameters:
+*        phase  I/P     QtFastStartSTD::StatsPhase      phase being reported
+*        done   I/P     uint64_t        unused
+*        total  I/P     uint64_t        unused
+*        user   I/O     void*   the Tracker of the conversion
+**************************************************************************/
+static void onProgress(QtFastStartSTD::StatsPhase phase, uint64_t done, uint64_t total, void* user)
+{
+        (void)done;
+        (void)total;
+        Tracker *tracker = (Tracker*)user;
+        if(tracker->current == (int)phase)
+                return;
+        closePhase(tracker);
+        tracker->current = phase;
+        tracker->probe = begin();
+}
+
+/***************************************************************************
+* static uint64_t percentile(const std::vector<uint64_t> &sorted, uint32_t pct)
+* Description: returns a nearest-rank percentile of sorted samples
+*
+* Parameters:
+*        sorted I/P     const std::vector<uint64_t>&    samples in ascending order
+*        pct    I/P     uint32_t        percentile, 0 to 100
+*        percentile     O/P     uint64_t        the sample at that rank
+**************************************************************************/
+static uint64_t percentile(const std::vector<uint64_t> &sorted, uint32_t pct)
+{
+        if(sorted.empty())
+                return 0;
+        uint64_t rank = (pct * sorted.size() + 99) / 100;
+        return sorted[rank ? rank - 1 : 0];
+}
+
+/***************************************************************************
+* static void writeJson(std::ostream &os, const SyntheticOptions &options, const SyntheticInfo &info, uint64_t inputSize, uint32_t iterations, std::vector<Phase> &phases)
+* Description: writes the results as a JSON document
+*
+* Parameters:
+*        os     I/O     std::ostream&   stream to write to
+*        options        I/P     const SyntheticOptions& settings the input was generated with
+*        info   I/P     const SyntheticInfo&    what the input contains
+*        inputSize      I/P     uint64_t        size of the input file
+*        iterations     I/P     uint32_t        number of measured runs
+*        phases I/O     std::vector<Phase>&     measured phases, their samples get sorted
+**************************************************************************/
+static void writeJson(std::ostream &os, const SyntheticOptions &options, const SyntheticInfo &info,
+                        uint64_t inputSize, uint32_t iterations, std::vector<Phase> &phases)
+{
+        os << "{\n";
+        os << "  \"input\": {\"bytes\": " << inputSize << ", \"tracks\": " << options.tracks
+           << ", \"co64\": " << (options.co64 ? "true" : "false") << ", \"padding\": " << options.padding
+           << ", \"min_moov_bytes\": " << options.moovSize << ", \"sample_limit\": " << options.samples
+           << ", \"sparse\": " << (options.sparse ? "true" : "false") << ", \"seed\": " << options.seed
+           << ", \"samples\": " << info.samples << ", \"chunks\": " << info.chunks
+           << ", \"moov_bytes\": " << info.moovSize << ", \"mdat_bytes\": " << info.mdatSize << "},\n";
+        os << "  \"iterations\": " << iterations << ",\n";
+        os << "  \"phases\": {\n";
+        for(size_t i = 0; i < phases.size(); i++){
+                Phase &p = phases[i];
+                std::sort(p.ns.begin(), p.ns.end());
+                uint64_t sum = 0;
+                for(uint64_t v : p.ns)
+                        sum += v;
+                uint64_t p50 = percentile(p.ns, 50);
+                double mbps = p50 ? (double)p.bytes / (1024.0 * 1024.0) / ((double)p50 / 1e9) : 0;
+                os << "    \"" << p.name << "\": {\"bytes\": " << p.bytes
+                   << ", \"ns\": {\"min\": " << (p.ns.empty() ? 0 : p.ns.front())
+                   << ", \"mean\": " << (p.ns.empty() ? 0 : sum / p.ns.size())
+                   << ", \"p50\": " << p50
+                   << ", \"p90\": " << percentile(p.ns, 90)
+                   << ", \"p99\": " << percentile(p.ns, 99)
+                   << ", \"max\": " << (p.ns.empty() ? 0 : p.ns.back()) << "}"
+                   << ", \"throughput_mib_s\": " << mbps
+                   << ", \"allocations\": " << p.allocations
+                   << ", \"allocated_bytes\": " << p.allocatedBytes
+                   << ", \"peak_heap_bytes\": " << p.peakBytes
+                   << ", \"rss_kb\": " << p.rssKb << "}"
+                   << (i + 1 < phases.size() ? ",\n" : "\n");
+        }
+        os << "  },\n";
+        os << "  \"peak_rss_kb\": " << readStatusKb("VmHWM:") << "\n";
+        os << "}" << std::endl;
+}
+
+
+/***************************************************************************
+* static byte* mapInput(const char* path, bool keep, uint64_t *len)
+* Description: maps a generated file copy-on-write, so the conversion reads
+*               it like a buffer without the whole file being loaded first
+*
+* Parameters:
+*        path   I/P     const char*     file to map
+*        keep   I/P     bool    false to unlink the file once it is mapped
+*        len    O/P     uint64_t*       size of the mapping
+*        mapInput       O/P     byte*   the mapping, NULL on errors
+**************************************************************************/
+static byte* mapInput(const char* path, bool keep, uint64_t *len)
+{
+        int fd = open(path, O_RDONLY);
+        if(!keep)
+                unlink(path);
+        if(fd < 0)
+                return NULL;
+        off_t size = lseek(fd, 0, SEEK_END);
+        void* map = size > 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if(map == MAP_FAILED)
+                return NULL;
+        *len = size;
+        return (byte*)map;
+}
+
+
+/***************************************************************************
+* int main(int argc, char* argv[])
+* Description: main function. Generates a synthetic mp4 with the moov behind the
+*               mdat, converts it repeatedly and reports the time, heap and
+*               resident memory of each phase of the conversion as JSON. The
+*               time of the phases (scan, moov_read, patch, copy) comes from
+*               the QtFastStartStats of the conversion, their heap is split up
+*               by the progress callback announcing each phase, "total" is the
+*               complete conversion through QtFastStart
+*
+* Parameters:
+*        argc   I/P     int     number of arguments
+*        argv   I/P     char* []        arguments passed (first element in name of application)
+*        main   O/P     int     exit code. returns 0 on success and 1 on errors
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+        SyntheticOptions options;
+        uint32_t iterations = 20;
+        std::string outStr, dumpStr;
+
+        struct option long_options[] = {
+                {"size",       required_argument, NULL, 's'},
+                {"samples",    required_argument, NULL, 'm'},
+                {"tracks",     required_argument, NULL, 't'},
+                {"padding",    required_argument, NULL, 'p'},
+                {"moov-size",  required_argument, NULL, 'M'},
+                {"sparse",     no_argument,       NULL, 'S'},
+                {"iterations", required_argument, NULL, 'n'},
+                {"seed",       required_argument, NULL, 'r'},
+                {"co64",       no_argument,       NULL, 'c'},
+                {"output",     required_argument, NULL, 'o'},
+                {"dump",       required_argument, NULL, 'd'},
+                {"help",       no_argument,       NULL, 'h'},
+                {NULL,      0,                   NULL, 0}
+        };
+
+        int ch;
+        while( (ch = getopt_long(argc, argv, "s:m:t:p:M:Sn:r:co:d:h", long_options, NULL)) != -1){
+                switch(ch){
+                        case 's':{
+                                options.mediaSize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+                                break;
+                        }
+                        case 'm':{
+                                options.samples = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 't':{
+                                options.tracks = strtoul(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'p':{
+                                options.padding = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'M':{
+                                options.moovSize = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'S':{
+                                options.sparse = true;
+                                break;
+                        }
+                        case 'n':{
+                                iterations = strtoul(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'r':{
+                                options.seed = strtoul(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'c':{
+                                options.co64 = true;
+                                break;
+                        }
+                        case 'o':{
+                                outStr = optarg;
+                                break;
+                        }
+                        case 'd':{
+                                dumpStr = optarg;
+                                break;
+                        }
+                        case 'h':
+                        default:{
+                                std::cerr << "Usage: " << argv[0] << " [--size -s MEBIBYTES] [--samples -m N] [--tracks -t N]"
+                                        " [--padding -p BYTES] [--moov-size -M BYTES] [--sparse -S] [--iterations -n N]"
+                                        " [--seed -r N] [--co64 -c] [--output -o JSONFILE] [--dump -d MP4FILE]" << std::endl;
+                                return 1;
+                        }
+                }
+        }
+        if(options.tracks == 0 || iterations == 0){
+                std::cerr << "tracks and iterations have to be at least 1" << std::endl;
+                return 1;
+        }
+
+        //the input is streamed to a file and mapped, so it never sits in the heap twice
+        std::string path = dumpStr;
+        if(path.empty()){
+                char tmp[] = "/tmp/qtfs-bench-XXXXXX";
+                int fd = mkstemp(tmp);
+                if(fd < 0){
+                        std::cerr << "Failed to create a temporary file" << std::endl;
+                        return 1;
+                }
+                close(fd);
+                path = tmp;
+        }
+        SyntheticInfo info;
+        if(!generateMp4(options, path.c_str(), &info)){
+                std::cerr << "Failed to write " << path << std::endl;
+                if(dumpStr.empty())
+                        unlink(path.c_str());
+                return 1;
+        }
+        uint64_t inputSize = 0;
+        byte* input = mapInput(path.c_str(), !dumpStr.empty(), &inputSize);
+        if(!input){
+                std::cerr << "Failed to map " << path << std::endl;
+                return 1;
+        }
+
+        //the media payload the output has to carry over
+        std::vector<QtFastStartSTD::AtomRange> top;
+        if(!QtFastStartSTD::scanAtoms(input, 0, inputSize, top)){
+                std::cerr << "Generated file is malformed" << std::endl;
+                return 1;
+        }
+        uint64_t media = QtFastStartSTD::mediaSize(top);
+
+        std::vector<Phase> phases;
+        for(int i = 0; i < QtFastStartSTD::PHASE_COUNT; i++)
+                phases.emplace_back(QtFastStartSTD::QtFastStartStats::phaseName((QtFastStartSTD::StatsPhase)i));
+        phases.emplace_back("total");
+        Phase &total = phases[QtFastStartSTD::PHASE_COUNT];
+
+        try{
+                for(uint32_t it = 0; it < iterations; it++){
+                        QtFastStartSTD::QtFastStartStats stats;
+                        Tracker tracker;
+                        tracker.phases = &phases;
+                        QtFastStartSTD::QtFastStartOptions convert;
+                        convert.stats = &stats;
+                        convert.progress = onProgress;
+                        convert.progressData = &tracker;
+
+                        Probe p = begin();
+                        tracker.startBytes = p.liveBytes;
+                        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                        QtFastStartSTD::QtFastStart *qtfs = new QtFastStartSTD::QtFastStart(input, inputSize, convert);
+                        std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+                        closePhase(&tracker);
+                        total.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+                        //each phase restarted the peak, so the overall one is the highest of them
+                        int64_t peak = tracker.peak;
+                        end(p, total);
+                        total.peakBytes = peak;
+                        total.bytes = inputSize;
+
+                        if(stats.fallback != QtFastStartSTD::FALLBACK_NONE){
+                                std::cerr << "input was passed through: "
+                                        << QtFastStartSTD::QtFastStartStats::fallbackName(stats.fallback) << std::endl;
+                                delete qtfs;
+                                return 1;
+                        }
+                        if(it == 0){
+                                QtFastStartSTD::QtFastStartResult valid =
+                                        QtFastStartSTD::validateFastStart(qtfs->getData(), qtfs->getLength(), media);
+                                if(!valid.ok()){
+                                        std::cerr << "conversion output is not valid: " << valid.message << std::endl;
+                                        delete qtfs;
+                                        return 1;
+                                }
+                        }
+                        for(int i = 0; i < QtFastStartSTD::PHASE_COUNT; i++)
+                                phases[i].ns.push_back(stats.phaseNs[i]);
+                        phases[QtFastStartSTD::PHASE_SCAN].bytes = inputSize;
+                        phases[QtFastStartSTD::PHASE_MOOV_READ].bytes = info.moovSize;
+                        phases[QtFastStartSTD::PHASE_PATCH].bytes = info.moovSize;
+                        phases[QtFastStartSTD::PHASE_COPY].bytes = stats.bytesCopied;
+                        delete qtfs;
+                }
+        }catch(std::exception const &e){
+                std::cerr << "Failed to benchmark: " << e.what() << std::endl;
+                return 1;
+        }catch(...){
+                std::cerr << "Failed to benchmark" << std::endl;
+                return 1;
+        }
+
+        if(outStr.empty())
+                writeJson(std::cout, options, info, inputSize, iterations, phases);
+        else{
+                std::ofstream out(outStr);
+                if(!out){
+                        std::cerr << "Failed to open " << outStr << std::endl;
+                        return 1;
+                }
+                writeJson(out, options, info, inputSize, iterations, phases);
+        }
+        munmap(input, inputSize);
+        return 0;
+}
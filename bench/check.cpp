@@ -0,0 +1,686 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  check.cpp
+* Procedures:
+* loadMp4       -generates a synthetic mp4 and reads it into memory
+* mapMp4        -generates a synthetic mp4 and maps it copy-on-write
+* findMoov      -parses the moov of a converted file
+* sampleBytes   -adds up the sample sizes of a moov
+* convert       -converts a file and checks that the output is valid fast-start
+* fragment      -converts a file into a fragmented mp4
+* appendItem    -appends a top-level meta whose one item points into the file
+* itemOffset    -reads back the item offset of that meta
+* report        -prints the result of one check
+* checkFreeSlotCompact  -compaction is not skipped when the moov fits the padding
+* checkRechunkOnly      -rechunk alone rewrites only stsc and the chunk offsets, at their width
+* checkFreeSlotChecksum -moving the moov into the padding hashes the output while writing it
+* checkInPlaceExactSlot -a moov that fills the padding exactly is moved in place without a free header
+* checkWidenPast4GB     -stco tables the moved moov pushes past 4GB become co64
+* checkInterleave       -interleaving moves the chunks and the items of a top-level meta with them
+* checkDropTrack        -dropping a track leaves its media out and keeps the items of the others
+* checkTrim     -trimming copies only the clip and refuses items outside of it
+* checkFragment -fragmenting keeps every sample and compresses the init moov if asked to
+* checkDefragment       -fragments merge back into one moov, honoring the output options
+* main          -runs every check
+***************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "QtFastStartCPP.hpp"
+#include "Synthetic.hpp"
+#include "Cursor.hpp"
+#include "Endian.hpp"
+
+
+/***************************************************************************
+* static bool loadMp4(const SyntheticOptions &options, std::vector<byte> &out)
+* Description: generates a synthetic mp4 into a temporary file and reads it
+*               into memory
+*
+* Parameters:
+*        options        I/P     const SyntheticOptions& shape of the file
+*        out    O/P     std::vector<byte>&      the generated file
+*        loadMp4        O/P     bool    false if the file could not be generated
+**************************************************************************/
+static bool loadMp4(const SyntheticOptions &options, std::vector<byte> &out)
+{
+        char path[] = "/tmp/qtfs-check-XXXXXX";
+        int fd = mkstemp(path);
+        if(fd < 0)
+                return false;
+        close(fd);
+        SyntheticInfo info;
+        bool ok = generateMp4(options, path, &info);
+        FILE* f = ok ? fopen(path, "rb") : NULL;
+        unlink(path);
+        if(!f)
+                return false;
+        out.resize(info.fileSize);
+        ok = fread(out.data(), 1, out.size(), f) == out.size();
+        fclose(f);
+        return ok;
+}
+
+/***************************************************************************
+* static byte* mapMp4(const SyntheticOptions &options, uint64_t *len)
+* Description: generates a synthetic mp4 into a temporary file and maps it
+*               copy-on-write, so a sparse file of several gigabytes costs
+*               no memory until it is written to
+*
+* Parameters:
+*        options        I/P     const SyntheticOptions& shape of the file
+*        len    O/P     uint64_t*       size of the mapping
+*        mapMp4 O/P     byte*   the mapping, to be released with munmap, NULL on errors
+**************************************************************************/
+static byte* mapMp4(const SyntheticOptions &options, uint64_t *len)
+{
+        char path[] = "/tmp/qtfs-check-XXXXXX";
+        int fd = mkstemp(path);
+        if(fd < 0)
+                return NULL;
+        close(fd);
+        SyntheticInfo info;
+        bool ok = generateMp4(options, path, &info);
+        fd = ok ? open(path, O_RDONLY) : -1;
+        unlink(path);
+        if(fd < 0)
+                return NULL;
+        void* map = mmap(NULL, info.fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED)
+                return NULL;
+        *len = info.fileSize;
+        return (byte*)map;
+}
+
+/***************************************************************************
+* static bool findMoov(const byte* file, uint64_t len, QtFastStartSTD::Atom *moov)
+* Description: parses the moov of a converted file
+*
+* Parameters:
+*        file   I/P     const byte*     the file
+*        len    I/P     uint64_t        length of the file
+*        moov   O/P     QtFastStartSTD::Atom*   the parsed moov
+*        findMoov       O/P     bool    false if the file has no moov
+**************************************************************************/
+static bool findMoov(const byte* file, uint64_t len, QtFastStartSTD::Atom *moov)
+{
+        std::vector<QtFastStartSTD::AtomRange> top;
+        if(!QtFastStartSTD::scanAtoms(file, 0, len, top))
+                return false;
+        for(const QtFastStartSTD::AtomRange &r : top){
+                if(r.type == MOOV_ATOM){
+                        *moov = QtFastStartSTD::Atom::parse(&file[r.offset], r.size);
+                        return true;
+                }
+        }
+        return false;
+}
+
+/***************************************************************************
+* static uint64_t sampleBytes(QtFastStartSTD::Atom &moov)
+* Description: adds up the sizes of all samples in the stsz tables of a moov
+*
+* Parameters:
+*        moov   I/P     QtFastStartSTD::Atom&   the moov
+*        sampleBytes    O/P     uint64_t        bytes of sample data the moov refers to
+**************************************************************************/
+static uint64_t sampleBytes(QtFastStartSTD::Atom &moov)
+{
+        uint64_t total = 0;
+        for(QtFastStartSTD::Atom* stsz : moov.findAll(STSZ_ATOM)){
+                uint32_t size = stsz->getUint_32(4);
+                uint32_t count = stsz->getUint_32(8);
+                if(size != 0)
+                        total += (uint64_t)size * count;
+                else
+                        for(uint32_t i = 0; i < count; i++)
+                                total += stsz->getUint_32(12 + (uint64_t)i * 4);
+        }
+        return total;
+}
+
+/***************************************************************************
+* static bool convert(std::vector<byte> &in, const QtFastStartSTD::QtFastStartOptions &options, std::vector<byte> &out, bool keepsMedia = true)
+* Description: converts a file and checks that the output is valid fast-start
+*               output carrying all of the input's media data, or exactly the
+*               samples its own moov refers to when media is left out
+*
+* Parameters:
+*        in     I/O     std::vector<byte>&      input file, changed with options.inPlace
+*        options        I/P     const QtFastStartSTD::QtFastStartOptions&       settings of the conversion
+*        out    O/P     std::vector<byte>&      the converted file
+*        keepsMedia     I/P     bool    false if tracks are dropped or trimmed
+*        convert        O/P     bool    false if the conversion failed or its output is invalid
+**************************************************************************/
+static bool convert(std::vector<byte> &in, const QtFastStartSTD::QtFastStartOptions &options, std::vector<byte> &out,
+                        bool keepsMedia = true)
+{
+        std::vector<QtFastStartSTD::AtomRange> top;
+        if(!QtFastStartSTD::scanAtoms(in.data(), 0, in.size(), top))
+                return false;
+        uint64_t media = QtFastStartSTD::mediaSize(top);
+
+        QtFastStartSTD::QtFastStartResult result;
+        QtFastStartSTD::QtFastStart qtfs(in.data(), in.size(), options, &result);
+        if(!result.ok())
+                return false;
+        out.assign(qtfs.getData(), qtfs.getData() + qtfs.getLength());
+        QtFastStartSTD::Atom moov;
+        if(!keepsMedia){
+                if(!findMoov(out.data(), out.size(), &moov))
+                        return false;
+                media = sampleBytes(moov);
+        }
+        return QtFastStartSTD::validateFastStart(out.data(), out.size(), media).ok();
+}
+
+/***************************************************************************
+* static bool fragment(std::vector<byte> &in, std::vector<byte> &out)
+* Description: converts a file into a fragmented mp4
+*
+* Parameters:
+*        in     I/O     std::vector<byte>&      input file
+*        out    O/P     std::vector<byte>&      the fragmented file
+*        fragment       O/P     bool    false if the conversion failed
+**************************************************************************/
+static bool fragment(std::vector<byte> &in, std::vector<byte> &out)
+{
+        QtFastStartSTD::QtFastStartOptions options;
+        options.mode = QtFastStartSTD::MODE_FRAGMENTED;
+        options.fragmentDuration = 1000;
+        QtFastStartSTD::QtFastStartResult result;
+        QtFastStartSTD::QtFastStart qtfs(in.data(), in.size(), options, &result);
+        if(!result.ok())
+                return false;
+        out.assign(qtfs.getData(), qtfs.getData() + qtfs.getLength());
+        return true;
+}
+
+/***************************************************************************
+* static void appendItem(std::vector<byte> &file, uint64_t offset)
+* Description: appends a top-level meta with one item, a four byte iloc
+*               extent at the given file offset
+*
+* Parameters:
+*        file   I/O     std::vector<byte>&      file to append to
+*        offset I/P     uint64_t        file offset of the item data
+**************************************************************************/
+static void appendItem(std::vector<byte> &file, uint64_t offset)
+{
+        QtFastStartSTD::Atom hdlr(HDLR_ATOM), iloc(ILOC_ATOM), meta(META_ATOM);
+        hdlr.putUint_32(0);
+        hdlr.putUint_32(0);
+        hdlr.putUint_32(be32toh(PICT_ATOM));
+        hdlr.putUint_32(0);
+        hdlr.putUint_32(0);
+        hdlr.putUint_32(0);
+        hdlr.putUint_8(0);
+        iloc.putUint_32(1 << 24);               //version 1
+        iloc.putUint_8(0x84);                   //8 byte offsets, 4 byte lengths
+        iloc.putUint_8(0);                      //no base offset, no extent index
+        iloc.putUint_16(1);                     //item count
+        iloc.putUint_16(1);                     //item ID
+        iloc.putUint_16(0);                     //stored in the file
+        iloc.putUint_16(0);                     //data reference index
+        iloc.putUint_16(1);                     //extent count
+        iloc.putUint_64(offset);
+        iloc.putUint_32(4);
+        meta.putUint_32(0);
+        hdlr.serialize(meta.data);
+        iloc.serialize(meta.data);
+        meta.serialize(file);
+}
+
+/***************************************************************************
+* static bool itemOffset(const std::vector<byte> &file, uint64_t *offset)
+* Description: reads back the extent offset of the item appendItem() wrote
+*
+* Parameters:
+*        file   I/P     const std::vector<byte>&        the file
+*        offset O/P     uint64_t*       file offset of the item data
+*        itemOffset     O/P     bool    false if the file has no such item
+**************************************************************************/
+static bool itemOffset(const std::vector<byte> &file, uint64_t *offset)
+{
+        std::vector<QtFastStartSTD::AtomRange> top, children;
+        if(!QtFastStartSTD::scanAtoms(file.data(), 0, file.size(), top))
+                return false;
+        for(const QtFastStartSTD::AtomRange &r : top){
+                if(r.type != META_ATOM || !QtFastStartSTD::scanAtoms(file.data(), r.offset + r.headerSize + 4, r.offset + r.size, children))
+                        continue;
+                for(const QtFastStartSTD::AtomRange &c : children){
+                        if(c.type == ILOC_ATOM){
+                                *offset = BYTEBUFFER::BigEndian::load64(&file[c.offset + c.headerSize + 16]);
+                                return true;
+                        }
+                }
+        }
+        return false;
+}
+
+/***************************************************************************
+* static bool report(const char* name, bool passed)
+* Description: prints the result of one check
+*
+* Parameters:
+*        name   I/P     const char*     name of the check
+*        passed I/P     bool    result of the check
+*        report O/P     bool    passed
+**************************************************************************/
+static bool report(const char* name, bool passed)
+{
+        std::cout << (passed ? "ok      " : "FAILED  ") << name << std::endl;
+        return passed;
+}
+
+/***************************************************************************
+* static bool checkFreeSlotCompact(void)
+* Description: a moov that fits the padding in front of the mdat is still
+*               compacted when compaction is asked for. The input has co64
+*               tables that compaction narrows to stco
+*
+* Parameters:
+*        checkFreeSlotCompact   O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkFreeSlotCompact(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        synthetic.co64 = true;
+        synthetic.padding = 200000;
+        std::vector<byte> in, plain, compact;
+        if(!loadMp4(synthetic, in))
+                return false;
+
+        QtFastStartSTD::QtFastStartOptions options;
+        if(!convert(in, options, plain))
+                return false;
+        options.compactMoov = true;
+        if(!convert(in, options, compact))
+                return false;
+
+        QtFastStartSTD::Atom plainMoov, compactMoov;
+        if(!findMoov(plain.data(), plain.size(), &plainMoov) || !findMoov(compact.data(), compact.size(), &compactMoov))
+                return false;
+        return compactMoov.size() < plainMoov.size() && compactMoov.findAll(CO64_ATOM).empty()
+                && !compactMoov.findAll(STCO_ATOM).empty();
+}
+
+/***************************************************************************
+* static bool checkRechunkOnly(void)
+* Description: rechunk without compaction merges the chunks of a track laid
+*               out back to back, also when the moov fits the padding, and
+*               rewrites nothing but stsc and the chunk offsets: co64 stays
+*               co64 and stsz stays as it was
+*
+* Parameters:
+*        checkRechunkOnly       O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkRechunkOnly(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        synthetic.tracks = 1;
+        synthetic.co64 = true;
+        synthetic.padding = 200000;
+        std::vector<byte> in, plain, merged;
+        if(!loadMp4(synthetic, in))
+                return false;
+
+        QtFastStartSTD::QtFastStartOptions options;
+        if(!convert(in, options, plain))
+                return false;
+        options.rechunk = true;
+        if(!convert(in, options, merged))
+                return false;
+
+        QtFastStartSTD::Atom plainMoov, mergedMoov;
+        if(!findMoov(plain.data(), plain.size(), &plainMoov) || !findMoov(merged.data(), merged.size(), &mergedMoov))
+                return false;
+        std::vector<QtFastStartSTD::Atom*> plainCo = plainMoov.findAll(CO64_ATOM), mergedCo = mergedMoov.findAll(CO64_ATOM);
+        std::vector<QtFastStartSTD::Atom*> plainStsz = plainMoov.findAll(STSZ_ATOM), mergedStsz = mergedMoov.findAll(STSZ_ATOM);
+        return plainCo.size() == 1 && mergedCo.size() == 1 && mergedMoov.findAll(STCO_ATOM).empty()
+                && mergedCo[0]->getUint_32(4) == 1 && plainCo[0]->getUint_32(4) > 1
+                && plainStsz.size() == 1 && mergedStsz.size() == 1 && plainStsz[0]->data == mergedStsz[0]->data;
+}
+
+/***************************************************************************
+* static bool checkFreeSlotChecksum(void)
+* Description: moving the moov into the padding in front of the mdat writes
+*               the output front to back, so every byte is hashed as it is
+*               written and the finished output is never hashed again
+*
+* Parameters:
+*        checkFreeSlotChecksum  O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkFreeSlotChecksum(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        synthetic.padding = 200000;
+        std::vector<byte> in, out;
+        if(!loadMp4(synthetic, in))
+                return false;
+
+        QtFastStartSTD::Checksum sum(QtFastStartSTD::CHECKSUM_XXH3 | QtFastStartSTD::CHECKSUM_CRC32C);
+        QtFastStartSTD::QtFastStartOptions options;
+        options.checksum = &sum;
+        if(!convert(in, options, out))
+                return false;
+        QtFastStartSTD::Checksum expected(sum.kinds);
+        expected.finish(out.data(), out.size());
+        //the moov was the last atom, so only the free-slot path makes the file shorter
+        return out.size() < in.size() && sum.fusedBytes == out.size() && sum.total.length == out.size()
+                && sum.total.xxh3 == expected.total.xxh3 && sum.total.crc32c == expected.total.crc32c;
+}
+
+/***************************************************************************
+* static bool checkInPlaceExactSlot(void)
+* Description: padding exactly the size of the moov leaves no room for a
+*               free atom behind it. Moving the moov in place must write
+*               the moov alone, leaving the mdat header intact, and give
+*               the same file as the copying conversion
+*
+* Parameters:
+*        checkInPlaceExactSlot  O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkInPlaceExactSlot(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        synthetic.padding = 200000;
+        std::vector<byte> in, copied, moved;
+        QtFastStartSTD::Atom moov;
+        if(!loadMp4(synthetic, in) || !findMoov(in.data(), in.size(), &moov))
+                return false;
+        synthetic.padding = moov.size();
+        if(!loadMp4(synthetic, in))
+                return false;
+
+        QtFastStartSTD::QtFastStartOptions options;
+        if(!convert(in, options, copied))
+                return false;
+        options.inPlace = true;
+        if(!convert(in, options, moved))
+                return false;
+
+        std::vector<QtFastStartSTD::AtomRange> top;
+        if(!QtFastStartSTD::scanAtoms(moved.data(), 0, moved.size(), top))
+                return false;
+        //ftyp, moov, mdat: the moov was the last atom, so the file is cut behind the mdat
+        return top.size() == 3 && top[1].type == MOOV_ATOM && top[2].type == MDAT_ATOM
+                && moved == copied && memcmp(in.data(), moved.data(), moved.size()) == 0;
+}
+
+/***************************************************************************
+* static bool checkWidenPast4GB(void)
+* Description: a file with stco tables and the moov behind almost 4GB of
+*               media. Moving the moov in front pushes the last chunks past
+*               4GB, so their tables have to come out as co64 instead of
+*               being truncated. Needs the output, a little over 4GB, in memory
+*
+* Parameters:
+*        checkWidenPast4GB      O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkWidenPast4GB(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.mediaSize = UINT32_MAX - 2 * 1024 * 1024;
+        synthetic.sparse = true;
+        uint64_t len = 0;
+        byte* in = mapMp4(synthetic, &len);
+        if(!in)
+                return false;
+
+        std::vector<QtFastStartSTD::AtomRange> top;
+        bool passed = QtFastStartSTD::scanAtoms(in, 0, len, top);
+        uint64_t media = passed ? QtFastStartSTD::mediaSize(top) : 0;
+        if(passed){
+                QtFastStartSTD::QtFastStartResult result;
+                QtFastStartSTD::QtFastStartOptions options;
+                QtFastStartSTD::QtFastStart qtfs(in, len, options, &result);
+                QtFastStartSTD::Atom moov;
+                passed = result.ok() && qtfs.getLength() > (uint64_t)UINT32_MAX + 1
+                        && QtFastStartSTD::validateFastStart(qtfs.getData(), qtfs.getLength(), media).ok()
+                        && findMoov(qtfs.getData(), qtfs.getLength(), &moov)
+                        && !moov.findAll(CO64_ATOM).empty();
+        }
+        munmap(in, len);
+        return passed;
+}
+
+/***************************************************************************
+* static bool checkInterleave(void)
+* Description: interleaving regroups the chunks into the new duration and
+*               moves them, and the item of a top-level meta behind the mdat
+*               still points at the same sample bytes afterwards
+*
+* Parameters:
+*        checkInterleave        O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkInterleave(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        std::vector<byte> in, out;
+        if(!loadMp4(synthetic, in))
+                return false;
+        QtFastStartSTD::Atom inMoov;
+        if(!findMoov(in.data(), in.size(), &inMoov))
+                return false;
+        std::vector<QtFastStartSTD::Atom*> stco = inMoov.findAll(STCO_ATOM);
+        if(stco.empty())
+                return false;
+        uint32_t chunks = stco[0]->getUint_32(4);
+        uint64_t item = stco[0]->getUint_32(8 + 4 * (chunks - 1)) + 2;
+        appendItem(in, item);
+
+        QtFastStartSTD::QtFastStartOptions options;
+        options.interleaveDuration = 500;
+        QtFastStartSTD::Atom outMoov;
+        uint64_t moved = 0;
+        if(!convert(in, options, out) || !findMoov(out.data(), out.size(), &outMoov) || !itemOffset(out, &moved))
+                return false;
+        stco = outMoov.findAll(STCO_ATOM);
+        return !stco.empty() && stco[0]->getUint_32(4) != chunks && moved != item && moved + 4 <= out.size()
+                && memcmp(&in[item], &out[moved], 4) == 0;
+}
+
+/***************************************************************************
+* static bool checkDropTrack(void)
+* Description: dropping a track leaves its trak and its chunks out, and the
+*               item of a top-level meta pointing into a kept track follows
+*               its sample
+*
+* Parameters:
+*        checkDropTrack O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkDropTrack(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        synthetic.tracks = 3;
+        std::vector<byte> in, out;
+        if(!loadMp4(synthetic, in))
+                return false;
+        QtFastStartSTD::Atom inMoov;
+        if(!findMoov(in.data(), in.size(), &inMoov))
+                return false;
+        std::vector<QtFastStartSTD::Atom*> stco = inMoov.findAll(STCO_ATOM);
+        if(stco.size() != 3)
+                return false;
+        uint64_t item = stco[2]->getUint_32(8 + 4 * (stco[2]->getUint_32(4) - 1)) + 2;
+        appendItem(in, item);
+
+        QtFastStartSTD::QtFastStartOptions options;
+        options.dropTrackIds.push_back(2);
+        QtFastStartSTD::Atom outMoov;
+        uint64_t moved = 0;
+        if(!convert(in, options, out, false) || !findMoov(out.data(), out.size(), &outMoov) || !itemOffset(out, &moved))
+                return false;
+        return outMoov.findAll(TRAK_ATOM).size() == 2 && sampleBytes(outMoov) < sampleBytes(inMoov)
+                && moved + 4 <= out.size() && memcmp(&in[item], &out[moved], 4) == 0;
+}
+
+/***************************************************************************
+* static bool checkTrim(void)
+* Description: trimming copies only the samples of the clip, and refuses an
+*               input whose top-level meta points at data outside of it
+*
+* Parameters:
+*        checkTrim      O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkTrim(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        std::vector<byte> in, out;
+        if(!loadMp4(synthetic, in))
+                return false;
+        QtFastStartSTD::Atom inMoov, outMoov;
+        if(!findMoov(in.data(), in.size(), &inMoov))
+                return false;
+
+        QtFastStartSTD::QtFastStartOptions options;
+        options.trimStart = 2000;
+        options.trimLength = 3000;
+        if(!convert(in, options, out, false) || !findMoov(out.data(), out.size(), &outMoov))
+                return false;
+        uint64_t clip = sampleBytes(outMoov);
+        if(clip == 0 || clip >= sampleBytes(inMoov) / 2)
+                return false;
+
+        //the first chunk lies before the clip
+        std::vector<QtFastStartSTD::Atom*> stco = inMoov.findAll(STCO_ATOM);
+        if(stco.empty())
+                return false;
+        appendItem(in, stco[0]->getUint_32(8) + 2);
+        QtFastStartSTD::QtFastStartResult result;
+        QtFastStartSTD::QtFastStart qtfs(in.data(), in.size(), options, &result);
+        return result.status == QtFastStartSTD::STATUS_MALFORMED_ATOM;
+}
+
+/***************************************************************************
+* static bool checkFragment(void)
+* Description: fragmenting writes an init moov with mvex followed by moof and
+*               mdat pairs carrying every sample, and compresses the init moov
+*               with compressMoov
+*
+* Parameters:
+*        checkFragment  O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkFragment(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        std::vector<byte> in, plain, compressed;
+        QtFastStartSTD::Atom plainMoov, compressedMoov;
+        if(!loadMp4(synthetic, in))
+                return false;
+
+        QtFastStartSTD::QtFastStartOptions options;
+        options.mode = QtFastStartSTD::MODE_FRAGMENTED;
+        options.fragmentDuration = 1000;
+        if(!convert(in, options, plain) || !findMoov(plain.data(), plain.size(), &plainMoov))
+                return false;
+        options.compressMoov = true;
+        if(!convert(in, options, compressed) || !findMoov(compressed.data(), compressed.size(), &compressedMoov))
+                return false;
+
+        std::vector<QtFastStartSTD::AtomRange> top;
+        if(!QtFastStartSTD::scanAtoms(plain.data(), 0, plain.size(), top))
+                return false;
+        uint32_t fragments = 0;
+        for(const QtFastStartSTD::AtomRange &r : top)
+                fragments += r.type == MOOF_ATOM;
+        return fragments > 1 && plainMoov.find(MVEX_ATOM) && compressedMoov.find(CMOV_ATOM)
+                && compressed.size() < plain.size();
+}
+
+/***************************************************************************
+* static bool checkDefragment(void)
+* Description: a fragmented file merges back into one moov in front of one
+*               mdat with every sample, also when the output is interleaved,
+*               rechunked or compressed
+*
+* Parameters:
+*        checkDefragment        O/P     bool    true if the check passed
+**************************************************************************/
+static bool checkDefragment(void)
+{
+        SyntheticOptions synthetic;
+        synthetic.samples = 2000;
+        std::vector<byte> in, fragmented, plain, interleaved, compressed;
+        QtFastStartSTD::Atom inMoov, plainMoov, interleavedMoov, compressedMoov;
+        if(!loadMp4(synthetic, in) || !findMoov(in.data(), in.size(), &inMoov) || !fragment(in, fragmented))
+                return false;
+
+        QtFastStartSTD::QtFastStartOptions options;
+        if(!convert(fragmented, options, plain) || !findMoov(plain.data(), plain.size(), &plainMoov))
+                return false;
+        options.interleaveDuration = 250;
+        options.rechunk = true;
+        if(!convert(fragmented, options, interleaved) || !findMoov(interleaved.data(), interleaved.size(), &interleavedMoov))
+                return false;
+        options.compressMoov = true;
+        if(!convert(fragmented, options, compressed) || !findMoov(compressed.data(), compressed.size(), &compressedMoov))
+                return false;
+
+        std::vector<QtFastStartSTD::Atom*> plainStco = plainMoov.findAll(STCO_ATOM);
+        std::vector<QtFastStartSTD::Atom*> interleavedStco = interleavedMoov.findAll(STCO_ATOM);
+        return sampleBytes(plainMoov) == sampleBytes(inMoov) && sampleBytes(interleavedMoov) == sampleBytes(inMoov)
+                && plainStco.size() == 2 && interleavedStco.size() == 2
+                && plainStco[0]->getUint_32(4) != interleavedStco[0]->getUint_32(4)
+                && compressedMoov.find(CMOV_ATOM) && compressed.size() < interleaved.size();
+}
+
+
+/***************************************************************************
+* int main(void)
+* Description: main function. Runs every check on synthetic files
+*
+* Parameters:
+*        main   O/P     int     exit code. returns 0 if every check passed and 1 otherwise
+**************************************************************************/
+int main(void)
+{
+        bool passed = true;
+        try{
+                passed &= report("free slot with compaction", checkFreeSlotCompact());
+                passed &= report("rechunk without compaction", checkRechunkOnly());
+                passed &= report("free slot checksum while writing", checkFreeSlotChecksum());
+                passed &= report("in place, moov fills the padding", checkInPlaceExactSlot());
+                passed &= report("stco widened past 4GB", checkWidenPast4GB());
+                passed &= report("interleave", checkInterleave());
+                passed &= report("drop track", checkDropTrack());
+                passed &= report("trim", checkTrim());
+                passed &= report("fragment", checkFragment());
+                passed &= report("defragment", checkDefragment());
+        }catch(std::exception const &e){
+                std::cerr << "Check failed: " << e.what() << std::endl;
+                return 1;
+        }
+        return passed ? 0 : 1;
+}
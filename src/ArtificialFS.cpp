@@ -22,6 +22,7 @@
 * QtFastStartSTD::ArtificialFileStream::~ArtificialFileStream   -Default destructor
 * QtFastStartSTD::ArtificialFileStream::ArtificialFileStream    -Default constructor
 * QtFastStartSTD::ArtificialFileStream::ArtificialFileStream    -Overloaded constructor, takes in array of bytes of the file and it's length
+* QtFastStartSTD::ArtificialFileStream::ArtificialFileStream    -Overloaded constructor, can also reference the array of bytes instead of copying it
 * QtFastStartSTD::ArtificialFileStream::getPosition     -returns the position of the artificial file stream
 * QtFastStartSTD::ArtificialFileStream::size    -returns size of the artificial filestream
 * QtFastStartSTD::ArtificialFileStream::getByteArray    -returns pointer to internal byte array
@@ -35,6 +36,13 @@
 * QtFastStartSTD::ArtificialFileStream::write   -write a bytebuffer to the file stream at the specified position in the stream
 * QtFastStartSTD::ArtificialFileStream::transferTo      -transfers data from this artificial file stream to an inputted stream
 * QtFastStartSTD::ArtificialFileStream::ArtificialFileStream    -Copy constructor
+* QtFastStartSTD::ArtificialFileStream::reserve -preallocates room for the stream to grow to the given size
+* QtFastStartSTD::ArtificialFileStream::grow    -makes sure the stream can hold the given size, growing geometrically
+* QtFastStartSTD::ArtificialFileStream::own     -replaces a referenced byte array with a private copy before it gets modified
+* QtFastStartSTD::ArtificialFileStream::getCapacity     -returns the number of bytes the stream has allocated
+* QtFastStartSTD::ArtificialFileStream::getAllocations  -returns how many times the stream has allocated memory
+* QtFastStartSTD::ArtificialFileStream::setChecksum     -hashes the bytes written to the stream from now on
+* QtFastStartSTD::ArtificialFileStream::copyIn  -copies bytes into the stream, hashing them on the way if a checksum is set
 ***************************************************************************/
 
 
@@ -131,7 +139,8 @@ extern "C"
 **************************************************************************/
         QtFastStartSTD::ArtificialFileStream::~ArtificialFileStream(void)
         {
-                free(this->data);
+                if(this->owned)
+                        free(this->data);
         }
 
 /***************************************************************************
@@ -147,6 +156,7 @@ extern "C"
                 this->data = NULL;
                 this->position = 0;
                 this->totalSize = 0;
+                this->capacity = 0;
         }
 /***************************************************************************
 * QtFastStartSTD::ArtificialFileStream::ArtificialFileStream(byte* in, uint64_t len)
@@ -162,7 +172,37 @@ extern "C"
         {
                 this->data = (byte*)malloc(len);
                 memcpy(this->data, in, len);
+                this->allocations = 1;
                 this->totalSize = len;
+                this->capacity = len;
+                this->position = 0;
+        }
+/***************************************************************************
+* QtFastStartSTD::ArtificialFileStream::ArtificialFileStream(const byte* in, uint64_t len, QtFastStartSTD::StreamData mode)
+* Description: Overloaded constructor, can also reference the array of bytes
+*               instead of copying it. A referenced array is never written to,
+*               the stream copies it the first time it is modified
+*
+* Parameters:
+*        in     I/P     const byte*     input byte array of file, has to outlive a borrowing stream
+*        len    I/P     uint64_t        length of input file
+*        mode   I/P     QtFastStartSTD::StreamData      STREAM_COPY to copy the array, STREAM_BORROW to reference it
+**************************************************************************/
+        QtFastStartSTD::ArtificialFileStream::ArtificialFileStream(const byte* in, uint64_t len, QtFastStartSTD::StreamData mode)
+        {
+                if(mode == STREAM_BORROW){
+                        this->data = (byte*)in;
+                        this->owned = false;
+                }
+                else{
+                        this->data = (byte*)malloc(len);
+                        if(len && !this->data)
+                                throw Alloc_Fail();
+                        memcpy(this->data, in, len);
+                        this->allocations = 1;
+                }
+                this->totalSize = len;
+                this->capacity = len;
                 this->position = 0;
         }
 /***************************************************************************
@@ -263,10 +303,10 @@ extern "C"
                         throw Bad_Position(pos, this->totalSize);
                 }
                 if(this->totalSize - pos < len)
-                        q = this->totalSize = pos;
+                        q = this->totalSize - pos;
                 else
-                        q = len; ///TODO: VERIFY THIS
-                memcpy(dest, &this->data[position], q);
+                        q = len;
+                memcpy(dest, &this->data[pos], q);
                 this->position = pos + q;
                 return q;
 
@@ -338,12 +378,8 @@ extern "C"
 **************************************************************************/
         uint64_t QtFastStartSTD::ArtificialFileStream::write(const byte* src, uint64_t len)
         {
-                byte* tmp = (byte*)realloc(this->data, this->totalSize + len);
-                if(!tmp){
-                        throw Alloc_Fail();
-                }
-                this->data = tmp;
-                memcpy(&this->data[this->totalSize], src, len);
+                this->grow(this->totalSize + len);
+                this->copyIn(this->totalSize, src, len);
                 this->totalSize += len;
                 return len;
         }
@@ -365,25 +401,14 @@ extern "C"
 **************************************************************************/
         uint64_t QtFastStartSTD::ArtificialFileStream::write(uint64_t pos, const byte* src, uint64_t len)
         {
-                if(pos > this->totalSize){
-                        byte* tmp = (byte*)realloc(this->data, pos);
-                        if(!tmp){
-                                throw Alloc_Fail();
-                        }
-                        this->data = tmp;
-                        memcpy(&this->data[totalSize], src, len);
-                        return len;
-                }
-
+                this->own();
                 if(pos + len > this->totalSize){
-                        byte* tmp = (byte*)realloc(this->data, pos + len);
-                        if(!tmp){
-                                throw Alloc_Fail();
-                        }
-                        this->data = tmp;
-
+                        this->grow(pos + len);
+                        if(pos > this->totalSize)
+                                memset(&this->data[this->totalSize], 0, pos - this->totalSize);
+                        this->totalSize = pos + len;
                 }
-                memcpy(&this->data[position], src, len);
+                this->copyIn(pos, src, len);
                 return len;
 
         }
@@ -399,13 +424,8 @@ extern "C"
 **************************************************************************/
         uint64_t QtFastStartSTD::ArtificialFileStream::write(BYTEBUFFER::ByteBuffer *buff)
         {
-                byte* tmp = (byte*)realloc(this->data, this->totalSize + buff->getCapacity());
-                if(!tmp){
-                        throw Alloc_Fail();
-                }
-                this->data = tmp;
-
-                memcpy(&this->data[totalSize], buff->getData(), buff->getCapacity());
+                this->grow(this->totalSize + buff->getCapacity());
+                this->copyIn(this->totalSize, buff->getData(), buff->getCapacity());
                 this->totalSize+=buff->getCapacity();
                 return buff->getCapacity();
         }
@@ -422,31 +442,7 @@ extern "C"
 **************************************************************************/
         uint64_t QtFastStartSTD::ArtificialFileStream::write(uint64_t pos, BYTEBUFFER::ByteBuffer *buff)
         {
-                if(pos > this->totalSize){
-                        byte* tmp = (byte*)realloc(this->data, pos);
-                        if(!tmp){
-                                throw Alloc_Fail();
-                        }
-                        this->data = tmp;
-
-                        memcpy(&(this->data[pos - buff->getCapacity()]), buff->getData(), buff->getCapacity());
-                        this->totalSize = pos;
-                        return buff->getCapacity();
-                }
-
-                if(pos + buff->getCapacity() > this->totalSize){
-                        byte* tmp = (byte*)realloc(this->data, pos + buff->getCapacity());
-                        if(!tmp){
-                                throw Alloc_Fail();
-                        }
-                        this->data = tmp;
-                        memcpy(&(this->data[pos]), buff->getData(), buff->getCapacity());
-                        this->totalSize = pos + buff->getCapacity();
-                        return buff->getCapacity();
-                }
-
-                memcpy(&(this->data[pos]), buff->getData(), buff->getCapacity());
-                return buff->getCapacity();
+                return this->write(pos, buff->getData(), buff->getCapacity());
 
         }
 /***************************************************************************
@@ -463,13 +459,12 @@ extern "C"
 **************************************************************************/
         uint64_t QtFastStartSTD::ArtificialFileStream::transferTo(uint64_t pos, uint64_t count, ArtificialFileStream *target)
         {
-                byte* tmp = (byte*)malloc(count);
-                if(!tmp){
-                        throw Alloc_Fail();
+                if(pos > this->totalSize){
+                        throw Bad_Position(pos, this->totalSize);
                 }
-                uint64_t q = read(pos, tmp, count);
-                target->write(tmp, count);
-                free(tmp);
+                uint64_t q = this->totalSize - pos < count ? this->totalSize - pos : count;
+                target->write(&this->data[pos], q);
+                this->position = pos + q;
                 return q;
         }
 /***************************************************************************
@@ -485,13 +480,139 @@ extern "C"
         {
                 this->position = 0;
                 this->totalSize = afs.totalSize;
+                this->capacity = afs.totalSize;
                 this->data = (byte*)malloc(this->totalSize);
                 if(!this->data)
                         throw Alloc_Fail();
                 memcpy(this->data, afs.data, this->totalSize);
+                this->allocations = 1;
+        }
+/***************************************************************************
+* void QtFastStartSTD::ArtificialFileStream::reserve(uint64_t len)
+* Description: preallocates room for the stream to grow to the given size, so
+*               that following writes do not need to reallocate
+*
+* Parameters:
+*        len    I/P     uint64_t        total size the stream is expected to reach
+**************************************************************************/
+        void QtFastStartSTD::ArtificialFileStream::reserve(uint64_t len)
+        {
+                this->own();
+                if(len <= this->capacity)
+                        return;
+                byte* tmp = (byte*)realloc(this->data, len);
+                if(!tmp){
+                        throw Alloc_Fail();
+                }
+                this->data = tmp;
+                this->capacity = len;
+                this->allocations++;
+        }
+/***************************************************************************
+* void QtFastStartSTD::ArtificialFileStream::grow(uint64_t len)
+* Description: makes sure the stream can hold the given size. Grows the
+*               allocation geometrically so many small writes stay linear
+*
+* Parameters:
+*        len    I/P     uint64_t        size the stream needs to hold
+**************************************************************************/
+        void QtFastStartSTD::ArtificialFileStream::grow(uint64_t len)
+        {
+                if(len <= this->capacity)
+                        return;
+                uint64_t next = this->capacity + this->capacity / 2;
+                this->reserve(next > len ? next : len);
+        }
+/***************************************************************************
+* void QtFastStartSTD::ArtificialFileStream::own(void)
+* Description: replaces a referenced byte array with a private copy before the
+*               stream modifies or reallocates it. Does nothing if the stream
+*               already owns its data
+*
+* Parameters:
+**************************************************************************/
+        void QtFastStartSTD::ArtificialFileStream::own(void)
+        {
+                if(this->owned)
+                        return;
+                byte* tmp = (byte*)malloc(this->capacity);
+                if(this->capacity && !tmp){
+                        throw Alloc_Fail();
+                }
+                memcpy(tmp, this->data, this->totalSize);
+                this->data = tmp;
+                this->owned = true;
+                this->allocations++;
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::ArtificialFileStream::getCapacity(void)
+* Description: returns the number of bytes the stream has allocated, 0 while
+*               it references a byte array it does not own
+*
+* Parameters:
+*        getCapacity    O/P     uint64_t        allocated bytes
+**************************************************************************/
+        uint64_t QtFastStartSTD::ArtificialFileStream::getCapacity(void)
+        {
+                return this->owned ? this->capacity : 0;
+        }
+
+/***************************************************************************
+* uint32_t QtFastStartSTD::ArtificialFileStream::getAllocations(void)
+* Description: returns how many times the stream has allocated or reallocated
+*               its data
+*
+* Parameters:
+*        getAllocations O/P     uint32_t        number of allocations
+**************************************************************************/
+        uint32_t QtFastStartSTD::ArtificialFileStream::getAllocations(void)
+        {
+                return this->allocations;
         }
 
 
 }
 
+/***************************************************************************
+* void QtFastStartSTD::ArtificialFileStream::setChecksum(QtFastStartSTD::Checksum* sum)
+* Description: hashes the bytes written to the stream from now on, while they
+*               are copied in. The checksum has to start at the current end
+*               of the stream
+*
+* Parameters:
+*        sum    I/O     QtFastStartSTD::Checksum*       checksum to update, NULL to stop hashing
+**************************************************************************/
+        void QtFastStartSTD::ArtificialFileStream::setChecksum(QtFastStartSTD::Checksum* sum)
+        {
+                this->checksum = sum;
+        }
 
+/***************************************************************************
+* void QtFastStartSTD::ArtificialFileStream::copyIn(uint64_t pos, const byte* src, uint64_t len)
+* Description: copies bytes into the stream, which must already hold room for
+*               them. Bytes that continue the hashed part of the stream are
+*               copied in slices and each slice is hashed right after the
+*               copy, while it is still in the cache. Overwriting hashed bytes
+*               invalidates the checksum
+*
+* Parameters:
+*        pos    I/P     uint64_t        position in the stream to copy to
+*        src    I/P     const byte*     bytes to copy
+*        len    I/P     uint64_t        number of bytes
+**************************************************************************/
+        void QtFastStartSTD::ArtificialFileStream::copyIn(uint64_t pos, const byte* src, uint64_t len)
+        {
+                if(!this->checksum || pos != this->checksum->getPosition()){
+                        if(this->checksum && pos < this->checksum->getPosition() && len > 0)
+                                this->checksum->invalidate();
+                        memcpy(&this->data[pos], src, len);
+                        return;
+                }
+                for(uint64_t done = 0; done < len; ){
+                        uint64_t q = len - done < CHECKSUM_SLICE ? len - done : CHECKSUM_SLICE;
+                        memcpy(&this->data[pos + done], &src[done], q);
+                        this->checksum->update(&this->data[pos + done], q);
+                        done += q;
+                }
+        }
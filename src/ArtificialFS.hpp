@@ -21,6 +21,7 @@
 #include <string.h>
 #include <limits.h>
 #include "ByteBuffer.hpp"
+#include "Checksum.hpp"
 #include <exception>      // std::exception
 #include <sstream>
 
@@ -29,17 +30,32 @@ typedef         uint8_t         byte;
 
 extern "C" namespace QtFastStartSTD{
 
+        enum StreamData{
+        //whether a stream made from a byte array keeps its own copy of it
+                STREAM_COPY = 1,
+                STREAM_BORROW
+        };
+
         class ArtificialFileStream{
                 private:
                         uint64_t position;
                         uint64_t totalSize;
+                        uint64_t capacity;
                         byte* data = NULL;
+                        bool owned = true;
+                        uint32_t allocations = 0;
+                        Checksum* checksum = NULL;
+
+                        void grow(uint64_t len);
+                        void own(void);
+                        void copyIn(uint64_t pos, const byte* src, uint64_t len);
 
                 public:
                         static uint32_t getSize(byte* in);
                         static uint32_t getType(byte* in);
 
                         ArtificialFileStream(byte* in, uint64_t len);
+                        ArtificialFileStream(const byte* in, uint64_t len, StreamData mode);
                         ArtificialFileStream(const ArtificialFileStream& afs);
                         ArtificialFileStream(void);
                         ~ArtificialFileStream(void);
@@ -58,28 +74,34 @@ extern "C" namespace QtFastStartSTD{
                         uint64_t write(uint64_t pos, BYTEBUFFER::ByteBuffer *buff);
 
                         uint64_t transferTo(uint64_t pos, uint64_t count, ArtificialFileStream *target);
+                        void reserve(uint64_t len);
+                        uint64_t getCapacity(void);
+                        uint32_t getAllocations(void);
+                        void setChecksum(Checksum* sum);
 
 
 
 
         };
 
-        class Bad_Position : std::exception{
+        class Bad_Position : public std::exception{
                 private:
                         uint64_t position;
                         uint64_t size;
+                        std::string message;
 
                 public:
-                        Bad_Position(uint64_t pos, uint64_t siz){position = pos; size = siz;}
-                        const char* what() const noexcept {
+                        Bad_Position(uint64_t pos, uint64_t siz){
+                                position = pos; size = siz;
                                 std::stringstream ss;
                                 ss << "Position " << position << " is bigger than size "
                                 << size;
-                                return ss.str().c_str();
+                                message = ss.str();
                         }
+                        const char* what() const noexcept {return message.c_str();}
         };
 
-        class Alloc_Fail : std::exception{
+        class Alloc_Fail : public std::exception{
                 public:
                         Alloc_Fail(){}
                         const char* what() const noexcept{ return "Failed to malloc/realloc data";}
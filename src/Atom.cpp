@@ -0,0 +1,432 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Atom.cpp
+* Procedures:
+* QtFastStartSTD::Atom::Atom    -Default constructor
+* QtFastStartSTD::Atom::Atom    -Overloaded constructor, creates an empty atom of the given type
+* QtFastStartSTD::Atom::isContainer     -returns whether atoms of the given type are parsed into children
+* QtFastStartSTD::Atom::parse   -parses a complete atom and all of its children from a byte array
+* QtFastStartSTD::Atom::parseChildren   -parses the children of a container atom from a byte array
+* QtFastStartSTD::Atom::size    -returns the serialized size of the atom, including its header
+* QtFastStartSTD::Atom::serialize       -appends the serialized atom to a byte vector
+* QtFastStartSTD::Atom::write   -writes the serialized atom to an artificial file stream
+* QtFastStartSTD::Atom::find    -returns the first direct child of the given type
+* QtFastStartSTD::Atom::findPath        -follows a path of child types down the tree
+* QtFastStartSTD::Atom::findAll -returns every atom of the given type in the subtree
+* QtFastStartSTD::Atom::remove  -removes every direct child of the given type
+* uintX_t QtFastStartSTD::Atom::getUint_X       -reads a big endian integer from the payload
+* void QtFastStartSTD::Atom::setUint_X  -overwrites a big endian integer in the payload
+* void QtFastStartSTD::Atom::putUint_X  -appends a big endian integer to the payload
+* QtFastStartSTD::scanAtoms     -lists the atoms of a byte range without descending into them
+***************************************************************************/
+
+#include "Atom.hpp"
+#include "QtFastStartCPP.hpp"
+#include "Endian.hpp"
+
+
+/***************************************************************************
+* QtFastStartSTD::Atom::Atom(void)
+* Description: Default constructor
+*
+* Parameters:
+**************************************************************************/
+        QtFastStartSTD::Atom::Atom(void)
+        {
+                this->type = 0;
+                this->container = false;
+        }
+
+/***************************************************************************
+* QtFastStartSTD::Atom::Atom(uint32_t type, bool container)
+* Description: Overloaded constructor, creates an empty atom of the given type
+*
+* Parameters:
+*        type   I/P     uint32_t        type of the atom, as the *_ATOM definitions
+*        container      I/P     bool    whether the atom holds child atoms
+**************************************************************************/
+        QtFastStartSTD::Atom::Atom(uint32_t type, bool container)
+        {
+                this->type = type;
+                this->container = container;
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::Atom::isContainer(uint32_t type)
+* Description: returns whether atoms of the given type are parsed into children
+*
+* Parameters:
+*        type   I/P     uint32_t        atom type
+*        isContainer    O/P     bool    true if the atom only holds other atoms
+**************************************************************************/
+        bool QtFastStartSTD::Atom::isContainer(uint32_t type)
+        {
+                switch(type){
+                        case MOOV_ATOM:
+                        case TRAK_ATOM:
+                        case MDIA_ATOM:
+                        case MINF_ATOM:
+                        case STBL_ATOM:
+                        case EDTS_ATOM:
+                        case DINF_ATOM:
+                        case MVEX_ATOM:
+                        case MOOF_ATOM:
+                        case TRAF_ATOM:
+                        case MFRA_ATOM:
+                                return true;
+                        default:
+                                return false;
+                }
+        }
+
+/***************************************************************************
+* QtFastStartSTD::Atom QtFastStartSTD::Atom::parse(const byte* in, uint64_t len)
+* Description: parses a complete atom and all of its children from a byte array
+*
+* Parameters:
+*        in     I/P     const byte*     start of the atom header
+*        len    I/P     uint64_t        number of bytes available at in
+*        parse  O/P     QtFastStartSTD::Atom    the parsed atom
+**************************************************************************/
+        QtFastStartSTD::Atom QtFastStartSTD::Atom::parse(const byte* in, uint64_t len)
+        {
+                std::vector<AtomRange> ranges;
+                if(!scanAtoms(in, 0, len, ranges) || ranges.empty())
+                        throw Malformed_Atom("Failed to parse atom\n");
+
+                const AtomRange &r = ranges[0];
+                Atom atom(r.type, isContainer(r.type));
+                if(atom.container)
+                        atom.parseChildren(&in[r.headerSize], r.size - r.headerSize);
+                else
+                        atom.data.assign(&in[r.headerSize], &in[r.size]);
+                return atom;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Atom::parseChildren(const byte* in, uint64_t len)
+* Description: parses the children of a container atom from a byte array
+*
+* Parameters:
+*        in     I/P     const byte*     start of the payload of this atom
+*        len    I/P     uint64_t        size of the payload
+**************************************************************************/
+        void QtFastStartSTD::Atom::parseChildren(const byte* in, uint64_t len)
+        {
+                std::vector<AtomRange> ranges;
+                if(!scanAtoms(in, 0, len, ranges))
+                        throw Malformed_Atom("Malformed child atom\n");
+
+                this->children.reserve(ranges.size());
+                for(const AtomRange &r : ranges){
+                        Atom child(r.type, isContainer(r.type));
+                        if(child.container)
+                                child.parseChildren(&in[r.offset + r.headerSize], r.size - r.headerSize);
+                        else
+                                child.data.assign(&in[r.offset + r.headerSize], &in[r.offset + r.size]);
+                        this->children.push_back(std::move(child));
+                }
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::Atom::size(void) const
+* Description: returns the serialized size of the atom, including its header
+*
+* Parameters:
+*        size   O/P     uint64_t        size in bytes
+**************************************************************************/
+        uint64_t QtFastStartSTD::Atom::size(void) const
+        {
+                uint64_t s = this->data.size();
+                for(const Atom &c : this->children)
+                        s += c.size();
+                if(s + 8 > UINT32_MAX)
+                        return s + 16;
+                return s + 8;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Atom::serialize(std::vector<byte> &out) const
+* Description: appends the serialized atom to a byte vector
+*
+* Parameters:
+*        out    I/O     std::vector<byte>&      vector to append to
+**************************************************************************/
+        void QtFastStartSTD::Atom::serialize(std::vector<byte> &out) const
+        {
+                uint64_t s = this->size();
+                byte header[16];
+                uint32_t headerSize = 8;
+                uint32_t t = this->type;
+                if(s > UINT32_MAX){
+                        uint32_t one = htobe32(1);
+                        uint64_t large = htobe64(s);
+                        memcpy(&header[0], &one, 4);
+                        memcpy(&header[8], &large, 8);
+                        headerSize = 16;
+                }
+                else{
+                        uint32_t small = htobe32((uint32_t)s);
+                        memcpy(&header[0], &small, 4);
+                }
+                memcpy(&header[4], &t, 4);
+                //the type is kept in the byte order it was read in
+
+                out.insert(out.end(), header, header + headerSize);
+                out.insert(out.end(), this->data.begin(), this->data.end());
+                for(const Atom &c : this->children)
+                        c.serialize(out);
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Atom::write(QtFastStartSTD::ArtificialFileStream *out) const
+* Description: writes the serialized atom to an artificial file stream
+*
+* Parameters:
+*        out    I/O     QtFastStartSTD::ArtificialFileStream*   stream to append to
+**************************************************************************/
+        void QtFastStartSTD::Atom::write(QtFastStartSTD::ArtificialFileStream *out) const
+        {
+                std::vector<byte> tmp;
+                tmp.reserve(this->size());
+                this->serialize(tmp);
+                out->write(tmp.data(), tmp.size());
+        }
+
+/***************************************************************************
+* QtFastStartSTD::Atom* QtFastStartSTD::Atom::find(uint32_t type)
+* Description: returns the first direct child of the given type
+*
+* Parameters:
+*        type   I/P     uint32_t        type to look for
+*        find   O/P     QtFastStartSTD::Atom*   the child, or nullptr if none exists
+**************************************************************************/
+        QtFastStartSTD::Atom* QtFastStartSTD::Atom::find(uint32_t type)
+        {
+                for(Atom &c : this->children){
+                        if(c.type == type)
+                                return &c;
+                }
+                return nullptr;
+        }
+
+/***************************************************************************
+* QtFastStartSTD::Atom* QtFastStartSTD::Atom::findPath(const uint32_t* path, uint32_t depth)
+* Description: follows a path of child types down the tree
+*
+* Parameters:
+*        path   I/P     const uint32_t* array of types, starting with a child of this atom
+*        depth  I/P     uint32_t        number of elements in path
+*        findPath       O/P     QtFastStartSTD::Atom*   the atom at the end of the path, or nullptr
+**************************************************************************/
+        QtFastStartSTD::Atom* QtFastStartSTD::Atom::findPath(const uint32_t* path, uint32_t depth)
+        {
+                Atom* cur = this;
+                for(uint32_t i = 0; i < depth && cur; i++)
+                        cur = cur->find(path[i]);
+                return cur;
+        }
+
+/***************************************************************************
+* std::vector<QtFastStartSTD::Atom*> QtFastStartSTD::Atom::findAll(uint32_t type)
+* Description: returns every atom of the given type in the subtree, in file order
+*
+* Parameters:
+*        type   I/P     uint32_t        type to look for
+*        findAll        O/P     std::vector<QtFastStartSTD::Atom*>      matching atoms
+**************************************************************************/
+        std::vector<QtFastStartSTD::Atom*> QtFastStartSTD::Atom::findAll(uint32_t type)
+        {
+                std::vector<Atom*> ret;
+                for(Atom &c : this->children){
+                        if(c.type == type)
+                                ret.push_back(&c);
+                        if(c.container){
+                                std::vector<Atom*> sub = c.findAll(type);
+                                ret.insert(ret.end(), sub.begin(), sub.end());
+                        }
+                }
+                return ret;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Atom::remove(uint32_t type)
+* Description: removes every direct child of the given type
+*
+* Parameters:
+*        type   I/P     uint32_t        type to remove
+**************************************************************************/
+        void QtFastStartSTD::Atom::remove(uint32_t type)
+        {
+                std::vector<Atom> kept;
+                kept.reserve(this->children.size());
+                for(Atom &c : this->children){
+                        if(c.type != type)
+                                kept.push_back(std::move(c));
+                }
+                this->children.swap(kept);
+        }
+
+/***************************************************************************
+* uintX_t QtFastStartSTD::Atom::getUint_X(uint64_t pos) const
+* Description: reads a big endian integer from the payload
+*
+* Parameters:
+*        pos    I/P     uint64_t        offset into the payload
+*        getUint_X      O/P     uintX_t the value read
+**************************************************************************/
+        uint8_t QtFastStartSTD::Atom::getUint_8(uint64_t pos) const
+        {
+                if(pos + sizeof(uint8_t) > this->data.size())
+                        throw Malformed_Atom("Atom payload too short\n");
+                return this->data[pos];
+        }
+
+        uint16_t QtFastStartSTD::Atom::getUint_16(uint64_t pos) const
+        {
+                if(pos + sizeof(uint16_t) > this->data.size())
+                        throw Malformed_Atom("Atom payload too short\n");
+                uint16_t ret;
+                memcpy(&ret, &this->data[pos], sizeof(uint16_t));
+                return be16toh(ret);
+        }
+
+        uint32_t QtFastStartSTD::Atom::getUint_32(uint64_t pos) const
+        {
+                if(pos + sizeof(uint32_t) > this->data.size())
+                        throw Malformed_Atom("Atom payload too short\n");
+                uint32_t ret;
+                memcpy(&ret, &this->data[pos], sizeof(uint32_t));
+                return be32toh(ret);
+        }
+
+        uint64_t QtFastStartSTD::Atom::getUint_64(uint64_t pos) const
+        {
+                if(pos + sizeof(uint64_t) > this->data.size())
+                        throw Malformed_Atom("Atom payload too short\n");
+                uint64_t ret;
+                memcpy(&ret, &this->data[pos], sizeof(uint64_t));
+                return be64toh(ret);
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Atom::setUint_X(uint64_t pos, uintX_t value)
+* Description: overwrites a big endian integer in the payload
+*
+* Parameters:
+*        pos    I/P     uint64_t        offset into the payload
+*        value  I/P     uintX_t the value to write
+**************************************************************************/
+        void QtFastStartSTD::Atom::setUint_32(uint64_t pos, uint32_t value)
+        {
+                if(pos + sizeof(uint32_t) > this->data.size())
+                        throw Malformed_Atom("Atom payload too short\n");
+                uint32_t out = htobe32(value);
+                memcpy(&this->data[pos], &out, sizeof(uint32_t));
+        }
+
+        void QtFastStartSTD::Atom::setUint_64(uint64_t pos, uint64_t value)
+        {
+                if(pos + sizeof(uint64_t) > this->data.size())
+                        throw Malformed_Atom("Atom payload too short\n");
+                uint64_t out = htobe64(value);
+                memcpy(&this->data[pos], &out, sizeof(uint64_t));
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Atom::putUint_X(uintX_t value)
+* Description: appends a big endian integer to the payload
+*
+* Parameters:
+*        value  I/P     uintX_t the value to append
+**************************************************************************/
+        void QtFastStartSTD::Atom::putUint_8(uint8_t value)
+        {
+                this->data.push_back(value);
+        }
+
+        void QtFastStartSTD::Atom::putUint_16(uint16_t value)
+        {
+                uint16_t out = htobe16(value);
+                const byte* p = (const byte*)&out;
+                this->data.insert(this->data.end(), p, p + sizeof(uint16_t));
+        }
+
+        void QtFastStartSTD::Atom::putUint_32(uint32_t value)
+        {
+                uint32_t out = htobe32(value);
+                const byte* p = (const byte*)&out;
+                this->data.insert(this->data.end(), p, p + sizeof(uint32_t));
+        }
+
+        void QtFastStartSTD::Atom::putUint_64(uint64_t value)
+        {
+                uint64_t out = htobe64(value);
+                const byte* p = (const byte*)&out;
+                this->data.insert(this->data.end(), p, p + sizeof(uint64_t));
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::scanAtoms(const byte* in, uint64_t begin, uint64_t end, std::vector<QtFastStartSTD::AtomRange> &out, uint64_t maxAtoms)
+* Description: lists the atoms of a byte range without descending into them.
+*               An atom size of 0 extends the atom to the end of the range.
+*               The scan stops once maxAtoms atoms were listed, so a range of
+*               tiny atoms can not grow the list without bound
+*
+* Parameters:
+*        in     I/P     const byte*     byte array to scan
+*        begin  I/P     uint64_t        offset of the first atom
+*        end    I/P     uint64_t        offset one past the last byte of the range
+*        out    I/O     std::vector<QtFastStartSTD::AtomRange>& atoms found, with absolute offsets
+*        maxAtoms       I/P     uint64_t        most atoms to list
+*        scanAtoms      O/P     bool    false if an atom header or size does not fit the range,
+*                                       or the range holds more than maxAtoms atoms
+**************************************************************************/
+        bool QtFastStartSTD::scanAtoms(const byte* in, uint64_t begin, uint64_t end, std::vector<QtFastStartSTD::AtomRange> &out, uint64_t maxAtoms)
+        {
+                uint64_t pos = begin;
+                uint64_t first = out.size();
+                while(pos < end){
+                        if(out.size() - first == maxAtoms)
+                                return false;
+                        if(end - pos < 8)
+                                return false;
+                        AtomRange r;
+                        uint32_t size32;
+                        memcpy(&size32, &in[pos], 4);
+                        memcpy(&r.type, &in[pos + 4], 4);
+                        r.offset = pos;
+                        r.headerSize = 8;
+                        r.size = be32toh(size32);
+                        if(r.size == 1){
+                                if(end - pos < 16)
+                                        return false;
+                                uint64_t size64;
+                                memcpy(&size64, &in[pos + 8], 8);
+                                r.size = be64toh(size64);
+                                r.headerSize = 16;
+                        }
+                        else if(r.size == 0){
+                                r.size = end - pos;
+                        }
+                        if(r.size < r.headerSize || r.size > end - pos)
+                                return false;
+                        out.push_back(r);
+                        pos += r.size;
+                }
+                return true;
+        }
@@ -0,0 +1,80 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef ATOM_H
+#define ATOM_H
+
+#include <stdint.h>
+#include <vector>
+#include "ArtificialFS.hpp"
+
+
+namespace QtFastStartSTD{
+
+/*Location of an atom inside of a byte array, as found by scanAtoms()*/
+        struct AtomRange{
+                uint32_t type;
+                uint64_t offset;
+                uint64_t size;
+                uint32_t headerSize;
+        };
+
+/*In-memory tree of an atom and its children. Leaf atoms keep their whole
+payload in data, container atoms keep only the bytes that precede their
+children (the version and flags of a full box, otherwise nothing)
+*/
+        class Atom{
+                public:
+                        uint32_t type;
+                        bool container;
+                        std::vector<byte> data;
+                        std::vector<Atom> children;
+
+                        Atom(void);
+                        explicit Atom(uint32_t type, bool container = false);
+
+                        static bool isContainer(uint32_t type);
+                        static Atom parse(const byte* in, uint64_t len);
+
+                        uint64_t size(void) const;
+                        void serialize(std::vector<byte> &out) const;
+                        void write(ArtificialFileStream *out) const;
+
+                        Atom* find(uint32_t type);
+                        Atom* findPath(const uint32_t* path, uint32_t depth);
+                        std::vector<Atom*> findAll(uint32_t type);
+                        void remove(uint32_t type);
+
+                        uint8_t getUint_8(uint64_t pos) const;
+                        uint16_t getUint_16(uint64_t pos) const;
+                        uint32_t getUint_32(uint64_t pos) const;
+                        uint64_t getUint_64(uint64_t pos) const;
+                        void setUint_32(uint64_t pos, uint32_t value);
+                        void setUint_64(uint64_t pos, uint64_t value);
+                        void putUint_8(uint8_t value);
+                        void putUint_16(uint16_t value);
+                        void putUint_32(uint32_t value);
+                        void putUint_64(uint64_t value);
+
+                private:
+                        void parseChildren(const byte* in, uint64_t len);
+        };
+
+        bool scanAtoms(const byte* in, uint64_t begin, uint64_t end, std::vector<AtomRange> &out, uint64_t maxAtoms = UINT64_MAX);
+
+}
+
+
+#endif // ATOM_H
@@ -33,6 +33,7 @@
 * void BYTEBUFFER::ByteBuffer::putUint_X(uintX_t value) -put an unsigned integer-type into the bytebuffer at the specified position
 * BYTEBUFFER::ByteBuffer::clear -sets the position of the bytebuffer to 0, sets the limit to the capacity of the bytebuffer
 * BYTEBUFFER::ByteBuffer::getData       -returns the byte array retained in the buffer
+* BYTEBUFFER::ByteBuffer::getWritableData       -returns the byte array retained in the buffer, for cursors writing into it
 * BYTEBUFFER::ByteBuffer::getCapacity   -returns the capacity of the bytebuffer
 ***************************************************************************/
 
@@ -40,47 +41,7 @@
 #include "ByteBuffer.hpp"
 #include <string.h>
 
-#ifdef __unix__
-#include <endian.h>
-#elif defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
-/*Definitions of endian byte swapping for windows*/
-const int16_t __num = 1;
-const bool __littleEndian = (*(int8_t *)&__num == 1 ? true : false);
-
-
-    #if defined(__GNUC__ )
-    /*For GCC*/
-    #define be16toh(X) (__littleEndian ? ((X & 0xff00) >> 8) + ((X & 0x00ff) << 8) : X)
-    #define le16toh(X) (__littleEndian ? X : ((X & 0xff00) >> 8) + ((X & 0x00ff) << 8))
-    #define be32toh(X) (__littleEndian ? __builtin_bswap32(X) : X)
-    #define le32toh(X) (__littleEndian ? X : __builtin_bswap32(X))
-    #define be64toh(X) (__littleEndian ? __builtin_bswap64(X) : X)
-    #define le64toh(X) (__littleEndian ? X : __builtin_bswap64(X))
-
-
-    #elif defined(_MSC_VER)
-    /*For MSVC*/
-    #define be16toh(X) (__littleEndian ? _byteswap_ushort(X) : X)
-    #define le16toh(X) (__littleEndian ? X : _byteswap_ushort(X))
-    #define be32toh(X) (__littleEndian ? _byteswap_ulong(X) : X)
-    #define le32toh(X) (__littleEndian ? X : _byteswap_ulong(X))
-    #define be64toh(X) (__littleEndian ? _byteswap_uint64(X) : X)
-    #define le64toh(X) (__littleEndian ? X : _byteswap_uint64(X))
-
-    #endif // defined
-
-    #define htobe16(X) be16toh(X)
-    #define htole16(X) le16toh(X)
-    #define htobe32(X) be32toh(X)
-    #define htole32(X) le32toh(X)
-    #define htobe64(X) be64toh(X)
-    #define htole64(X) le64toh(X)
-
-
-
-#else
-        #error Operating system not supported
-#endif // linux
+#include "Cursor.hpp"
 #include <stdio.h>
 
 //#define DEBUG
@@ -323,74 +284,57 @@ uint16_t BYTEBUFFER::ByteBuffer::getUint_16(void)
 {
         if(sizeof(uint16_t) > this->limit - this->position)
                 throw BYTEBUFFER::Buffer_Underflow(sizeof(uint16_t), limit - position);;
-        uint16_t ret;
-        memcpy(&ret, &data[this->position], sizeof(uint16_t));
+        uint16_t ret = this->order == BYTEBUFFER::B_ENDIAN ? BigEndian::load16(&data[this->position])
+                                : LittleEndian::load16(&data[this->position]);
         this->position+=sizeof(uint16_t);
-
-        if(this->order == BYTEBUFFER::B_ENDIAN)
-                return be16toh(ret);
-        return le16toh(ret);
+        return ret;
 }
 
 uint16_t BYTEBUFFER::ByteBuffer::getUint_16(uint64_t pos)
 {
         if(sizeof(uint16_t) > this->limit - pos)
                 throw BYTEBUFFER::Buffer_Underflow(sizeof(uint16_t), limit - position);;
-        uint16_t ret;
-        memcpy(&ret, &data[pos], sizeof(uint16_t));
-
         if(this->order == BYTEBUFFER::B_ENDIAN)
-                return be16toh(ret);
-        return le16toh(ret);
+                return BigEndian::load16(&data[pos]);
+        return LittleEndian::load16(&data[pos]);
 }
 
 uint32_t BYTEBUFFER::ByteBuffer::getUint_32(void)
 {
         if(sizeof(uint32_t) > this->limit - this->position)
                 throw BYTEBUFFER::Buffer_Underflow(sizeof(uint32_t), limit - position);;
-        uint32_t ret;
-        memcpy(&ret, &data[this->position], sizeof(uint32_t));
+        uint32_t ret = this->order == BYTEBUFFER::B_ENDIAN ? BigEndian::load32(&data[this->position])
+                                : LittleEndian::load32(&data[this->position]);
         this->position+=sizeof(uint32_t);
-
-        if(this->order == BYTEBUFFER::B_ENDIAN)
-                return be32toh(ret);
-        return le32toh(ret);
+        return ret;
 }
 
 uint32_t BYTEBUFFER::ByteBuffer::getUint_32(uint64_t pos)
 {
         if(sizeof(uint32_t) > this->limit - pos)
                 throw BYTEBUFFER::Buffer_Underflow(sizeof(uint32_t), limit - position);
-        uint32_t ret;
-        memcpy(&ret,  &data[pos], sizeof(uint32_t));
-
         if(this->order == BYTEBUFFER::B_ENDIAN)
-                return be32toh(ret);
-        return le32toh(ret);
+                return BigEndian::load32(&data[pos]);
+        return LittleEndian::load32(&data[pos]);
 }
 
 uint64_t BYTEBUFFER::ByteBuffer::getUint_64(void)
 {
         if(sizeof(uint64_t) > this->limit - this->position)
                 throw BYTEBUFFER::Buffer_Underflow(sizeof(uint64_t), limit - position);
-        uint64_t ret;
-        memcpy(&ret, &data[this->position], sizeof(uint64_t));
+        uint64_t ret = this->order == BYTEBUFFER::B_ENDIAN ? BigEndian::load64(&data[this->position])
+                                : LittleEndian::load64(&data[this->position]);
         this->position+=sizeof(uint64_t);
-
-        if(this->order == BYTEBUFFER::B_ENDIAN)
-                return be64toh(ret);
-        return le64toh(ret);
+        return ret;
 }
 
 uint64_t BYTEBUFFER::ByteBuffer::getUint_64(uint64_t pos)
 {
         if(sizeof(uint64_t) > this->limit - pos)
                 throw BYTEBUFFER::Buffer_Underflow(sizeof(uint64_t), limit - position);
-        uint64_t ret;
-        memcpy(&ret,  &data[pos], sizeof(uint64_t));
         if(this->order == BYTEBUFFER::B_ENDIAN)
-                return be64toh(ret);
-        return le64toh(ret);
+                return BigEndian::load64(&data[pos]);
+        return LittleEndian::load64(&data[pos]);
 }
 /******************************************************************************
         End of get functions
@@ -419,12 +363,10 @@ void BYTEBUFFER::ByteBuffer::putUint_16(uint16_t value)
         if(sizeof(uint16_t) > this->limit - this->position)
                 throw BYTEBUFFER::Buffer_Overflow(sizeof(uint16_t), limit - position);
 
-        uint16_t out;
         if(this->order == BYTEBUFFER::B_ENDIAN)
-                out = htobe16(value);
+                BigEndian::store16(&data[this->position], value);
         else
-                out = htole16(value);
-        memcpy(&data[this->position], &out, sizeof(uint16_t));
+                LittleEndian::store16(&data[this->position], value);
         this->position += sizeof(uint16_t);
 }
 
@@ -433,12 +375,10 @@ void BYTEBUFFER::ByteBuffer::putUint_32(uint32_t value)
         if(sizeof(uint32_t) > this->limit - this->position)
                 throw BYTEBUFFER::Buffer_Overflow(sizeof(uint32_t), limit - position);
 
-        uint32_t out;
         if(this->order == BYTEBUFFER::B_ENDIAN)
-                out = htobe32(value);
+                BigEndian::store32(&data[this->position], value);
         else
-                out = htole32(value);
-        memcpy(&data[this->position], &out, sizeof(uint32_t));
+                LittleEndian::store32(&data[this->position], value);
         this->position += sizeof(uint32_t);
 }
 
@@ -447,12 +387,10 @@ void BYTEBUFFER::ByteBuffer::putUint_64(uint64_t value)
         if(sizeof(uint64_t) > this->limit - this->position)
                 throw BYTEBUFFER::Buffer_Overflow(sizeof(uint64_t), limit - position);
 
-        uint64_t out;
         if(this->order == BYTEBUFFER::B_ENDIAN)
-                out = htobe64(value);
+                BigEndian::store64(&data[this->position], value);
         else
-                out = htole64(value);
-        memcpy(&data[this->position], &out, sizeof(uint64_t));
+                LittleEndian::store64(&data[this->position], value);
         this->position += sizeof(uint64_t);
 }
 /******************************************************************************
@@ -488,6 +426,19 @@ const uint8_t* BYTEBUFFER::ByteBuffer::getData(void)
         return this->data;
 }
 
+/***************************************************************************
+* uint8_t* BYTEBUFFER::ByteBuffer::getWritableData(void)
+* Description: returns the byte array retained in the buffer, for cursors
+*               writing into it
+*
+* Parameters:
+*        getWritableData        O/P     uint8_t*        pointer to the returned data
+**************************************************************************/
+uint8_t* BYTEBUFFER::ByteBuffer::getWritableData(void)
+{
+        return this->data;
+}
+
 /***************************************************************************
 * uint64_t BYTEBUFFER::ByteBuffer::getCapacity(void)
 * Author: SkibbleBip
@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <exception>
 #include <sstream>
+#include <string>
 
 
 
@@ -70,6 +71,7 @@ unsigned integer types and maintain internal positioning
                         void put(BYTEBUFFER::ByteBuffer *src);
 
                         const uint8_t* getData(void);
+                        uint8_t* getWritableData(void);
                 private:
                         uint64_t position;
                         uint64_t limit;
@@ -84,83 +86,93 @@ unsigned integer types and maintain internal positioning
         };
 
 /*Exceptions*/
-        class Bad_Position : std::exception{
+        class Bad_Position : public std::exception{
                 private:
                         uint64_t position;
                         uint64_t size;
+                        std::string message;
 
                 public:
-                        Bad_Position(uint64_t pos, uint64_t siz){position = pos; size = siz;}
-                        const char* what() const noexcept {
+                        Bad_Position(uint64_t pos, uint64_t siz){
+                                position = pos; size = siz;
                                 std::stringstream ss;
                                 ss << "Position " << position << " is bigger than size "
                                 << size;
-                                return ss.str().c_str();
+                                message = ss.str();
                         }
+                        const char* what() const noexcept {return message.c_str();}
         };
 
 
-        class Bad_Limit : std::exception{
+        class Bad_Limit : public std::exception{
                 private:
                         uint64_t limit;
                         uint64_t capacity;
+                        std::string message;
 
                 public:
-                        Bad_Limit(uint64_t lim, uint64_t cap){limit = lim; capacity = cap;}
-                        const char* what() const noexcept {
+                        Bad_Limit(uint64_t lim, uint64_t cap){
+                                limit = lim; capacity = cap;
                                 std::stringstream ss;
                                 ss << "New limit " << limit << " is bigger than capacity "
                                 << capacity;
-                                return ss.str().c_str();
+                                message = ss.str();
                         }
+                        const char* what() const noexcept {return message.c_str();}
         };
 
 
-        class Buffer_Underflow : std::exception{
+        class Buffer_Underflow : public std::exception{
                 private:
                         uint64_t length;
                         uint64_t remaining;
+                        std::string message;
 
                 public:
-                        Buffer_Underflow(uint64_t len, uint64_t rem){length = len; remaining = rem;}
-                        const char* what() const noexcept {
+                        Buffer_Underflow(uint64_t len, uint64_t rem){
+                                length = len; remaining = rem;
                                 std::stringstream ss;
                                 ss << "Length " << length << " is bigger than remaining "
                                 << remaining;
-                                return ss.str().c_str();
+                                message = ss.str();
                         }
+                        const char* what() const noexcept {return message.c_str();}
         };
 
 
 
-        class Buffer_Overflow : std::exception{
+        class Buffer_Overflow : public std::exception{
                 private:
                         uint64_t length;
                         uint64_t remaining;
+                        std::string message;
 
                 public:
-                        Buffer_Overflow(uint64_t srcRem, uint64_t destRem){length = srcRem; remaining = destRem;}
-                        const char* what() const noexcept {
+                        Buffer_Overflow(uint64_t srcRem, uint64_t destRem){
+                                length = srcRem; remaining = destRem;
                                 std::stringstream ss;
                                 ss << "Source length " << length << " is bigger than destination remaining "
                                 << remaining;
-                                return ss.str().c_str();
+                                message = ss.str();
                         }
+                        const char* what() const noexcept {return message.c_str();}
         };
 
-        class IndexOutOfBounds : std::exception{
+        class IndexOutOfBounds : public std::exception{
                 private:
                         uint64_t index;
                         uint64_t length;
+                        std::string message;
 
                 public:
-                        IndexOutOfBounds(uint64_t idx, uint64_t len){index = idx; length = len;}
-                        const char* what() const noexcept {
+                        IndexOutOfBounds(uint64_t idx, uint64_t len){
+                                index = idx; length = len;
                                 std::stringstream ss;
                                 ss << "Index " << index << " out of bounds in length "
                                 << length;
-                                return ss.str().c_str();
+                                message = ss.str();
                         }
+                        const char* what() const noexcept {return message.c_str();}
         };
 
 }
@@ -0,0 +1,915 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Checksum.cpp
+* Procedures:
+* QtFastStartSTD::Xxh3::Xxh3    -starts an XXH3 hash
+* QtFastStartSTD::Xxh3::update  -adds bytes to an XXH3 hash
+* QtFastStartSTD::Xxh3::digest  -returns the XXH3 hash of the bytes added so far
+* QtFastStartSTD::Sha256::Sha256        -starts a SHA-256 hash
+* QtFastStartSTD::Sha256::update        -adds bytes to a SHA-256 hash
+* QtFastStartSTD::Sha256::digest        -returns the SHA-256 hash of the bytes added so far
+* QtFastStartSTD::crc32c        -continues a CRC-32C over more bytes
+* QtFastStartSTD::Checksum::Checksum    -creates an empty checksum of the selected hashes
+* QtFastStartSTD::Checksum::reset       -forgets every hashed byte, for the next conversion
+* QtFastStartSTD::Checksum::getPosition -returns the output offset the next hashed byte has to come from
+* QtFastStartSTD::Checksum::update      -hashes bytes that were just written at the current position
+* QtFastStartSTD::Checksum::invalidate  -notes that bytes which were already hashed got overwritten
+* QtFastStartSTD::Checksum::finish      -hashes what the writes did not cover and fills in the results
+* QtFastStartSTD::Checksum::hash        -adds bytes to the whole output and the current part
+* QtFastStartSTD::Checksum::feed        -adds bytes to the selected hashes of one range
+* QtFastStartSTD::Checksum::close       -writes the results of one range
+* load64        -reads a little endian 64 bit word
+* load32        -reads a little endian 32 bit word
+* fold64        -multiplies two 64 bit words and folds the 128 bit product
+* avalanche     -XXH3 final mix
+* avalanche64   -XXH64 final mix, used by XXH3 for the shortest inputs
+* rrmxmx        -XXH3 final mix for inputs of 4 to 8 bytes
+* mix16         -mixes 16 input bytes with 16 secret bytes
+* xxh3Short     -XXH3 of up to 240 bytes
+* accumulate    -mixes one 64 byte stripe into the accumulators
+* scramble      -scrambles the accumulators after every block
+* consumeStripes        -accumulates stripes, scrambling at the end of every block
+* ror   -rotates a 32 bit word right
+* sha256Blocks  -portable SHA-256 compression of whole blocks
+* sha256BlocksNi        -SHA-256 compression of whole blocks with the SHA extensions
+* crc32cTable   -bytewise CRC-32C
+* crc32cHardware        -CRC-32C with the SSE4.2 crc32 instruction
+* cpuHas        -returns which accelerated hashes the CPU supports
+* compress      -SHA-256 compression of whole blocks, accelerated if the CPU supports it
+***************************************************************************/
+
+#include <string.h>
+#include "Checksum.hpp"
+#include "Endian.hpp"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CHECKSUM_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif // defined
+
+
+namespace{
+
+        const uint64_t PRIME32_1 = 0x9E3779B1U;
+        const uint64_t PRIME32_2 = 0x85EBCA77U;
+        const uint64_t PRIME32_3 = 0xC2B2AE3DU;
+        const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+        const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+        const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+        const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+        const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+        const uint32_t STRIPE = 64;
+        const uint32_t STRIPES_PER_BLOCK = 16;  //(secret size - stripe) / 8
+
+        //the default XXH3 secret
+        const byte SECRET[192] = {
+                0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+                0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+                0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+                0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+                0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+                0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+                0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+                0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+                0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+                0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+                0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+                0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+        };
+
+        const uint32_t SHA256_K[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+        };
+
+/***************************************************************************
+* uint64_t load64(const byte* in)
+* Description: reads a little endian 64 bit word
+*
+* Parameters:
+*        in     I/P     const byte*     first byte of the word
+*        load64 O/P     uint64_t        the word
+**************************************************************************/
+        inline uint64_t load64(const byte* in)
+        {
+                uint64_t v;
+                memcpy(&v, in, sizeof(v));
+                return le64toh(v);
+        }
+
+/***************************************************************************
+* uint32_t load32(const byte* in)
+* Description: reads a little endian 32 bit word
+*
+* Parameters:
+*        in     I/P     const byte*     first byte of the word
+*        load32 O/P     uint32_t        the word
+**************************************************************************/
+        inline uint32_t load32(const byte* in)
+        {
+                uint32_t v;
+                memcpy(&v, in, sizeof(v));
+                return le32toh(v);
+        }
+
+/***************************************************************************
+* uint64_t fold64(uint64_t a, uint64_t b)
+* Description: multiplies two 64 bit words and xors the halves of the 128 bit
+*               product
+*
+* Parameters:
+*        a      I/P     uint64_t        first factor
+*        b      I/P     uint64_t        second factor
+*        fold64 O/P     uint64_t        low ^ high half of the product
+**************************************************************************/
+        inline uint64_t fold64(uint64_t a, uint64_t b)
+        {
+#ifdef __SIZEOF_INT128__
+                unsigned __int128 p = (unsigned __int128)a * b;
+                return (uint64_t)p ^ (uint64_t)(p >> 64);
+#else
+                uint64_t loLo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+                uint64_t hiLo = (a >> 32) * (b & 0xFFFFFFFF);
+                uint64_t loHi = (a & 0xFFFFFFFF) * (b >> 32);
+                uint64_t hiHi = (a >> 32) * (b >> 32);
+                uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFF) + loHi;
+                uint64_t high = (hiLo >> 32) + (cross >> 32) + hiHi;
+                uint64_t low = (cross << 32) | (loLo & 0xFFFFFFFF);
+                return low ^ high;
+#endif // __SIZEOF_INT128__
+        }
+
+/***************************************************************************
+* uint64_t avalanche(uint64_t h)
+* Description: XXH3 final mix
+*
+* Parameters:
+*        h      I/P     uint64_t        hash to mix
+*        avalanche      O/P     uint64_t        mixed hash
+**************************************************************************/
+        inline uint64_t avalanche(uint64_t h)
+        {
+                h ^= h >> 37;
+                h *= 0x165667919E3779F9ULL;
+                return h ^ (h >> 32);
+        }
+
+/***************************************************************************
+* uint64_t avalanche64(uint64_t h)
+* Description: XXH64 final mix, used by XXH3 for the shortest inputs
+*
+* Parameters:
+*        h      I/P     uint64_t        hash to mix
+*        avalanche64    O/P     uint64_t        mixed hash
+**************************************************************************/
+        inline uint64_t avalanche64(uint64_t h)
+        {
+                h ^= h >> 33;
+                h *= PRIME64_2;
+                h ^= h >> 29;
+                h *= PRIME64_3;
+                return h ^ (h >> 32);
+        }
+
+/***************************************************************************
+* uint64_t rrmxmx(uint64_t h, uint64_t len)
+* Description: XXH3 final mix for inputs of 4 to 8 bytes
+*
+* Parameters:
+*        h      I/P     uint64_t        hash to mix
+*        len    I/P     uint64_t        input length
+*        rrmxmx O/P     uint64_t        mixed hash
+**************************************************************************/
+        inline uint64_t rrmxmx(uint64_t h, uint64_t len)
+        {
+                h ^= ((h << 49) | (h >> 15)) ^ ((h << 24) | (h >> 40));
+                h *= 0x9FB21C651E98DF25ULL;
+                h ^= (h >> 35) + len;
+                h *= 0x9FB21C651E98DF25ULL;
+                return h ^ (h >> 28);
+        }
+
+/***************************************************************************
+* uint64_t mix16(const byte* in, const byte* secret)
+* Description: mixes 16 input bytes with 16 secret bytes
+*
+* Parameters:
+*        in     I/P     const byte*     input bytes
+*        secret I/P     const byte*     secret bytes
+*        mix16  O/P     uint64_t        mixed word
+**************************************************************************/
+        inline uint64_t mix16(const byte* in, const byte* secret)
+        {
+                return fold64(load64(in) ^ load64(secret), load64(in + 8) ^ load64(secret + 8));
+        }
+
+/***************************************************************************
+* uint64_t xxh3Short(const byte* in, uint64_t len)
+* Description: XXH3 of up to 240 bytes, which does not use the accumulators
+*
+* Parameters:
+*        in     I/P     const byte*     input bytes
+*        len    I/P     uint64_t        input length, at most 240
+*        xxh3Short      O/P     uint64_t        hash
+**************************************************************************/
+        uint64_t xxh3Short(const byte* in, uint64_t len)
+        {
+                if(len == 0)
+                        return avalanche64(load64(SECRET + 56) ^ load64(SECRET + 64));
+                if(len <= 3){
+                        uint32_t combined = ((uint32_t)in[0] << 16) | ((uint32_t)in[len >> 1] << 24)
+                                        | (uint32_t)in[len - 1] | ((uint32_t)len << 8);
+                        return avalanche64(combined ^ (uint64_t)(load32(SECRET) ^ load32(SECRET + 4)));
+                }
+                if(len <= 8){
+                        uint64_t input = load32(in + len - 4) + ((uint64_t)load32(in) << 32);
+                        return rrmxmx(input ^ (load64(SECRET + 8) ^ load64(SECRET + 16)), len);
+                }
+                if(len <= 16){
+                        uint64_t lo = load64(in) ^ load64(SECRET + 24) ^ load64(SECRET + 32);
+                        uint64_t hi = load64(in + len - 8) ^ load64(SECRET + 40) ^ load64(SECRET + 48);
+                        return avalanche(len + __builtin_bswap64(lo) + hi + fold64(lo, hi));
+                }
+
+                uint64_t acc = len * PRIME64_1;
+                if(len <= 128){
+                        if(len > 96){
+                                acc += mix16(in + 48, SECRET + 96);
+                                acc += mix16(in + len - 64, SECRET + 112);
+                        }
+                        if(len > 64){
+                                acc += mix16(in + 32, SECRET + 64);
+                                acc += mix16(in + len - 48, SECRET + 80);
+                        }
+                        if(len > 32){
+                                acc += mix16(in + 16, SECRET + 32);
+                                acc += mix16(in + len - 32, SECRET + 48);
+                        }
+                        acc += mix16(in, SECRET);
+                        acc += mix16(in + len - 16, SECRET + 16);
+                        return avalanche(acc);
+                }
+
+                for(uint32_t i = 0; i < 8; i++)
+                        acc += mix16(in + 16 * i, SECRET + 16 * i);
+                acc = avalanche(acc);
+                for(uint32_t i = 8; i < len / 16; i++)
+                        acc += mix16(in + 16 * i, SECRET + 16 * (i - 8) + 3);
+                acc += mix16(in + len - 16, SECRET + 136 - 17);
+                return avalanche(acc);
+        }
+
+/***************************************************************************
+* void accumulate(uint64_t acc[8], const byte* in, const byte* secret)
+* Description: mixes one 64 byte stripe into the accumulators. Written as
+*               plain lane arithmetic, which the compiler vectorizes
+*
+* Parameters:
+*        acc    I/O     uint64_t[8]     accumulators
+*        in     I/P     const byte*     stripe
+*        secret I/P     const byte*     secret bytes for the stripe
+**************************************************************************/
+        inline void accumulate(uint64_t acc[8], const byte* in, const byte* secret)
+        {
+                for(uint32_t i = 0; i < 8; i++){
+                        uint64_t v = load64(in + 8 * i);
+                        uint64_t k = v ^ load64(secret + 8 * i);
+                        acc[i ^ 1] += v;
+                        acc[i] += (k & 0xFFFFFFFF) * (k >> 32);
+                }
+        }
+
+/***************************************************************************
+* void scramble(uint64_t acc[8])
+* Description: scrambles the accumulators after every block
+*
+* Parameters:
+*        acc    I/O     uint64_t[8]     accumulators
+**************************************************************************/
+        inline void scramble(uint64_t acc[8])
+        {
+                const byte* secret = SECRET + sizeof(SECRET) - STRIPE;
+                for(uint32_t i = 0; i < 8; i++){
+                        uint64_t a = acc[i] ^ (acc[i] >> 47);
+                        acc[i] = (a ^ load64(secret + 8 * i)) * PRIME32_1;
+                }
+        }
+
+/***************************************************************************
+* uint32_t consumeStripes(uint64_t acc[8], const byte* in, uint32_t count, uint32_t stripes)
+* Description: accumulates stripes, scrambling at the end of every block
+*
+* Parameters:
+*        acc    I/O     uint64_t[8]     accumulators
+*        in     I/P     const byte*     first stripe
+*        count  I/P     uint32_t        number of stripes, at most one block
+*        stripes        I/P     uint32_t        stripes of the current block already accumulated
+*        consumeStripes O/P     uint32_t        stripes of the current block accumulated afterwards
+**************************************************************************/
+        uint32_t consumeStripes(uint64_t acc[8], const byte* in, uint32_t count, uint32_t stripes)
+        {
+                if(STRIPES_PER_BLOCK - stripes <= count){
+                        uint32_t toEnd = STRIPES_PER_BLOCK - stripes;
+                        for(uint32_t i = 0; i < toEnd; i++)
+                                accumulate(acc, in + i * STRIPE, SECRET + (stripes + i) * 8);
+                        scramble(acc);
+                        for(uint32_t i = toEnd; i < count; i++)
+                                accumulate(acc, in + i * STRIPE, SECRET + (i - toEnd) * 8);
+                        return count - toEnd;
+                }
+                for(uint32_t i = 0; i < count; i++)
+                        accumulate(acc, in + i * STRIPE, SECRET + (stripes + i) * 8);
+                return stripes + count;
+        }
+
+/***************************************************************************
+* uint32_t ror(uint32_t v, uint32_t n)
+* Description: rotates a 32 bit word right
+*
+* Parameters:
+*        v      I/P     uint32_t        word
+*        n      I/P     uint32_t        bits to rotate by, 1 to 31
+*        ror    O/P     uint32_t        rotated word
+**************************************************************************/
+        inline uint32_t ror(uint32_t v, uint32_t n)
+        {
+                return (v >> n) | (v << (32 - n));
+        }
+
+/***************************************************************************
+* void sha256Blocks(uint32_t state[8], const byte* in, uint64_t blocks)
+* Description: portable SHA-256 compression of whole 64 byte blocks
+*
+* Parameters:
+*        state  I/O     uint32_t[8]     hash state
+*        in     I/P     const byte*     first block
+*        blocks I/P     uint64_t        number of blocks
+**************************************************************************/
+        void sha256Blocks(uint32_t state[8], const byte* in, uint64_t blocks)
+        {
+                uint32_t w[64];
+                for(; blocks > 0; blocks--, in += 64){
+                        for(uint32_t i = 0; i < 16; i++){
+                                uint32_t v;
+                                memcpy(&v, in + 4 * i, 4);
+                                w[i] = be32toh(v);
+                        }
+                        for(uint32_t i = 16; i < 64; i++){
+                                uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                                uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                        }
+
+                        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+                        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+                        for(uint32_t i = 0; i < 64; i++){
+                                uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+                                uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                                h = g;
+                                g = f;
+                                f = e;
+                                e = d + t1;
+                                d = c;
+                                c = b;
+                                b = a;
+                                a = t1 + t2;
+                        }
+                        state[0] += a;
+                        state[1] += b;
+                        state[2] += c;
+                        state[3] += d;
+                        state[4] += e;
+                        state[5] += f;
+                        state[6] += g;
+                        state[7] += h;
+                }
+        }
+
+/***************************************************************************
+* uint32_t crc32cTable(uint32_t crc, const byte* in, uint64_t len)
+* Description: bytewise CRC-32C, for CPUs without SSE4.2
+*
+* Parameters:
+*        crc    I/P     uint32_t        running CRC, already inverted
+*        in     I/P     const byte*     bytes to add
+*        len    I/P     uint64_t        number of bytes
+*        crc32cTable    O/P     uint32_t        running CRC
+**************************************************************************/
+        uint32_t crc32cTable(uint32_t crc, const byte* in, uint64_t len)
+        {
+                //built once, the initialization of a local static is thread safe
+                static const std::vector<uint32_t> table = [](){
+                        std::vector<uint32_t> t(256);
+                        for(uint32_t i = 0; i < 256; i++){
+                                uint32_t c = i;
+                                for(uint32_t k = 0; k < 8; k++)
+                                        c = c & 1 ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+                                t[i] = c;
+                        }
+                        return t;
+                }();
+                for(uint64_t i = 0; i < len; i++)
+                        crc = table[(crc ^ in[i]) & 0xFF] ^ (crc >> 8);
+                return crc;
+        }
+
+#ifdef CHECKSUM_X86
+
+/***************************************************************************
+* void sha256BlocksNi(uint32_t state[8], const byte* in, uint64_t blocks)
+* Description: SHA-256 compression of whole 64 byte blocks with the SHA
+*               extensions. The state is kept as ABEF/CDGH, the layout
+*               sha256rnds2 works on, and each step runs four rounds while
+*               the message schedule for four rounds later is computed
+*
+* Parameters:
+*        state  I/O     uint32_t[8]     hash state
+*        in     I/P     const byte*     first block
+*        blocks I/P     uint64_t        number of blocks
+**************************************************************************/
+        __attribute__((target("sha,ssse3,sse4.1")))
+        void sha256BlocksNi(uint32_t state[8], const byte* in, uint64_t blocks)
+        {
+                const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+                __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+                __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+                __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+                state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+                for(; blocks > 0; blocks--, in += 64){
+                        __m128i abef = state0, cdgh = state1;
+                        __m128i w[4];
+                        for(uint32_t i = 0; i < 4; i++)
+                                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 16 * i)), swap);
+                        for(uint32_t i = 0; i < 16; i++){
+                                __m128i msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*)&SHA256_K[4 * i]));
+                                state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+                                state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+                                if(i < 12){
+                                        __m128i next = _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]),
+                                                        _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                                        w[i & 3] = _mm_sha256msg2_epu32(next, w[(i + 3) & 3]);
+                                }
+                        }
+                        state0 = _mm_add_epi32(state0, abef);
+                        state1 = _mm_add_epi32(state1, cdgh);
+                }
+
+                tmp = _mm_shuffle_epi32(state0, 0x1B);
+                state1 = _mm_shuffle_epi32(state1, 0xB1);
+                _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+                _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+        }
+
+/***************************************************************************
+* uint32_t crc32cHardware(uint32_t crc, const byte* in, uint64_t len)
+* Description: CRC-32C with the SSE4.2 crc32 instruction, 8 bytes at a time
+*
+* Parameters:
+*        crc    I/P     uint32_t        running CRC, already inverted
+*        in     I/P     const byte*     bytes to add
+*        len    I/P     uint64_t        number of bytes
+*        crc32cHardware O/P     uint32_t        running CRC
+**************************************************************************/
+        __attribute__((target("sse4.2")))
+        uint32_t crc32cHardware(uint32_t crc, const byte* in, uint64_t len)
+        {
+                uint64_t c = crc;
+                for(; len >= 8; len -= 8, in += 8){
+                        uint64_t v;
+                        memcpy(&v, in, 8);
+                        c = _mm_crc32_u64(c, v);
+                }
+                crc = (uint32_t)c;
+                for(; len > 0; len--)
+                        crc = _mm_crc32_u8(crc, *in++);
+                return crc;
+        }
+
+#endif // CHECKSUM_X86
+
+/***************************************************************************
+* uint32_t cpuHas(void)
+* Description: returns which accelerated hashes the CPU supports, looked up
+*               once
+*
+* Parameters:
+*        cpuHas O/P     uint32_t        CHECKSUM_CRC32C and CHECKSUM_SHA256 bits
+**************************************************************************/
+        uint32_t cpuHas(void)
+        {
+                static const uint32_t has = [](){
+                        uint32_t found = 0;
+#ifdef CHECKSUM_X86
+                        unsigned int a, b, c, d;
+                        bool sse41 = false;
+                        if(__get_cpuid(1, &a, &b, &c, &d)){
+                                if(c & bit_SSE4_2)
+                                        found |= QtFastStartSTD::CHECKSUM_CRC32C;
+                                sse41 = (c & bit_SSE4_1) && (c & bit_SSSE3);
+                        }
+                        if(sse41 && __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA))
+                                found |= QtFastStartSTD::CHECKSUM_SHA256;
+#endif // CHECKSUM_X86
+                        return found;
+                }();
+                return has;
+        }
+
+/***************************************************************************
+* void compress(uint32_t state[8], const byte* in, uint64_t blocks)
+* Description: SHA-256 compression of whole blocks, with the SHA extensions
+*               if the CPU has them
+*
+* Parameters:
+*        state  I/O     uint32_t[8]     hash state
+*        in     I/P     const byte*     first block
+*        blocks I/P     uint64_t        number of blocks
+**************************************************************************/
+        void compress(uint32_t state[8], const byte* in, uint64_t blocks)
+        {
+#ifdef CHECKSUM_X86
+                if(cpuHas() & QtFastStartSTD::CHECKSUM_SHA256){
+                        sha256BlocksNi(state, in, blocks);
+                        return;
+                }
+#endif // CHECKSUM_X86
+                sha256Blocks(state, in, blocks);
+        }
+
+}
+
+
+/***************************************************************************
+* QtFastStartSTD::Xxh3::Xxh3(void)
+* Description: starts an XXH3 hash
+*
+* Parameters:
+*        none
+**************************************************************************/
+        QtFastStartSTD::Xxh3::Xxh3(void)
+        {
+                const uint64_t initial[8] = {PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1};
+                memcpy(this->acc, initial, sizeof(this->acc));
+                this->buffered = 0;
+                this->stripes = 0;
+                this->total = 0;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Xxh3::update(const byte* in, uint64_t len)
+* Description: adds bytes to the hash. Whole 256 byte runs are accumulated
+*               straight from the input, the rest is kept until more bytes
+*               come in. The last stripe is always kept back, since the
+*               digest treats it differently
+*
+* Parameters:
+*        in     I/P     const byte*     bytes to add
+*        len    I/P     uint64_t        number of bytes
+**************************************************************************/
+        void QtFastStartSTD::Xxh3::update(const byte* in, uint64_t len)
+        {
+                const uint32_t size = sizeof(this->buffer);
+                this->total += len;
+                if(len + this->buffered <= size){
+                        memcpy(this->buffer + this->buffered, in, len);
+                        this->buffered += len;
+                        return;
+                }
+
+                if(this->buffered > 0){
+                        uint32_t fill = size - this->buffered;
+                        memcpy(this->buffer + this->buffered, in, fill);
+                        in += fill;
+                        len -= fill;
+                        this->stripes = consumeStripes(this->acc, this->buffer, size / STRIPE, this->stripes);
+                        this->buffered = 0;
+                }
+
+                if(len > size){
+                        do{
+                                this->stripes = consumeStripes(this->acc, in, size / STRIPE, this->stripes);
+                                in += size;
+                                len -= size;
+                        }while(len > size);
+                        //the digest may need the stripe before the kept bytes
+                        memcpy(this->buffer + size - STRIPE, in - STRIPE, STRIPE);
+                }
+                memcpy(this->buffer, in, len);
+                this->buffered = len;
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::Xxh3::digest(void) const
+* Description: returns the XXH3 hash of the bytes added so far, the hash can
+*               still be added to afterwards
+*
+* Parameters:
+*        digest O/P     uint64_t        64 bit XXH3
+**************************************************************************/
+        uint64_t QtFastStartSTD::Xxh3::digest(void) const
+        {
+                if(this->total <= 240)
+                        return xxh3Short(this->buffer, this->total);
+
+                uint64_t acc[8];
+                memcpy(acc, this->acc, sizeof(acc));
+                const byte* lastSecret = SECRET + sizeof(SECRET) - STRIPE - 7;
+                if(this->buffered >= STRIPE){
+                        consumeStripes(acc, this->buffer, (this->buffered - 1) / STRIPE, this->stripes);
+                        accumulate(acc, this->buffer + this->buffered - STRIPE, lastSecret);
+                }
+                else{
+                        //the last stripe reaches back into bytes that were already accumulated
+                        byte last[STRIPE];
+                        uint32_t catchup = STRIPE - this->buffered;
+                        memcpy(last, this->buffer + sizeof(this->buffer) - catchup, catchup);
+                        memcpy(last + catchup, this->buffer, this->buffered);
+                        accumulate(acc, last, lastSecret);
+                }
+
+                uint64_t result = this->total * PRIME64_1;
+                for(uint32_t i = 0; i < 4; i++)
+                        result += fold64(acc[2 * i] ^ load64(SECRET + 11 + 16 * i), acc[2 * i + 1] ^ load64(SECRET + 19 + 16 * i));
+                return avalanche(result);
+        }
+
+/***************************************************************************
+* QtFastStartSTD::Sha256::Sha256(void)
+* Description: starts a SHA-256 hash
+*
+* Parameters:
+*        none
+**************************************************************************/
+        QtFastStartSTD::Sha256::Sha256(void)
+        {
+                const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                                0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+                memcpy(this->state, initial, sizeof(this->state));
+                this->total = 0;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Sha256::update(const byte* in, uint64_t len)
+* Description: adds bytes to the hash, whole blocks straight from the input
+*
+* Parameters:
+*        in     I/P     const byte*     bytes to add
+*        len    I/P     uint64_t        number of bytes
+**************************************************************************/
+        void QtFastStartSTD::Sha256::update(const byte* in, uint64_t len)
+        {
+                uint32_t used = this->total % 64;
+                this->total += len;
+                if(used){
+                        uint32_t fill = 64 - used;
+                        if(len < fill){
+                                memcpy(this->buffer + used, in, len);
+                                return;
+                        }
+                        memcpy(this->buffer + used, in, fill);
+                        compress(this->state, this->buffer, 1);
+                        in += fill;
+                        len -= fill;
+                }
+                if(len >= 64)
+                        compress(this->state, in, len / 64);
+                memcpy(this->buffer, in + len / 64 * 64, len % 64);
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Sha256::digest(byte out[32]) const
+* Description: returns the SHA-256 hash of the bytes added so far, the hash
+*               can still be added to afterwards
+*
+* Parameters:
+*        out    O/P     byte[32]        big endian hash
+**************************************************************************/
+        void QtFastStartSTD::Sha256::digest(byte out[32]) const
+        {
+                uint32_t state[8];
+                memcpy(state, this->state, sizeof(state));
+                byte tail[128] = {};
+                uint32_t used = this->total % 64;
+                memcpy(tail, this->buffer, used);
+                tail[used] = 0x80;
+                uint32_t blocks = used < 56 ? 1 : 2;
+                uint64_t bits = htobe64(this->total * 8);
+                memcpy(tail + blocks * 64 - 8, &bits, 8);
+                compress(state, tail, blocks);
+                for(uint32_t i = 0; i < 8; i++){
+                        uint32_t v = htobe32(state[i]);
+                        memcpy(out + 4 * i, &v, 4);
+                }
+        }
+
+/***************************************************************************
+* uint32_t QtFastStartSTD::crc32c(uint32_t crc, const byte* in, uint64_t len)
+* Description: continues a CRC-32C over more bytes, with the SSE4.2 crc32
+*               instruction if the CPU has it
+*
+* Parameters:
+*        crc    I/P     uint32_t        CRC of the bytes before, 0 to start
+*        in     I/P     const byte*     bytes to add
+*        len    I/P     uint64_t        number of bytes
+*        crc32c O/P     uint32_t        CRC of all bytes
+**************************************************************************/
+        uint32_t QtFastStartSTD::crc32c(uint32_t crc, const byte* in, uint64_t len)
+        {
+#ifdef CHECKSUM_X86
+                if(cpuHas() & CHECKSUM_CRC32C)
+                        return ~crc32cHardware(~crc, in, len);
+#endif // CHECKSUM_X86
+                return ~crc32cTable(~crc, in, len);
+        }
+
+/***************************************************************************
+* QtFastStartSTD::Checksum::Checksum(uint32_t kinds, uint64_t partSize)
+* Description: creates an empty checksum of the selected hashes
+*
+* Parameters:
+*        kinds  I/P     uint32_t        ChecksumKind bits to compute
+*        partSize       I/P     uint64_t        bytes per part, 0 for no parts
+**************************************************************************/
+        QtFastStartSTD::Checksum::Checksum(uint32_t kinds, uint64_t partSize)
+        {
+                this->kinds = kinds;
+                this->partSize = partSize;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Checksum::reset(void)
+* Description: forgets every hashed byte and result, for the next conversion
+*
+* Parameters:
+*        none
+**************************************************************************/
+        void QtFastStartSTD::Checksum::reset(void)
+        {
+                this->whole = Running();
+                this->part = Running();
+                this->position = 0;
+                this->stale = false;
+                this->total = ChecksumDigest();
+                this->parts.clear();
+                this->fusedBytes = 0;
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::Checksum::getPosition(void) const
+* Description: returns the output offset the next hashed byte has to come from
+*
+* Parameters:
+*        getPosition    O/P     uint64_t        bytes hashed so far
+**************************************************************************/
+        uint64_t QtFastStartSTD::Checksum::getPosition(void) const
+        {
+                return this->position;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Checksum::update(const byte* in, uint64_t len)
+* Description: hashes bytes that were just written at the current position.
+*               Once hashed bytes were overwritten nothing is hashed anymore,
+*               finish then starts over from the output
+*
+* Parameters:
+*        in     I/P     const byte*     bytes written
+*        len    I/P     uint64_t        number of bytes
+**************************************************************************/
+        void QtFastStartSTD::Checksum::update(const byte* in, uint64_t len)
+        {
+                if(this->stale)
+                        return;
+                hash(in, len);
+                this->fusedBytes += len;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Checksum::invalidate(void)
+* Description: notes that bytes which were already hashed got overwritten
+*
+* Parameters:
+*        none
+**************************************************************************/
+        void QtFastStartSTD::Checksum::invalidate(void)
+        {
+                this->stale = true;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Checksum::finish(const byte* file, uint64_t len)
+* Description: hashes the bytes of the finished output that the writes did
+*               not cover, or all of it if hashed bytes were overwritten,
+*               and fills in the results
+*
+* Parameters:
+*        file   I/P     const byte*     finished output
+*        len    I/P     uint64_t        its size
+**************************************************************************/
+        void QtFastStartSTD::Checksum::finish(const byte* file, uint64_t len)
+        {
+                if(this->stale || this->position > len){
+                        uint32_t kinds = this->kinds;
+                        uint64_t partSize = this->partSize;
+                        reset();
+                        this->kinds = kinds;
+                        this->partSize = partSize;
+                }
+                hash(file + this->position, len - this->position);
+                close(this->whole, &this->total);
+                if(this->part.range.length > 0){
+                        this->parts.push_back(ChecksumDigest());
+                        close(this->part, &this->parts.back());
+                }
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Checksum::hash(const byte* in, uint64_t len)
+* Description: adds bytes to the whole output and to the current part,
+*               closing every part that fills up
+*
+* Parameters:
+*        in     I/P     const byte*     bytes at the current position
+*        len    I/P     uint64_t        number of bytes
+**************************************************************************/
+        void QtFastStartSTD::Checksum::hash(const byte* in, uint64_t len)
+        {
+                feed(this->whole, in, len);
+                this->position += len;
+                while(this->partSize && len > 0){
+                        uint64_t q = this->partSize - this->part.range.length;
+                        q = q < len ? q : len;
+                        feed(this->part, in, q);
+                        in += q;
+                        len -= q;
+                        if(this->part.range.length == this->partSize){
+                                this->parts.push_back(ChecksumDigest());
+                                close(this->part, &this->parts.back());
+                                uint64_t next = this->part.range.offset + this->partSize;
+                                this->part = Running();
+                                this->part.range.offset = next;
+                        }
+                }
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Checksum::feed(Running &r, const byte* in, uint64_t len)
+* Description: adds bytes to the selected hashes of one range
+*
+* Parameters:
+*        r      I/O     Running&        hashes of the range
+*        in     I/P     const byte*     bytes to add
+*        len    I/P     uint64_t        number of bytes
+**************************************************************************/
+        void QtFastStartSTD::Checksum::feed(Running &r, const byte* in, uint64_t len)
+        {
+                if(this->kinds & CHECKSUM_XXH3)
+                        r.xxh3.update(in, len);
+                if(this->kinds & CHECKSUM_CRC32C)
+                        r.crc32c = crc32c(r.crc32c, in, len);
+                if(this->kinds & CHECKSUM_SHA256)
+                        r.sha256.update(in, len);
+                r.range.length += len;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Checksum::close(Running &r, ChecksumDigest *out) const
+* Description: writes the results of one range
+*
+* Parameters:
+*        r      I/P     Running&        hashes of the range
+*        out    O/P     ChecksumDigest* results, hashes that were not selected stay 0
+**************************************************************************/
+        void QtFastStartSTD::Checksum::close(Running &r, ChecksumDigest *out) const
+        {
+                *out = r.range;
+                if(this->kinds & CHECKSUM_XXH3)
+                        out->xxh3 = r.xxh3.digest();
+                if(this->kinds & CHECKSUM_CRC32C)
+                        out->crc32c = r.crc32c;
+                if(this->kinds & CHECKSUM_SHA256)
+                        r.sha256.digest(out->sha256);
+        }
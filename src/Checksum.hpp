@@ -0,0 +1,117 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <vector>
+
+//bytes copied before they are hashed, small enough to still be in the cache
+#define CHECKSUM_SLICE  65536
+
+
+typedef         uint8_t         byte;
+
+namespace QtFastStartSTD{
+
+        enum ChecksumKind{
+        //hashes a Checksum computes, combined as a bit set
+                CHECKSUM_XXH3 = 1,      //64 bit XXH3 with the default secret and seed 0
+                CHECKSUM_CRC32C = 2,    //CRC-32C (Castagnoli), SSE4.2 accelerated where available
+                CHECKSUM_SHA256 = 4     //SHA-256, SHA-NI accelerated where available
+        };
+
+/*Streaming XXH3, 64 bit variant*/
+        class Xxh3{
+                private:
+                        uint64_t acc[8];
+                        byte buffer[256];
+                        uint32_t buffered;
+                        uint32_t stripes;
+                        uint64_t total;
+
+                public:
+                        Xxh3(void);
+                        void update(const byte* in, uint64_t len);
+                        uint64_t digest(void) const;
+        };
+
+/*Streaming SHA-256*/
+        class Sha256{
+                private:
+                        uint32_t state[8];
+                        byte buffer[64];
+                        uint64_t total;
+
+                public:
+                        Sha256(void);
+                        void update(const byte* in, uint64_t len);
+                        void digest(byte out[32]) const;
+        };
+
+        uint32_t crc32c(uint32_t crc, const byte* in, uint64_t len);
+
+/*Hashes of one range of the output*/
+        struct ChecksumDigest{
+                uint64_t offset = 0;
+                uint64_t length = 0;
+                uint64_t xxh3 = 0;
+                uint32_t crc32c = 0;
+                byte sha256[32] = {};
+        };
+
+/*Hashes the output of a conversion while it is written, so it does not have
+to be read again afterwards. Filled in when QtFastStartOptions::checksum points
+to one. Bytes are hashed as they are appended to the output; a write that goes
+back over hashed bytes makes the conversion hash the finished output instead.
+With partSize set, every part of that many bytes also gets its own hashes, for
+multipart uploads*/
+        class Checksum{
+                private:
+                        struct Running{
+                                Xxh3 xxh3;
+                                uint32_t crc32c = 0;
+                                Sha256 sha256;
+                                ChecksumDigest range;
+                        };
+                        Running whole;
+                        Running part;
+                        uint64_t position = 0;
+                        bool stale = false;
+
+                        void hash(const byte* in, uint64_t len);
+                        void feed(Running &r, const byte* in, uint64_t len);
+                        void close(Running &r, ChecksumDigest *out) const;
+
+                public:
+                        uint32_t kinds;                 //ChecksumKind bits to compute
+                        uint64_t partSize;              //bytes per part, 0 for no parts
+                        ChecksumDigest total;           //hashes of the whole output
+                        std::vector<ChecksumDigest> parts;
+                        uint64_t fusedBytes = 0;        //bytes hashed while they were written
+
+                        Checksum(uint32_t kinds, uint64_t partSize = 0);
+                        void reset(void);
+                        uint64_t getPosition(void) const;
+                        void update(const byte* in, uint64_t len);
+                        void invalidate(void);
+                        void finish(const byte* file, uint64_t len);
+        };
+
+}
+
+
+#endif // CHECKSUM_H
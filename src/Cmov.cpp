@@ -0,0 +1,220 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Cmov.cpp
+* Procedures:
+* QtFastStartSTD::isCompressedMoov      -returns whether a moov atom holds a compressed cmov atom
+* QtFastStartSTD::inflateMoov   -decompresses the moov atom stored inside of a cmov atom
+* QtFastStartSTD::deflateMoov   -wraps a moov atom into a zlib compressed cmov atom
+* QtFastStartSTD::packMoov      -serializes a moov atom, compressing it if asked to
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+//for debugging only
+
+#include <vector>
+#include <memory>
+#include <zlib.h>
+#include "QtFastStartCPP.hpp"
+#include "Endian.hpp"
+
+//largest expansion a deflate stream can achieve
+#define ZLIB_MAX_RATIO 1032
+
+
+/***************************************************************************
+* bool QtFastStartSTD::isCompressedMoov(const byte* moov, uint64_t len, uint32_t headerSize)
+* Description: returns whether a moov atom holds a compressed cmov atom
+*
+* Parameters:
+*        moov   I/P     const byte*     complete moov atom, header included
+*        len    I/P     uint64_t        size of the moov atom
+*        headerSize     I/P     uint32_t        size of the moov atom's header
+*        isCompressedMoov       O/P     bool    true if the first child is a cmov atom
+**************************************************************************/
+        bool QtFastStartSTD::isCompressedMoov(const byte* moov, uint64_t len, uint32_t headerSize)
+        {
+                uint32_t type;
+                if(len < (uint64_t)headerSize + 8)
+                        return false;
+                memcpy(&type, &moov[headerSize + 4], 4);
+                return type == CMOV_ATOM;
+        }
+
+/***************************************************************************
+* BYTEBUFFER::ByteBuffer* QtFastStartSTD::inflateMoov(const byte* moov, uint64_t len, uint32_t headerSize, uint64_t maxSize)
+* Description: decompresses the moov atom stored inside of a cmov atom. The
+*               output buffer is allocated once at the uncompressed size the
+*               cmvd atom announces, which is checked against what zlib can
+*               expand the compressed data to and against maxSize before
+*               allocating
+*
+* Parameters:
+*        moov   I/P     const byte*     complete moov atom holding the cmov atom
+*        len    I/P     uint64_t        size of the moov atom
+*        headerSize     I/P     uint32_t        size of the moov atom's header
+*        maxSize        I/P     uint64_t        largest uncompressed size to allocate, Limit_Exceeded is thrown above it
+*        inflateMoov    O/P     BYTEBUFFER::ByteBuffer* newly allocated buffer holding the
+*                                       uncompressed moov atom, owned by the caller
+**************************************************************************/
+        BYTEBUFFER::ByteBuffer* QtFastStartSTD::inflateMoov(const byte* moov, uint64_t len, uint32_t headerSize, uint64_t maxSize)
+        {
+                std::vector<AtomRange> children;
+                std::vector<AtomRange> cmov;
+                const AtomRange* dcom = nullptr;
+                const AtomRange* cmvd = nullptr;
+
+                if(!scanAtoms(moov, headerSize, len, children) || children.empty() || children[0].type != CMOV_ATOM)
+                        throw Malformed_Atom("Failed to parse cmov atom\n");
+                if(!scanAtoms(moov, children[0].offset + children[0].headerSize,
+                                children[0].offset + children[0].size, cmov))
+                        throw Malformed_Atom("Failed to parse cmov atom\n");
+                for(const AtomRange &r : cmov){
+                        if(r.type == DCOM_ATOM)
+                                dcom = &r;
+                        else if(r.type == CMVD_ATOM)
+                                cmvd = &r;
+                }
+                if(!dcom || !cmvd || dcom->size < dcom->headerSize + 4 || cmvd->size < cmvd->headerSize + 4)
+                        throw Malformed_Atom("cmov atom is missing dcom or cmvd\n");
+
+                uint32_t algorithm;
+                memcpy(&algorithm, &moov[dcom->offset + dcom->headerSize], 4);
+                if(algorithm != ZLIB_COMPRESSION)
+                        throw Compressed_Moov();
+
+                uint32_t plainSize;
+                memcpy(&plainSize, &moov[cmvd->offset + cmvd->headerSize], 4);
+                plainSize = be32toh(plainSize);
+                const byte* src = &moov[cmvd->offset + cmvd->headerSize + 4];
+                uint64_t srcLen = cmvd->size - cmvd->headerSize - 4;
+                if(plainSize < ATOM_PREAMBLE_SIZE || plainSize > srcLen * ZLIB_MAX_RATIO)
+                        throw Malformed_Atom("Bad uncompressed moov size\n");
+                if(plainSize > maxSize)
+                        throw Limit_Exceeded("Uncompressed moov atom exceeds the size limit\n");
+
+#ifdef DEBUG
+                std::cout << "inflating " << srcLen << " bytes of cmov into " << plainSize << " bytes..." << std::endl;
+#endif // DEBUG
+
+                BYTEBUFFER::ByteBuffer* out = new BYTEBUFFER::ByteBuffer(plainSize, BYTEBUFFER::B_ENDIAN);
+                uLongf outLen = plainSize;
+                if(uncompress((Bytef*)out->getData(), &outLen, src, srcLen) != Z_OK || outLen != plainSize){
+                        delete out;
+                        throw Malformed_Atom("Failed to decompress cmov atom\n");
+                }
+
+                //the data has to be exactly one moov atom
+                std::vector<AtomRange> inner;
+                if(!scanAtoms(out->getData(), 0, plainSize, inner) || inner.size() != 1 || inner[0].type != MOOV_ATOM){
+                        delete out;
+                        throw Malformed_Atom("Compressed data is not a moov atom\n");
+                }
+                out->setLimit(plainSize);
+                out->rewind();
+                return out;
+        }
+
+/***************************************************************************
+* BYTEBUFFER::ByteBuffer* QtFastStartSTD::deflateMoov(BYTEBUFFER::ByteBuffer *moov, uint64_t minSize)
+* Description: wraps a moov atom into a zlib compressed cmov atom, as
+*               moov{cmov{dcom, cmvd}}. When the result is smaller than
+*               minSize, a free atom is appended to the outer moov so the
+*               caller can keep a size it already laid the file out with
+*
+* Parameters:
+*        moov   I/P     BYTEBUFFER::ByteBuffer* plain moov atom, from position 0 to its limit
+*        minSize        I/P     uint64_t        size the result is padded up to, 0 for no padding
+*        deflateMoov    O/P     BYTEBUFFER::ByteBuffer* newly allocated buffer holding the compressed
+*                                       moov atom, owned by the caller. Padding of less than
+*                                       an atom header can not be expressed, the result is then
+*                                       larger than minSize and the caller has to retry with it
+**************************************************************************/
+        BYTEBUFFER::ByteBuffer* QtFastStartSTD::deflateMoov(BYTEBUFFER::ByteBuffer *moov, uint64_t minSize)
+        {
+                uint64_t plainSize = moov->getLimit();
+                if(plainSize > UINT32_MAX)
+                        throw Malformed_Atom("moov atom is too large to compress\n");
+
+                std::vector<byte> packed(compressBound(plainSize));
+                uLongf packedLen = packed.size();
+                if(compress2(packed.data(), &packedLen, moov->getData(), plainSize, Z_BEST_COMPRESSION) != Z_OK)
+                        throw Malformed_Atom("Failed to compress moov atom\n");
+
+                //moov, cmov, dcom and cmvd headers, the algorithm and the uncompressed size
+                uint64_t size = 4 * ATOM_PREAMBLE_SIZE + 8 + packedLen;
+                uint64_t pad = 0;
+                if(minSize > size){
+                        pad = minSize - size;
+                        if(pad < ATOM_PREAMBLE_SIZE)
+                                pad = ATOM_PREAMBLE_SIZE;
+                }
+                if(size + pad > UINT32_MAX)
+                        throw Malformed_Atom("moov atom is too large to compress\n");
+
+                BYTEBUFFER::ByteBuffer* out = new BYTEBUFFER::ByteBuffer(size + pad, BYTEBUFFER::B_ENDIAN);
+                out->putUint_32(size + pad);
+                out->putUint_32(htobe32(MOOV_ATOM));
+                out->putUint_32(size - ATOM_PREAMBLE_SIZE);
+                out->putUint_32(htobe32(CMOV_ATOM));
+                out->putUint_32(ATOM_PREAMBLE_SIZE + 4);
+                out->putUint_32(htobe32(DCOM_ATOM));
+                out->putUint_32(htobe32(ZLIB_COMPRESSION));
+                out->putUint_32(ATOM_PREAMBLE_SIZE + 4 + packedLen);
+                out->putUint_32(htobe32(CMVD_ATOM));
+                out->putUint_32(plainSize);
+                out->put(packed.data(), packedLen);
+                if(pad){
+                        out->putUint_32(pad);
+                        out->putUint_32(htobe32(FREE_ATOM));
+                        std::vector<byte> zero(pad - ATOM_PREAMBLE_SIZE, 0);
+                        out->put(zero.data(), zero.size());
+                }
+
+#ifdef DEBUG
+                std::cout << "deflated moov from " << plainSize << " to " << size + pad << " bytes" << std::endl;
+#endif // DEBUG
+
+                out->rewind();
+                return out;
+        }
+
+/***************************************************************************
+* BYTEBUFFER::ByteBuffer* QtFastStartSTD::packMoov(const QtFastStartSTD::Atom &moov, bool compress, uint64_t minSize)
+* Description: serializes a moov atom, compressing it into a cmov if asked to
+*
+* Parameters:
+*        moov   I/P     const QtFastStartSTD::Atom&     moov atom to serialize
+*        compress       I/P     bool    whether to wrap it into a cmov atom
+*        minSize        I/P     uint64_t        size a compressed moov is padded up to
+*        packMoov       O/P     BYTEBUFFER::ByteBuffer* newly allocated buffer owned by the caller
+**************************************************************************/
+        BYTEBUFFER::ByteBuffer* QtFastStartSTD::packMoov(const QtFastStartSTD::Atom &moov, bool compress, uint64_t minSize)
+        {
+                std::vector<byte> plain;
+                moov.serialize(plain);
+                BYTEBUFFER::ByteBuffer* buffer = new BYTEBUFFER::ByteBuffer(plain.size(), BYTEBUFFER::B_ENDIAN);
+                buffer->put(plain.data(), plain.size());
+                buffer->rewind();
+                if(!compress)
+                        return buffer;
+                std::unique_ptr<BYTEBUFFER::ByteBuffer> owner(buffer);
+                return deflateMoov(buffer, minSize);
+        }
@@ -0,0 +1,90 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Compact.cpp
+* Procedures:
+* QtFastStartSTD::QtFastStart::compactTables    -rebuilds the sample tables of the loaded moov in their smallest form
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+
+#include "QtFastStartCPP.hpp"
+#include "SampleTable.hpp"
+
+
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::compactTables(uint32_t *headerSize)
+* Description: rebuilds the sample tables of every trak of the loaded moov
+*               through SampleTable::build, which run-length encodes stts,
+*               ctts and stsc, collapses a constant stsz, leaves out an stss
+*               listing every sample and writes stco instead of co64 when
+*               the offsets fit. With rechunk set, chunks lying back to back
+*               are merged first; with rechunk alone only stsc and the chunk
+*               offset table are rewritten, at their original width. A trak
+*               keeps its old tables unless the new ones are smaller, stz2
+*               can be, or if they can not be parsed. The moov must already
+*               hold the output offsets
+*
+* Parameters:
+*        headerSize     O/P     uint32_t*       header size of the compacted moov atom
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::compactTables(uint32_t *headerSize)
+        {
+                uint64_t size = moovAtom->getLimit();
+                trackBuffer(size);
+                Atom moov = Atom::parse(moovAtom->getData(), size);
+
+                //offsets this close to 4GB stay 64 bit, recompressing the moov may still move them up
+                uint64_t maxNarrow = UINT32_MAX - (size < UINT32_MAX ? size : UINT32_MAX);
+                for(Atom &trak : moov.children){
+                        if(trak.type != TRAK_ATOM)
+                                continue;
+                        Atom* stbl = SampleTable::getStbl(trak);
+                        if(!stbl)
+                                continue;
+                        Atom original = *stbl;
+                        SampleTable track;
+                        //traks without complete sample tables, such as some timecode and hint tracks, keep theirs
+                        try{
+                                track.parse(trak);
+                        }
+                        catch(const Malformed_Atom&){
+#ifdef DEBUG
+                                std::cerr << "trak without complete sample tables, left as it is" << std::endl;
+#endif // DEBUG
+                                continue;
+                        }
+                        if(this->options.rechunk)
+                                track.mergeChunks();
+                        if(this->options.compactMoov)
+                                track.build(trak, maxNarrow);
+                        else
+                                track.buildChunks(trak);
+                        stbl = SampleTable::getStbl(trak);
+                        if(stbl->size() >= original.size())
+                                *stbl = std::move(original);
+                }
+
+                replaceMoov(moov, headerSize);
+                trackBuffer(-(int64_t)size);
+#ifdef DEBUG
+                std::cout << "compacted the moov from " << size << " to " << moovAtom->getLimit() << " bytes" << std::endl;
+#endif // DEBUG
+        }
@@ -0,0 +1,153 @@
+/**
+    ByteBuffer implementation
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <stdint.h>
+#include <string.h>
+#include "ByteBuffer.hpp"
+#include "Endian.hpp"
+
+
+/*Cursors are the compile time counterpart of ByteBuffer: the byte order and
+whether accesses are bounds checked are template parameters instead of run time
+state, so every access inlines down to a load and a byte swap. Hot loops check
+a whole table once with fits() and then walk it with an unchecked cursor*/
+namespace BYTEBUFFER{
+
+/*Byte order policies*/
+        struct BigEndian{
+                static uint16_t load16(const uint8_t* p){uint16_t v; memcpy(&v, p, 2); return be16toh(v);}
+                static uint32_t load32(const uint8_t* p){uint32_t v; memcpy(&v, p, 4); return be32toh(v);}
+                static uint64_t load64(const uint8_t* p){uint64_t v; memcpy(&v, p, 8); return be64toh(v);}
+                static void store16(uint8_t* p, uint16_t v){v = htobe16(v); memcpy(p, &v, 2);}
+                static void store32(uint8_t* p, uint32_t v){v = htobe32(v); memcpy(p, &v, 4);}
+                static void store64(uint8_t* p, uint64_t v){v = htobe64(v); memcpy(p, &v, 8);}
+        };
+
+        struct LittleEndian{
+                static uint16_t load16(const uint8_t* p){uint16_t v; memcpy(&v, p, 2); return le16toh(v);}
+                static uint32_t load32(const uint8_t* p){uint32_t v; memcpy(&v, p, 4); return le32toh(v);}
+                static uint64_t load64(const uint8_t* p){uint64_t v; memcpy(&v, p, 8); return le64toh(v);}
+                static void store16(uint8_t* p, uint16_t v){v = htole16(v); memcpy(p, &v, 2);}
+                static void store32(uint8_t* p, uint32_t v){v = htole32(v); memcpy(p, &v, 4);}
+                static void store64(uint8_t* p, uint64_t v){v = htole64(v); memcpy(p, &v, 8);}
+        };
+
+/*Bounds policies, called with the bytes an access needs and the bytes left*/
+        struct CheckedBounds{
+                static void read(uint64_t len, uint64_t rem){if(len > rem) throw Buffer_Underflow(len, rem);}
+                static void write(uint64_t len, uint64_t rem){if(len > rem) throw Buffer_Overflow(len, rem);}
+        };
+
+        struct UncheckedBounds{
+                static void read(uint64_t, uint64_t){}
+                static void write(uint64_t, uint64_t){}
+        };
+
+
+/*Position and limit over memory owned by someone else, such as a ByteBuffer or
+an atom payload. Positional accesses leave the position alone*/
+        template<class Order, class Bounds>
+        class Cursor{
+                private:
+                        uint8_t *data;
+                        uint64_t limit;
+                        uint64_t position;
+
+                        uint64_t left(uint64_t pos) const{return pos > this->limit ? 0 : this->limit - pos;}
+
+                public:
+                        Cursor(uint8_t *data, uint64_t limit, uint64_t position = 0)
+                                : data(data), limit(limit), position(position){}
+                        explicit Cursor(ByteBuffer *buffer)
+                                : data(buffer->getWritableData()), limit(buffer->getLimit()), position(buffer->getPosition()){}
+
+                        uint64_t getPosition(void) const{return this->position;}
+                        uint64_t getLimit(void) const{return this->limit;}
+                        uint64_t remaining(void) const{return this->limit - this->position;}
+                        void setPosition(uint64_t newPos)
+                        {
+                                if(newPos > this->limit)
+                                        throw Bad_Position(newPos, this->limit);
+                                this->position = newPos;
+                        }
+                        //whether count elements of size bytes starting at pos lie within the limit
+                        bool fits(uint64_t pos, uint64_t count, uint64_t size) const
+                        {
+                                return pos <= this->limit && count <= (this->limit - pos) / size;
+                        }
+
+                        uint8_t getUint_8(uint64_t pos) const{Bounds::read(1, left(pos)); return this->data[pos];}
+                        uint16_t getUint_16(uint64_t pos) const{Bounds::read(2, left(pos)); return Order::load16(&this->data[pos]);}
+                        uint32_t getUint_32(uint64_t pos) const{Bounds::read(4, left(pos)); return Order::load32(&this->data[pos]);}
+                        uint64_t getUint_64(uint64_t pos) const{Bounds::read(8, left(pos)); return Order::load64(&this->data[pos]);}
+                        uint8_t getUint_8(void){uint8_t v = getUint_8(this->position); this->position += 1; return v;}
+                        uint16_t getUint_16(void){uint16_t v = getUint_16(this->position); this->position += 2; return v;}
+                        uint32_t getUint_32(void){uint32_t v = getUint_32(this->position); this->position += 4; return v;}
+                        uint64_t getUint_64(void){uint64_t v = getUint_64(this->position); this->position += 8; return v;}
+
+                        void putUint_8(uint64_t pos, uint8_t v){Bounds::write(1, left(pos)); this->data[pos] = v;}
+                        void putUint_16(uint64_t pos, uint16_t v){Bounds::write(2, left(pos)); Order::store16(&this->data[pos], v);}
+                        void putUint_32(uint64_t pos, uint32_t v){Bounds::write(4, left(pos)); Order::store32(&this->data[pos], v);}
+                        void putUint_64(uint64_t pos, uint64_t v){Bounds::write(8, left(pos)); Order::store64(&this->data[pos], v);}
+                        void putUint_8(uint8_t v){putUint_8(this->position, v); this->position += 1;}
+                        void putUint_16(uint16_t v){putUint_16(this->position, v); this->position += 2;}
+                        void putUint_32(uint32_t v){putUint_32(this->position, v); this->position += 4;}
+                        void putUint_64(uint64_t v){putUint_64(this->position, v); this->position += 8;}
+
+                        //bulk accessors, the whole array is bounds checked once
+                        void getArray_32(uint64_t pos, uint32_t *out, uint64_t count) const
+                        {
+                                if(!fits(pos, count, 4))
+                                        Bounds::read(count * 4, left(pos));
+                                const uint8_t *p = &this->data[pos];
+                                for(uint64_t i = 0; i < count; i++)
+                                        out[i] = Order::load32(&p[i * 4]);
+                        }
+                        void getArray_64(uint64_t pos, uint64_t *out, uint64_t count) const
+                        {
+                                if(!fits(pos, count, 8))
+                                        Bounds::read(count * 8, left(pos));
+                                const uint8_t *p = &this->data[pos];
+                                for(uint64_t i = 0; i < count; i++)
+                                        out[i] = Order::load64(&p[i * 8]);
+                        }
+                        void putArray_32(uint64_t pos, const uint32_t *in, uint64_t count)
+                        {
+                                if(!fits(pos, count, 4))
+                                        Bounds::write(count * 4, left(pos));
+                                uint8_t *p = &this->data[pos];
+                                for(uint64_t i = 0; i < count; i++)
+                                        Order::store32(&p[i * 4], in[i]);
+                        }
+                        void putArray_64(uint64_t pos, const uint64_t *in, uint64_t count)
+                        {
+                                if(!fits(pos, count, 8))
+                                        Bounds::write(count * 8, left(pos));
+                                uint8_t *p = &this->data[pos];
+                                for(uint64_t i = 0; i < count; i++)
+                                        Order::store64(&p[i * 8], in[i]);
+                        }
+        };
+
+        typedef Cursor<BigEndian, CheckedBounds> BigEndianCursor;
+        typedef Cursor<BigEndian, UncheckedBounds> BigEndianRawCursor;
+
+}
+
+
+#endif // CURSOR_H
@@ -0,0 +1,452 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Defragment.cpp
+* Procedures:
+* QtFastStartSTD::QtFastStart::defragmentImpl   -converts a fragmented mp4 into a fast-start progressive mp4
+* readTrex      -reads the per track sample defaults of the mvex atom
+* appendTraf    -appends the samples described by a traf atom to the sample table of its track
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+
+#include <map>
+#include <algorithm>
+#include <memory>
+#include "QtFastStartCPP.hpp"
+#include "SampleTable.hpp"
+#include "Endian.hpp"
+
+#define TFHD_BASE_DATA_OFFSET_PRESENT   0x000001
+#define TFHD_DESCRIPTION_INDEX_PRESENT  0x000002
+#define TFHD_DEFAULT_DURATION_PRESENT   0x000008
+#define TFHD_DEFAULT_SIZE_PRESENT       0x000010
+#define TFHD_DEFAULT_FLAGS_PRESENT      0x000020
+#define TFHD_DEFAULT_BASE_IS_MOOF       0x020000
+
+#define TRUN_DATA_OFFSET_PRESENT        0x000001
+#define TRUN_FIRST_FLAGS_PRESENT        0x000004
+#define TRUN_SAMPLE_DURATION_PRESENT    0x000100
+#define TRUN_SAMPLE_SIZE_PRESENT        0x000200
+#define TRUN_SAMPLE_FLAGS_PRESENT       0x000400
+#define TRUN_SAMPLE_CTO_PRESENT         0x000800
+
+#define SAMPLE_IS_NON_SYNC              0x00010000
+
+
+namespace{
+
+        using QtFastStartSTD::Atom;
+        using QtFastStartSTD::Chunk;
+        using QtFastStartSTD::Sample;
+        using QtFastStartSTD::SampleTable;
+
+/*Sample defaults of one track, from its trex atom*/
+        struct TrackDefaults{
+                uint32_t descriptionIndex = 1;
+                uint32_t duration = 0;
+                uint32_t size = 0;
+                uint32_t flags = 0;
+        };
+
+/***************************************************************************
+* std::map<uint32_t, TrackDefaults> readTrex(Atom &moov)
+* Description: reads the per track sample defaults of the mvex atom
+*
+* Parameters:
+*        moov   I/P     Atom&   moov atom holding the mvex atom
+*        readTrex       O/P     std::map<uint32_t, TrackDefaults>       defaults by track ID
+**************************************************************************/
+        std::map<uint32_t, TrackDefaults> readTrex(Atom &moov)
+        {
+                std::map<uint32_t, TrackDefaults> ret;
+                Atom* mvex = moov.find(MVEX_ATOM);
+                if(!mvex)
+                        return ret;
+                for(Atom &trex : mvex->children){
+                        if(trex.type != TREX_ATOM)
+                                continue;
+                        TrackDefaults d;
+                        d.descriptionIndex = trex.getUint_32(8);
+                        d.duration = trex.getUint_32(12);
+                        d.size = trex.getUint_32(16);
+                        d.flags = trex.getUint_32(20);
+                        ret[trex.getUint_32(4)] = d;
+                }
+                return ret;
+        }
+
+/***************************************************************************
+* uint64_t appendTraf(Atom &traf, uint64_t base, const TrackDefaults &defaults, SampleTable &track, uint64_t fileSize)
+* Description: appends the samples described by a traf atom to the sample
+*               table of its track. Every trun becomes one chunk
+*
+* Parameters:
+*        traf   I/P     Atom&   traf atom to read
+*        base   I/P     uint64_t        implied base data offset of this traf
+*        defaults       I/P     const TrackDefaults&    trex defaults of the track
+*        track  I/O     SampleTable&    sample table to append to
+*        fileSize       I/P     uint64_t        size of the input, for bounds checks
+*        appendTraf     O/P     uint64_t        offset one past the last sample data of the traf
+**************************************************************************/
+        uint64_t appendTraf(Atom &traf, uint64_t base, const TrackDefaults &defaults, SampleTable &track, uint64_t fileSize)
+        {
+                Atom* tfhd = traf.find(TFHD_ATOM);
+                uint32_t flags = tfhd->getUint_32(0) & 0xffffff;
+                uint64_t pos = 8;
+                TrackDefaults d = defaults;
+
+                if(flags & TFHD_BASE_DATA_OFFSET_PRESENT){
+                        base = tfhd->getUint_64(pos);
+                        pos += 8;
+                }
+                if(flags & TFHD_DESCRIPTION_INDEX_PRESENT){
+                        d.descriptionIndex = tfhd->getUint_32(pos);
+                        pos += 4;
+                }
+                if(flags & TFHD_DEFAULT_DURATION_PRESENT){
+                        d.duration = tfhd->getUint_32(pos);
+                        pos += 4;
+                }
+                if(flags & TFHD_DEFAULT_SIZE_PRESENT){
+                        d.size = tfhd->getUint_32(pos);
+                        pos += 4;
+                }
+                if(flags & TFHD_DEFAULT_FLAGS_PRESENT)
+                        d.flags = tfhd->getUint_32(pos);
+
+                uint64_t time = track.samples.empty() ? 0 : track.samples.back().decodeTime + track.samples.back().duration;
+                Atom* tfdt = traf.find(TFDT_ATOM);
+                if(tfdt)
+                        time = tfdt->getUint_8(0) == 1 ? tfdt->getUint_64(4) : tfdt->getUint_32(4);
+
+                uint64_t next = base;
+                for(Atom &trun : traf.children){
+                        if(trun.type != TRUN_ATOM)
+                                continue;
+                        uint32_t tflags = trun.getUint_32(0) & 0xffffff;
+                        uint32_t count = trun.getUint_32(4);
+                        pos = 8;
+                        if(tflags & TRUN_DATA_OFFSET_PRESENT){
+                                next = base + (int64_t)(int32_t)trun.getUint_32(pos);
+                                pos += 4;
+                        }
+                        uint32_t firstFlags = d.flags;
+                        bool hasFirstFlags = tflags & TRUN_FIRST_FLAGS_PRESENT;
+                        if(hasFirstFlags){
+                                firstFlags = trun.getUint_32(pos);
+                                pos += 4;
+                        }
+                        uint32_t entrySize = 4 * (!!(tflags & TRUN_SAMPLE_DURATION_PRESENT) + !!(tflags & TRUN_SAMPLE_SIZE_PRESENT)
+                                                + !!(tflags & TRUN_SAMPLE_FLAGS_PRESENT) + !!(tflags & TRUN_SAMPLE_CTO_PRESENT));
+                        if((uint64_t)count * entrySize > trun.data.size() - pos)
+                                throw QtFastStartSTD::Malformed_Atom("Bad atom size/element count\n");
+
+                        Chunk ch;
+                        ch.offset = next;
+                        ch.firstSample = track.samples.size();
+                        ch.sampleCount = count;
+                        ch.descriptionIndex = d.descriptionIndex;
+                        track.chunks.push_back(ch);
+                        track.samples.reserve(track.samples.size() + count);
+
+                        for(uint32_t i = 0; i < count; i++){
+                                Sample s;
+                                s.duration = d.duration;
+                                s.size = d.size;
+                                uint32_t sflags = (i == 0 && hasFirstFlags) ? firstFlags : d.flags;
+                                s.compositionOffset = 0;
+                                if(tflags & TRUN_SAMPLE_DURATION_PRESENT){
+                                        s.duration = trun.getUint_32(pos);
+                                        pos += 4;
+                                }
+                                if(tflags & TRUN_SAMPLE_SIZE_PRESENT){
+                                        s.size = trun.getUint_32(pos);
+                                        pos += 4;
+                                }
+                                if(tflags & TRUN_SAMPLE_FLAGS_PRESENT){
+                                        sflags = trun.getUint_32(pos);
+                                        pos += 4;
+                                }
+                                if(tflags & TRUN_SAMPLE_CTO_PRESENT){
+                                        s.compositionOffset = (int32_t)trun.getUint_32(pos);
+                                        track.hasCompositionOffsets = true;
+                                        pos += 4;
+                                }
+                                s.sync = !(sflags & SAMPLE_IS_NON_SYNC);
+                                s.offset = next;
+                                s.decodeTime = time;
+                                s.descriptionIndex = d.descriptionIndex;
+                                if(s.offset + s.size > fileSize)
+                                        throw QtFastStartSTD::Malformed_Atom("Sample lies outside of the file\n");
+                                next += s.size;
+                                time += s.duration;
+                                track.samples.push_back(s);
+                        }
+                }
+                return next;
+        }
+
+}
+
+
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::defragmentImpl(const std::vector<QtFastStartSTD::AtomRange> &top)
+* Description: converts a fragmented mp4 into a fast-start progressive mp4.
+*               The moof atoms are merged into the sample tables of a single
+*               moov, which is written in front of one mdat holding the
+*               sample data in its original order. With an interleave
+*               duration the samples are regrouped and interleaved as by
+*               interleaveImpl, and the moov is compressed and its chunks
+*               merged as for any other output
+*
+* Parameters:
+*        top    I/P     const std::vector<QtFastStartSTD::AtomRange>&   top-level atoms of the input
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::defragmentImpl(const std::vector<QtFastStartSTD::AtomRange> &top)
+        {
+                const byte* in = inFile->getByteArray();
+                const AtomRange* moovRange = nullptr;
+                const AtomRange* ftypRange = nullptr;
+                QtFastStartStats *stats = this->options.stats;
+                for(const AtomRange &r : top){
+                        if(r.type == MOOV_ATOM && !moovRange)
+                                moovRange = &r;
+                        else if(r.type == FTYP_ATOM && !ftypRange)
+                                ftypRange = &r;
+                }
+                if(!moovRange){
+#ifdef DEBUG
+                        std::cerr << "Fragmented file has no moov atom" << std::endl;
+#endif // DEBUG
+                        passThrough(FALLBACK_NO_MOOV);
+                        return;
+                }
+
+                PhaseTimer readTimer(stats, PHASE_MOOV_READ);
+
+                Atom moov = parseMoov(*moovRange);
+                std::vector<uint32_t> droppedIds = dropTracks(moov);
+                applyMoovEdit(moov);
+                std::map<uint32_t, TrackDefaults> defaults = readTrex(moov);
+
+                std::vector<SampleTable> tracks;
+                std::map<uint32_t, uint32_t> byId;
+                for(Atom &trak : moov.children){
+                        if(trak.type != TRAK_ATOM)
+                                continue;
+                        tracks.push_back(SampleTable());
+                        tracks.back().parse(trak);
+                        byId[tracks.back().trackId] = tracks.size() - 1;
+                }
+                //the fragments of dropped tracks are still read, a traf without a
+                //base offset starts where the previous one ended
+                std::map<uint32_t, SampleTable> dropped;
+                for(uint32_t id : droppedIds)
+                        dropped[id].trackId = id;
+
+                //single pass over the moof atoms, only the sample tables are kept
+                for(const AtomRange &r : top){
+                        if(r.type != MOOF_ATOM)
+                                continue;
+                        trackBuffer(r.size);
+                        Atom moof = Atom::parse(&in[r.offset], r.size);
+                        uint64_t next = r.offset;
+                        for(Atom &traf : moof.children){
+                                if(traf.type != TRAF_ATOM)
+                                        continue;
+                                Atom* tfhd = traf.find(TFHD_ATOM);
+                                if(!tfhd)
+                                        throw Malformed_Atom("traf atom is missing tfhd\n");
+                                uint32_t trackId = tfhd->getUint_32(4);
+                                uint64_t base = (tfhd->getUint_32(0) & TFHD_DEFAULT_BASE_IS_MOOF) ? r.offset : next;
+                                std::map<uint32_t, uint32_t>::iterator t = byId.find(trackId);
+                                if(t == byId.end()){
+                                        std::map<uint32_t, SampleTable>::iterator d = dropped.find(trackId);
+                                        if(d == dropped.end())
+                                                throw Malformed_Atom("traf references an unknown track\n");
+                                        next = appendTraf(traf, base, defaults[trackId], d->second, inFile->size());
+                                        d->second.samples.clear();
+                                        d->second.chunks.clear();
+                                        continue;
+                                }
+                                next = appendTraf(traf, base, defaults[t->first], tracks[t->second], inFile->size());
+                        }
+                        if(stats)
+                                stats->bytesRead += r.size;
+                        trackBuffer(-(int64_t)r.size);
+                }
+                if(stats)
+                        stats->bytesRead += moovRange->size;
+                if(this->options.trimStart || this->options.trimLength)
+                        trimTracks(moov, tracks);
+                readTimer.stop();
+
+                //the output mdat holds every chunk, in input order unless it is interleaved
+                PhaseTimer patchTimer(stats, PHASE_PATCH);
+                struct Span{ uint64_t offset; long double start; uint64_t size; uint32_t track; uint32_t chunk; };
+                std::vector<Span> spans;
+                for(uint32_t t = 0; t < tracks.size(); t++){
+                        SampleTable &track = tracks[t];
+                        if(this->options.interleaveDuration)
+                                track.splitChunks(this->options.interleaveDuration);
+                        for(uint32_t c = 0; c < track.chunks.size(); c++){
+                                Chunk &ch = track.chunks[c];
+                                uint64_t size = 0;
+                                for(uint32_t i = ch.firstSample; i < ch.firstSample + ch.sampleCount; i++)
+                                        size += track.samples[i].size;
+                                if(!size)
+                                        continue;
+                                const Sample &first = track.samples[ch.firstSample];
+                                long double start = track.timescale ? (long double)first.decodeTime / track.timescale : 0;
+                                spans.push_back({first.offset, start, size, t, c});
+                        }
+                }
+                if(this->options.interleaveDuration)
+                        std::stable_sort(spans.begin(), spans.end(), [](const Span &a, const Span &b){ return a.start < b.start; });
+                else
+                        std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b){ return a.offset < b.offset; });
+                uint64_t payload = 0;
+                for(const Span &s : spans)
+                        payload += s.size;
+
+                moov.remove(MVEX_ATOM);
+                Atom* mvhd = moov.find(MVHD_ATOM);
+                if(!mvhd)
+                        throw Malformed_Atom("moov atom is missing mvhd\n");
+                uint32_t movieTimescale = mvhd->getUint_32(mvhd->getUint_8(0) == 1 ? 20 : 12);
+
+                uint64_t movieDuration = 0;
+                for(uint32_t t = 0; t < tracks.size(); t++){
+                        SampleTable &track = tracks[t];
+                        if(track.timescale)
+                                movieDuration = std::max(movieDuration, track.duration() * movieTimescale / track.timescale);
+                }
+                if(mvhd->getUint_8(0) == 1)
+                        mvhd->setUint_64(24, movieDuration);
+                else
+                        mvhd->setUint_32(16, movieDuration > UINT32_MAX ? UINT32_MAX : (uint32_t)movieDuration);
+
+                uint64_t ftypSize = ftypRange ? ftypRange->size : 0;
+                uint64_t mdatHeader = payload + 8 > UINT32_MAX ? 16 : 8;
+                uint64_t moovSize = 0;
+                std::unique_ptr<BYTEBUFFER::ByteBuffer> packed;
+                //the moov size depends on the offsets through co64 and compression, so settle it first
+                for(;;){
+                        uint64_t pos = ftypSize + moovSize + mdatHeader;
+                        for(const Span &s : spans){
+                                tracks[s.track].chunks[s.chunk].offset = pos;
+                                pos += s.size;
+                        }
+                        uint32_t t = 0;
+                        for(Atom &trak : moov.children){
+                                if(trak.type != TRAK_ATOM)
+                                        continue;
+                                const SampleTable &track = tracks[t++];
+                                track.build(trak);
+                                track.updateDurations(trak, movieTimescale);
+                                //chunks that ended up back to back are merged in the tables only, and only if that is smaller
+                                if(this->options.rechunk){
+                                        Atom plain = *SampleTable::getStbl(trak);
+                                        SampleTable merged = track;
+                                        merged.mergeChunks();
+                                        merged.build(trak);
+                                        Atom* stbl = SampleTable::getStbl(trak);
+                                        if(stbl->size() >= plain.size())
+                                                *stbl = std::move(plain);
+                                }
+                        }
+                        packed.reset(packMoov(moov, this->options.compressMoov, moovSize));
+                        if(packed->getLimit() == moovSize)
+                                break;
+                        moovSize = packed->getLimit();
+                }
+                trackBuffer(moovSize);
+                if(this->options.index)
+                        this->options.index->addMoov(moov);
+                if(stats)
+                        stats->entriesPatched = spans.size();
+                patchTimer.stop();
+
+                PhaseTimer copyTimer(stats, PHASE_COPY);
+                uint64_t copied = payload;
+                //top-level atoms that do not describe fragments are kept after the media
+                std::vector<const AtomRange*> kept;
+                for(const AtomRange &r : top){
+                        switch(r.type){
+                                case FTYP_ATOM: case MOOV_ATOM: case MOOF_ATOM: case MDAT_ATOM:
+                                case STYP_ATOM: case SIDX_ATOM: case SSIX_ATOM: case MFRA_ATOM:
+                                case PRFT_ATOM: case FREE_ATOM: case SKIP_ATOM: case JUNK_ATOM:
+                                case WIDE_ATOM:
+                                        break;
+                                default:
+                                        kept.push_back(&r);
+                                        copied += r.size;
+                        }
+                }
+
+                throwResult(checkMemory(ftypSize + moovSize + mdatHeader + copied));
+                outFile->reserve(ftypSize + moovSize + mdatHeader + copied);
+                if(ftypRange)
+                        outFile->write(&in[ftypRange->offset], ftypRange->size);
+                packed->rewind();
+                outFile->write(packed.get());
+                packed.reset();
+                trackBuffer(-(int64_t)moovSize);
+
+                BYTEBUFFER::ByteBuffer header(mdatHeader, BYTEBUFFER::B_ENDIAN);
+                if(mdatHeader == 16){
+                        header.putUint_32(1);
+                        header.putUint_32(htobe32(MDAT_ATOM));
+                        header.putUint_64(payload + 16);
+                }
+                else{
+                        header.putUint_32(payload + 8);
+                        header.putUint_32(htobe32(MDAT_ATOM));
+                }
+                outFile->write(&header);
+
+                this->progress.begin(PHASE_COPY, copied);
+                //samples that are adjacent in the input are copied as one range, also across chunks
+                uint64_t start = 0, end = 0;
+                for(const Span &s : spans){
+                        const SampleTable &track = tracks[s.track];
+                        const Chunk &ch = track.chunks[s.chunk];
+                        for(uint32_t i = ch.firstSample; i < ch.firstSample + ch.sampleCount; i++){
+                                const Sample &sample = track.samples[i];
+                                if(sample.offset != end){
+                                        if(end != start)
+                                                this->progress.transfer(inFile, start, end - start, outFile);
+                                        start = sample.offset;
+                                        end = start;
+                                }
+                                end += sample.size;
+                        }
+                }
+                this->progress.transfer(inFile, start, end - start, outFile);
+
+                for(const AtomRange* r : kept)
+                        this->progress.transfer(inFile, r->offset, r->size, outFile);
+
+                if(stats)
+                        stats->bytesCopied = copied;
+                this->data = outFile->getByteArray();
+                this->data_len = outFile->size();
+        }
@@ -0,0 +1,412 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Fragment.cpp
+* Procedures:
+* QtFastStartSTD::QtFastStart::fragmentImpl     -converts a progressive mp4 into a fragmented mp4
+* buildInitMoov -turns a progressive moov into the moov of an init segment
+* fragmentBoundaries    -picks the decode times at which new fragments start
+* buildTraf     -builds the traf atom describing a run of samples of one track
+* copyRuns      -copies samples into the output, merging samples that are adjacent in the input
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+
+#include <memory>
+#include "QtFastStartCPP.hpp"
+#include "SampleTable.hpp"
+#include "Endian.hpp"
+
+#define SAMPLE_FLAGS_SYNC       0x02000000
+#define SAMPLE_FLAGS_NON_SYNC   0x01010000
+
+#define TFHD_DESCRIPTION_INDEX_PRESENT  0x000002
+#define TFHD_DEFAULT_BASE_IS_MOOF       0x020000
+
+#define TRUN_DATA_OFFSET_PRESENT        0x000001
+#define TRUN_SAMPLE_DURATION_PRESENT    0x000100
+#define TRUN_SAMPLE_SIZE_PRESENT        0x000200
+#define TRUN_SAMPLE_FLAGS_PRESENT       0x000400
+#define TRUN_SAMPLE_CTO_PRESENT         0x000800
+
+
+namespace{
+
+        using QtFastStartSTD::Atom;
+        using QtFastStartSTD::Sample;
+        using QtFastStartSTD::SampleTable;
+
+/***************************************************************************
+* void buildInitMoov(Atom &moov, std::vector<SampleTable> &tracks)
+* Description: turns a progressive moov into the moov of an init segment.
+*               The sample tables are emptied and a mvex atom is appended
+*
+* Parameters:
+*        moov   I/O     Atom&   moov atom to rewrite
+*        tracks I/P     std::vector<SampleTable>&       sample tables of each trak, in order
+**************************************************************************/
+        void buildInitMoov(Atom &moov, std::vector<SampleTable> &tracks)
+        {
+                const uint32_t perSample[] = {SDTP_ATOM, STPS_ATOM, SBGP_ATOM, SUBS_ATOM, SAIZ_ATOM, SAIO_ATOM};
+                SampleTable empty;
+
+                for(Atom &trak : moov.children){
+                        if(trak.type != TRAK_ATOM)
+                                continue;
+                        empty.build(trak);
+                        Atom* stbl = SampleTable::getStbl(trak);
+                        for(uint32_t type : perSample)
+                                stbl->remove(type);
+                }
+
+                Atom* mvhd = moov.find(MVHD_ATOM);
+                if(!mvhd)
+                        throw QtFastStartSTD::Malformed_Atom("moov atom is missing mvhd\n");
+                uint64_t duration = mvhd->getUint_8(0) == 1 ? mvhd->getUint_64(24) : mvhd->getUint_32(16);
+
+                Atom mvex(MVEX_ATOM, true);
+                Atom mehd(MEHD_ATOM);
+                mehd.putUint_32(0x01000000);
+                mehd.putUint_64(duration);
+                mvex.children.push_back(std::move(mehd));
+                for(const SampleTable &track : tracks){
+                        Atom trex(TREX_ATOM);
+                        trex.putUint_32(0);
+                        trex.putUint_32(track.trackId);
+                        trex.putUint_32(1);     //default sample description index
+                        trex.putUint_32(0);
+                        trex.putUint_32(0);
+                        trex.putUint_32(0);
+                        mvex.children.push_back(std::move(trex));
+                }
+                moov.remove(MVEX_ATOM);
+                moov.children.push_back(std::move(mvex));
+        }
+
+/***************************************************************************
+* std::vector<long double> fragmentBoundaries(const SampleTable &ref, uint32_t duration)
+* Description: picks the decode times, in seconds, at which new fragments
+*               start. A fragment is cut at the first sync sample of the
+*               reference track after the fragment duration has passed
+*
+* Parameters:
+*        ref    I/P     const SampleTable&      track the fragments are aligned to
+*        duration       I/P     uint32_t        minimum fragment duration in milliseconds
+*        fragmentBoundaries     O/P     std::vector<long double>        start times of every fragment but the first
+**************************************************************************/
+        std::vector<long double> fragmentBoundaries(const SampleTable &ref, uint32_t duration)
+        {
+                std::vector<long double> ret;
+                if(ref.samples.empty() || ref.timescale == 0)
+                        return ret;
+
+                uint64_t start = ref.samples[0].decodeTime;
+                uint64_t minimum = (uint64_t)duration * ref.timescale / 1000;
+                for(const Sample &s : ref.samples){
+                        if(s.sync && s.decodeTime - start >= minimum && s.decodeTime != start){
+                                ret.push_back((long double)s.decodeTime / ref.timescale);
+                                start = s.decodeTime;
+                        }
+                }
+                return ret;
+        }
+
+/***************************************************************************
+* Atom buildTraf(const SampleTable &track, uint32_t first, uint32_t last)
+* Description: builds the traf atom describing a run of samples of one track.
+*               The data offset of the trun is left at 0 for the caller to fill
+*
+* Parameters:
+*        track  I/P     const SampleTable&      track the samples belong to
+*        first  I/P     uint32_t        index of the first sample
+*        last   I/P     uint32_t        index one past the last sample
+*        buildTraf      O/P     Atom    the traf atom
+**************************************************************************/
+        Atom buildTraf(const SampleTable &track, uint32_t first, uint32_t last)
+        {
+                Atom traf(TRAF_ATOM, true);
+                uint32_t desc = track.samples[first].descriptionIndex;
+
+                Atom tfhd(TFHD_ATOM);
+                tfhd.putUint_32(TFHD_DEFAULT_BASE_IS_MOOF | (desc != 1 ? TFHD_DESCRIPTION_INDEX_PRESENT : 0));
+                tfhd.putUint_32(track.trackId);
+                if(desc != 1)
+                        tfhd.putUint_32(desc);
+                traf.children.push_back(std::move(tfhd));
+
+                Atom tfdt(TFDT_ATOM);
+                tfdt.putUint_32(0x01000000);
+                tfdt.putUint_64(track.samples[first].decodeTime);
+                traf.children.push_back(std::move(tfdt));
+
+                bool negative = false;
+                for(uint32_t i = first; i < last; i++)
+                        negative |= track.samples[i].compositionOffset < 0;
+
+                uint32_t flags = TRUN_DATA_OFFSET_PRESENT | TRUN_SAMPLE_DURATION_PRESENT
+                                | TRUN_SAMPLE_SIZE_PRESENT | TRUN_SAMPLE_FLAGS_PRESENT;
+                if(track.hasCompositionOffsets)
+                        flags |= TRUN_SAMPLE_CTO_PRESENT;
+
+                Atom trun(TRUN_ATOM);
+                trun.data.reserve(12 + (uint64_t)(last - first) * 16);
+                trun.putUint_32((negative ? 0x01000000 : 0) | flags);
+                trun.putUint_32(last - first);
+                trun.putUint_32(0);
+                for(uint32_t i = first; i < last; i++){
+                        const Sample &s = track.samples[i];
+                        trun.putUint_32(s.duration);
+                        trun.putUint_32(s.size);
+                        trun.putUint_32(s.sync ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC);
+                        if(track.hasCompositionOffsets)
+                                trun.putUint_32((uint32_t)s.compositionOffset);
+                }
+                traf.children.push_back(std::move(trun));
+                return traf;
+        }
+
+/***************************************************************************
+* uint64_t copyRuns(QtFastStartSTD::ArtificialFileStream *in, QtFastStartSTD::ArtificialFileStream *out, const SampleTable &track, uint32_t first, uint32_t last, QtFastStartSTD::Progress *progress)
+* Description: copies samples into the output. Samples that are adjacent in
+*               the input are copied as a single byte range
+*
+* Parameters:
+*        in     I/P     QtFastStartSTD::ArtificialFileStream*   input file
+*        out    I/O     QtFastStartSTD::ArtificialFileStream*   output file
+*        track  I/P     const SampleTable&      track the samples belong to
+*        first  I/P     uint32_t        index of the first sample
+*        last   I/P     uint32_t        index one past the last sample
+*        progress       I/O     QtFastStartSTD::Progress*       progress of the copy
+*        copyRuns       O/P     uint64_t        number of bytes copied
+**************************************************************************/
+        uint64_t copyRuns(QtFastStartSTD::ArtificialFileStream *in, QtFastStartSTD::ArtificialFileStream *out,
+                        const SampleTable &track, uint32_t first, uint32_t last, QtFastStartSTD::Progress *progress)
+        {
+                uint64_t total = 0;
+                uint32_t i = first;
+                while(i < last){
+                        uint64_t start = track.samples[i].offset;
+                        uint64_t end = start + track.samples[i].size;
+                        for(i++; i < last && track.samples[i].offset == end; i++)
+                                end += track.samples[i].size;
+                        if(end > in->size())
+                                throw QtFastStartSTD::Malformed_Atom("Sample lies outside of the file\n");
+                        total += progress->transfer(in, start, end - start, out);
+                }
+                return total;
+        }
+
+}
+
+
+/***************************************************************************
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::fragmentImpl(void)
+* Description: converts a progressive mp4 into a fragmented mp4. Writes the
+*               ftyp and an init moov with mvex, followed by one moof/mdat
+*               pair per fragment. The init moov is compressed with
+*               compressMoov. Its sample tables are empty and no padding is
+*               written, which is what compactMoov and stripPadding ask for
+*
+* Parameters:
+*        fragmentImpl   O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, or why the input was not converted.
+*                                               Malformed atoms found past the scan are thrown
+**************************************************************************/
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::fragmentImpl(void)
+        {
+                const byte* in = inFile->getByteArray();
+                std::vector<AtomRange> top;
+                const AtomRange* moovRange = nullptr;
+                const AtomRange* ftypRange = nullptr;
+                QtFastStartStats *stats = this->options.stats;
+
+                PhaseTimer scanTimer(stats, PHASE_SCAN);
+                QtFastStartResult scanned = scanTopLevel(top);
+                if(scanned.status == STATUS_BAD_ATOM_SIZE){
+#ifdef DEBUG
+                        std::cerr << "Failed to scan top-level atoms" << std::endl;
+#endif // DEBUG
+                        passThrough(FALLBACK_BAD_ATOM_SIZES);
+                        return QtFastStartResult();
+                }
+                if(!scanned.ok())
+                        return scanned;
+                for(const AtomRange &r : top){
+                        if(r.type == MOOV_ATOM && !moovRange)
+                                moovRange = &r;
+                        else if(r.type == FTYP_ATOM && !ftypRange)
+                                ftypRange = &r;
+                        else if(r.type == MOOF_ATOM){
+                                //already fragmented
+                                passThrough(FALLBACK_ALREADY_FRAGMENTED);
+                                return QtFastStartResult();
+                        }
+                }
+                if(!moovRange){
+                        passThrough(FALLBACK_NO_MOOV);
+                        return QtFastStartResult();
+                }
+                scanTimer.stop();
+
+                PhaseTimer readTimer(stats, PHASE_MOOV_READ);
+
+                Atom moov = parseMoov(*moovRange);
+                if(moov.find(MVEX_ATOM)){
+                        passThrough(FALLBACK_ALREADY_FRAGMENTED);
+                        return QtFastStartResult();
+                }
+                dropTracks(moov);
+                applyMoovEdit(moov);
+
+                std::vector<SampleTable> tracks;
+                for(Atom &trak : moov.children){
+                        if(trak.type != TRAK_ATOM)
+                                continue;
+                        tracks.push_back(SampleTable());
+                        tracks.back().parse(trak);
+                        //fragments are cut by decode time in seconds
+                        if(tracks.back().timescale == 0)
+                                throw Malformed_Atom("mdhd timescale is 0\n");
+                }
+                if(this->options.trimStart || this->options.trimLength)
+                        trimTracks(moov, tracks);
+                if(stats)
+                        stats->bytesRead = moovRange->size;
+                readTimer.stop();
+
+                //fragments follow the sync samples of the first video track
+                PhaseTimer patchTimer(stats, PHASE_PATCH);
+                const SampleTable* ref = nullptr;
+                for(const SampleTable &t : tracks){
+                        if(t.handler == VIDE_HANDLER && !t.samples.empty()){
+                                ref = &t;
+                                break;
+                        }
+                }
+                for(uint32_t i = 0; !ref && i < tracks.size(); i++){
+                        if(!tracks[i].samples.empty())
+                                ref = &tracks[i];
+                }
+                std::vector<long double> boundaries;
+                if(ref)
+                        boundaries = fragmentBoundaries(*ref, this->options.fragmentDuration);
+
+                buildInitMoov(moov, tracks);
+                std::unique_ptr<BYTEBUFFER::ByteBuffer> packed(packMoov(moov, this->options.compressMoov, 0));
+                uint64_t moovSize = packed->getLimit();
+                trackBuffer(moovSize);
+                patchTimer.stop();
+
+                PhaseTimer copyTimer(stats, PHASE_COPY);
+
+                QtFastStartResult memory = checkMemory(inFile->size() + inFile->size() / 16);
+                if(!memory.ok())
+                        return memory;
+                outFile->reserve(inFile->size() + inFile->size() / 16);
+                if(ftypRange)
+                        outFile->write(&in[ftypRange->offset], ftypRange->size);
+                packed->rewind();
+                outFile->write(packed.get());
+                packed.reset();
+                trackBuffer(-(int64_t)moovSize);
+
+                uint64_t media = 0;
+                for(const SampleTable &t : tracks)
+                        for(const Sample &sample : t.samples)
+                                media += sample.size;
+                this->progress.begin(PHASE_COPY, media);
+
+                std::vector<uint32_t> cursor(tracks.size(), 0);
+                uint32_t sequence = 1;
+                for(uint32_t f = 0; f <= boundaries.size(); f++){
+                        struct Run{ uint32_t track; uint32_t first; uint32_t last; uint64_t bytes; };
+                        std::vector<Run> runs;
+
+                        for(uint32_t t = 0; t < tracks.size(); t++){
+                                const SampleTable &track = tracks[t];
+                                uint32_t end = cursor[t];
+                                while(end < track.samples.size()
+                                        && (f == boundaries.size()
+                                        || (long double)track.samples[end].decodeTime / track.timescale < boundaries[f]))
+                                        end++;
+
+                                //a traf can only reference one sample description
+                                for(uint32_t i = cursor[t]; i < end; ){
+                                        Run r = {t, i, i, 0};
+                                        while(r.last < end && track.samples[r.last].descriptionIndex == track.samples[i].descriptionIndex){
+                                                r.bytes += track.samples[r.last].size;
+                                                r.last++;
+                                        }
+                                        runs.push_back(r);
+                                        i = r.last;
+                                }
+                                cursor[t] = end;
+                        }
+                        if(runs.empty())
+                                continue;
+
+                        Atom moof(MOOF_ATOM, true);
+                        Atom mfhd(MFHD_ATOM);
+                        mfhd.putUint_32(0);
+                        mfhd.putUint_32(sequence++);
+                        moof.children.push_back(std::move(mfhd));
+
+                        uint64_t payload = 0;
+                        for(const Run &r : runs){
+                                moof.children.push_back(buildTraf(tracks[r.track], r.first, r.last));
+                                payload += r.bytes;
+                        }
+
+                        uint64_t mdatHeader = payload + 8 > UINT32_MAX ? 16 : 8;
+                        uint64_t dataOffset = moof.size() + mdatHeader;
+                        for(uint32_t i = 0; i < runs.size(); i++){
+                                if(dataOffset > INT32_MAX)
+                                        throw Bad_Atom_Size();
+                                moof.children[i + 1].find(TRUN_ATOM)->setUint_32(8, (uint32_t)dataOffset);
+                                dataOffset += runs[i].bytes;
+                        }
+                        moof.write(outFile);
+
+                        BYTEBUFFER::ByteBuffer header(mdatHeader, BYTEBUFFER::B_ENDIAN);
+                        if(mdatHeader == 16){
+                                header.putUint_32(1);
+                                header.putUint_32(htobe32(MDAT_ATOM));
+                                header.putUint_64(payload + 16);
+                        }
+                        else{
+                                header.putUint_32(payload + 8);
+                                header.putUint_32(htobe32(MDAT_ATOM));
+                        }
+                        outFile->write(&header);
+
+                        for(const Run &r : runs)
+                                copyRuns(inFile, outFile, tracks[r.track], r.first, r.last, &this->progress);
+                        if(stats){
+                                stats->bytesCopied += payload;
+                                stats->entriesPatched += runs.size();
+                        }
+#ifdef DEBUG
+                        std::cout << "wrote fragment " << sequence - 1 << " with " << payload << " bytes" << std::endl;
+#endif // DEBUG
+                }
+
+                this->data = outFile->getByteArray();
+                this->data_len = outFile->size();
+                return QtFastStartResult();
+        }
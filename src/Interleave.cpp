@@ -0,0 +1,331 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Interleave.cpp
+* Procedures:
+* QtFastStartSTD::QtFastStart::interleaveImpl   -rewrites the media data so the chunks of all tracks alternate in decode order
+* collectMeta   -gathers the meta atoms of an atom tree
+* patchMeta     -rewrites the file offsets held by a meta atom of the moov
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+
+#include <algorithm>
+#include <memory>
+#include "QtFastStartCPP.hpp"
+#include "SampleTable.hpp"
+#include "Endian.hpp"
+
+
+namespace{
+
+        using QtFastStartSTD::Atom;
+        using QtFastStartSTD::Chunk;
+        using QtFastStartSTD::SampleTable;
+
+/***************************************************************************
+* void collectMeta(Atom &atom, std::vector<Atom*> &out)
+* Description: gathers the meta atoms found in an atom tree, descending only
+*               into containers like patchChunkOffsets does
+*
+* Parameters:
+*        atom   I/P     Atom&   atom whose children are searched
+*        out    I/O     std::vector<Atom*>&     meta atoms found, appended to
+**************************************************************************/
+        void collectMeta(Atom &atom, std::vector<Atom*> &out)
+        {
+                for(Atom &child : atom.children){
+                        if(child.type == META_ATOM)
+                                out.push_back(&child);
+                        else if(child.container)
+                                collectMeta(child, out);
+                }
+        }
+
+/***************************************************************************
+* void patchMeta(Atom &meta, const std::vector<byte> &original, const QtFastStartSTD::OffsetMap &copies)
+* Description: restores the payload of a meta atom from its input bytes and
+*               rewrites the file offsets it holds. Patching leaves the size as
+*               it is, so the moov does not have to settle again
+*
+* Parameters:
+*        meta   I/O     Atom&   meta atom to patch
+*        original       I/P     const std::vector<byte>&        payload of the meta in the input
+*        copies I/P     const QtFastStartSTD::OffsetMap&        input to output offset mapping of the copy
+**************************************************************************/
+        void patchMeta(Atom &meta, const std::vector<byte> &original, const QtFastStartSTD::OffsetMap &copies)
+        {
+                meta.data = original;
+                std::vector<byte> plain;
+                meta.serialize(plain);
+                BYTEBUFFER::ByteBuffer buffer(plain.size(), BYTEBUFFER::B_ENDIAN);
+                buffer.put(plain.data(), plain.size());
+                QtFastStartSTD::throwResult(QtFastStartSTD::patchChunkOffsets(&buffer, 0, plain.size(), copies));
+                memcpy(meta.data.data(), buffer.getData() + plain.size() - original.size(), original.size());
+        }
+
+}
+
+
+/***************************************************************************
+* bool QtFastStartSTD::QtFastStart::interleaveImpl(const std::vector<QtFastStartSTD::AtomRange> &top, const QtFastStartSTD::AtomRange *moovRange, const QtFastStartSTD::AtomRange *ftypRange)
+* Description: rewrites the media data so the chunks of all tracks alternate
+*               in decode order, every chunk spanning at most the interleave
+*               duration. Writes the ftyp, the moov and one mdat whose chunks
+*               are streamed from the input in the planned order, followed
+*               by the other top-level atoms that do not hold media. The
+*               offsets held by meta and mfra atoms are patched, and throw
+*               if they point at media that is left out. Only the sample
+*               tables are kept in memory. Without an interleave duration the
+*               chunks keep their input grouping and order, and only those of
+*               dropped tracks and outside of the trim range are left out
+*
+* Parameters:
+*        top    I/P     const std::vector<QtFastStartSTD::AtomRange>&   top-level atoms of the input
+*        moovRange      I/P     const QtFastStartSTD::AtomRange*        the moov atom
+*        ftypRange      I/P     const QtFastStartSTD::AtomRange*        the ftyp atom, or nullptr
+*        interleaveImpl O/P     bool    false if the tracks can not be interleaved, nothing is written then
+**************************************************************************/
+        bool QtFastStartSTD::QtFastStart::interleaveImpl(const std::vector<QtFastStartSTD::AtomRange> &top,
+                                const QtFastStartSTD::AtomRange *moovRange, const QtFastStartSTD::AtomRange *ftypRange)
+        {
+                const byte* in = inFile->getByteArray();
+                QtFastStartStats *stats = this->options.stats;
+
+                bool trimming = this->options.trimStart || this->options.trimLength;
+
+                PhaseTimer readTimer(stats, PHASE_MOOV_READ);
+                Atom moov = parseMoov(*moovRange);
+                if(!moov.find(TRAK_ATOM))
+                        return false;
+                dropTracks(moov);
+
+                for(Atom* trak : moov.findAll(TRAK_ATOM)){
+                        //auxiliary sample data is addressed by file offset and would be left behind
+                        Atom* stbl = SampleTable::getStbl(*trak);
+                        if(stbl && stbl->find(SAIO_ATOM)){
+#ifdef DEBUG
+                                std::cerr << "saio atom present, not interleaving" << std::endl;
+#endif // DEBUG
+                                return false;
+                        }
+                }
+
+                //edited only once the fast-start fallback is ruled out, so the callback runs once
+                applyMoovEdit(moov);
+                std::vector<SampleTable> tracks;
+                for(Atom &trak : moov.children){
+                        if(trak.type != TRAK_ATOM)
+                                continue;
+                        tracks.push_back(SampleTable());
+                        tracks.back().parse(trak);
+                }
+                if(trimming)
+                        trimTracks(moov, tracks);
+                if(stats)
+                        stats->bytesRead = moovRange->size;
+                readTimer.stop();
+
+                //plan the output order of the new chunks by their first decode time
+                PhaseTimer patchTimer(stats, PHASE_PATCH);
+                struct Span{ long double start; uint32_t track; uint32_t chunk; uint64_t size; };
+                std::vector<Span> plan;
+                uint64_t payload = 0;
+                for(uint32_t t = 0; t < tracks.size(); t++){
+                        SampleTable &track = tracks[t];
+                        if(this->options.interleaveDuration)
+                                track.splitChunks(this->options.interleaveDuration);
+                        //empty chunks hold no media, the rebuilt stsc simply leaves them out
+                        track.chunks.erase(std::remove_if(track.chunks.begin(), track.chunks.end(),
+                                        [](const Chunk &ch){ return ch.sampleCount == 0; }), track.chunks.end());
+                        for(uint32_t c = 0; c < track.chunks.size(); c++){
+                                const Chunk &ch = track.chunks[c];
+                                uint64_t size = 0;
+                                for(uint32_t i = ch.firstSample; i < ch.firstSample + ch.sampleCount; i++){
+                                        const Sample &s = track.samples[i];
+                                        if(s.offset + s.size > inFile->size())
+                                                throw Malformed_Atom("Sample lies outside of the file\n");
+                                        size += s.size;
+                                }
+                                long double start = track.timescale ? (long double)track.samples[ch.firstSample].decodeTime / track.timescale : 0;
+                                plan.push_back({start, t, c, size});
+                                payload += size;
+                        }
+                }
+                if(this->options.interleaveDuration)
+                        std::stable_sort(plan.begin(), plan.end(), [](const Span &a, const Span &b){ return a.start < b.start; });
+                else
+                        std::stable_sort(plan.begin(), plan.end(), [&tracks](const Span &a, const Span &b){
+                                return tracks[a.track].chunks[a.chunk].offset < tracks[b.track].chunks[b.chunk].offset; });
+
+                uint64_t ftypSize = ftypRange ? ftypRange->size : 0;
+                uint64_t mdatHeader = payload + 8 > UINT32_MAX ? 16 : 8;
+                uint64_t copied = payload;
+                std::vector<const AtomRange*> kept;
+                for(const AtomRange &r : top){
+                        switch(r.type){
+                                case FTYP_ATOM: case MOOV_ATOM: case MDAT_ATOM:
+                                        continue;
+                                case FREE_ATOM: case SKIP_ATOM: case WIDE_ATOM: case JUNK_ATOM:
+                                        if(this->options.stripPadding)
+                                                continue;
+                        }
+                        kept.push_back(&r);
+                        copied += r.size;
+                }
+
+                /* iloc atoms of a meta hold file offsets as well. The meta atoms
+                 * of the moov are patched on every pass from their input bytes,
+                 * against the output the copy below produces */
+                std::vector<Atom*> metas;
+                collectMeta(moov, metas);
+                std::vector<std::vector<byte>> metaData;
+                for(const Atom* meta : metas)
+                        metaData.push_back(meta->data);
+
+                uint64_t moovOutSize = 0;
+                std::unique_ptr<BYTEBUFFER::ByteBuffer> packed;
+                OffsetMap copies;
+                //the moov size depends on the offsets through co64 and compression, so settle it first
+                for(;;){
+                        uint64_t pos = ftypSize + moovOutSize + mdatHeader;
+                        copies = OffsetMap();
+                        for(const Span &s : plan){
+                                SampleTable &track = tracks[s.track];
+                                Chunk &ch = track.chunks[s.chunk];
+                                ch.offset = pos;
+                                //samples that were adjacent in the input are copied as one range
+                                for(uint32_t i = ch.firstSample; i < ch.firstSample + ch.sampleCount; ){
+                                        uint64_t start = track.samples[i].offset;
+                                        uint64_t end = start + track.samples[i].size;
+                                        for(i++; i < ch.firstSample + ch.sampleCount && track.samples[i].offset == end; i++)
+                                                end += track.samples[i].size;
+                                        copies.add(start, end - start, pos);
+                                        pos += end - start;
+                                }
+                        }
+                        for(const AtomRange* r : kept){
+                                copies.add(r->offset, r->size, pos);
+                                pos += r->size;
+                        }
+                        for(uint32_t m = 0; m < metas.size(); m++)
+                                patchMeta(*metas[m], metaData[m], copies);
+                        uint32_t t = 0;
+                        for(Atom &trak : moov.children){
+                                if(trak.type != TRAK_ATOM)
+                                        continue;
+                                const SampleTable &track = tracks[t++];
+                                track.build(trak);
+                                //chunks the plan put back to back are merged in the tables only, and only if that is smaller
+                                if(this->options.rechunk){
+                                        Atom plain = *SampleTable::getStbl(trak);
+                                        SampleTable merged = track;
+                                        merged.mergeChunks();
+                                        merged.build(trak);
+                                        Atom* stbl = SampleTable::getStbl(trak);
+                                        if(stbl->size() >= plain.size())
+                                                *stbl = std::move(plain);
+                                }
+                        }
+                        packed.reset(QtFastStartSTD::packMoov(moov, this->options.compressMoov, moovOutSize));
+                        if(packed->getLimit() == moovOutSize)
+                                break;
+                        moovOutSize = packed->getLimit();
+                }
+                trackBuffer(moovOutSize);
+                if(this->options.index)
+                        this->options.index->addMoov(moov);
+
+                //a top-level meta or mfra is patched once, the conversion is refused if it points at data left behind
+                std::vector<std::unique_ptr<BYTEBUFFER::ByteBuffer>> patchedAtoms(kept.size());
+                for(uint32_t k = 0; k < kept.size(); k++){
+                        const AtomRange* r = kept[k];
+                        if(r->type != META_ATOM && r->type != MFRA_ATOM)
+                                continue;
+                        trackBuffer(r->size);
+                        patchedAtoms[k].reset(new BYTEBUFFER::ByteBuffer(r->size, BYTEBUFFER::B_ENDIAN));
+                        readAndFill(inFile, patchedAtoms[k].get(), r->offset);
+                        QtFastStartResult res = patchChunkOffsets(patchedAtoms[k].get(), 0, r->size, copies);
+                        if(!res.ok()){
+                                res.offset += r->offset;
+                                throwResult(res);
+                        }
+                }
+                if(stats)
+                        stats->entriesPatched = plan.size();
+                patchTimer.stop();
+
+                PhaseTimer copyTimer(stats, PHASE_COPY);
+                throwResult(checkMemory(ftypSize + moovOutSize + copied + mdatHeader));
+                outFile->reserve(ftypSize + moovOutSize + copied + mdatHeader);
+                if(ftypRange)
+                        outFile->write(&in[ftypRange->offset], ftypRange->size);
+                packed->rewind();
+                outFile->write(packed.get());
+                packed.reset();
+                trackBuffer(-(int64_t)moovOutSize);
+
+                BYTEBUFFER::ByteBuffer header(mdatHeader, BYTEBUFFER::B_ENDIAN);
+                if(mdatHeader == 16){
+                        header.putUint_32(1);
+                        header.putUint_32(htobe32(MDAT_ATOM));
+                        header.putUint_64(payload + 16);
+                }
+                else{
+                        header.putUint_32(payload + 8);
+                        header.putUint_32(htobe32(MDAT_ATOM));
+                }
+                outFile->write(&header);
+
+                this->progress.begin(PHASE_COPY, copied);
+                for(const Span &s : plan){
+                        const SampleTable &track = tracks[s.track];
+                        const Chunk &ch = track.chunks[s.chunk];
+                        //samples that were adjacent in the input are copied as one range
+                        for(uint32_t i = ch.firstSample; i < ch.firstSample + ch.sampleCount; ){
+                                uint64_t start = track.samples[i].offset;
+                                uint64_t end = start + track.samples[i].size;
+                                for(i++; i < ch.firstSample + ch.sampleCount && track.samples[i].offset == end; i++)
+                                        end += track.samples[i].size;
+                                this->progress.transfer(inFile, start, end - start, outFile);
+                        }
+                }
+                for(uint32_t k = 0; k < kept.size(); k++){
+                        const AtomRange* r = kept[k];
+                        if(!patchedAtoms[k]){
+                                this->progress.transfer(inFile, r->offset, r->size, outFile);
+                                continue;
+                        }
+                        patchedAtoms[k]->rewind();
+                        outFile->write(patchedAtoms[k].get());
+                        this->progress.update(outFile->size() - ftypSize - moovOutSize - mdatHeader);
+                        patchedAtoms[k].reset();
+                        trackBuffer(-(int64_t)r->size);
+                }
+
+#ifdef DEBUG
+                std::cout << "interleaved " << plan.size() << " chunks of " << tracks.size() << " tracks" << std::endl;
+#endif // DEBUG
+                if(stats)
+                        stats->bytesCopied = copied;
+                this->data = outFile->getByteArray();
+                this->data_len = outFile->size();
+                return true;
+        }
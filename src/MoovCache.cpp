@@ -0,0 +1,303 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  MoovCache.cpp
+* Procedures:
+* QtFastStartSTD::MoovCache::MoovCache  -Constructor, takes the cache directory and its size limit
+* QtFastStartSTD::MoovCache::makeKey    -fingerprints the input of a conversion
+* QtFastStartSTD::MoovCache::path       -returns the file name of an entry
+* QtFastStartSTD::MoovCache::load       -reads the entry of a key, if there is a valid one
+* QtFastStartSTD::MoovCache::store      -writes the entry of a key
+* QtFastStartSTD::MoovCache::evict      -removes the least recently used entries until the cache fits its limit
+* fnv   -continues a 64 bit FNV-1a hash over a byte range
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <zlib.h>
+#include "MoovCache.hpp"
+#include "Cursor.hpp"
+
+#define FNV_OFFSET_BASIS        0xcbf29ce484222325ULL
+#define FNV_PRIME               0x100000001b3ULL
+
+//magic, version, key, moov length and region count
+#define ENTRY_HEADER_SIZE       52
+#define REGION_SIZE             24
+#define ENTRY_CRC_SIZE          4
+
+#define ENTRY_SUFFIX            ".qtmc"
+#define TEMP_PREFIX             ".tmp-"
+
+
+namespace{
+
+/***************************************************************************
+* uint64_t fnv(uint64_t hash, const byte* data, uint64_t len)
+* Description: continues a 64 bit FNV-1a hash over a byte range
+*
+* Parameters:
+*        hash   I/P     uint64_t        hash so far, FNV_OFFSET_BASIS to start one
+*        data   I/P     const byte*     bytes to hash
+*        len    I/P     uint64_t        number of bytes
+*        fnv    O/P     uint64_t        the continued hash
+**************************************************************************/
+        uint64_t fnv(uint64_t hash, const byte* data, uint64_t len)
+        {
+                for(uint64_t i = 0; i < len; i++){
+                        hash ^= data[i];
+                        hash *= FNV_PRIME;
+                }
+                return hash;
+        }
+
+}
+
+
+/***************************************************************************
+* QtFastStartSTD::MoovCache::MoovCache(const std::string &directory, uint64_t maxBytes)
+* Description: Constructor, takes the cache directory and its size limit. The
+*               directory has to exist
+*
+* Parameters:
+*        directory      I/P     const std::string&      directory holding the entries
+*        maxBytes       I/P     uint64_t        size the entries are evicted down to
+**************************************************************************/
+        QtFastStartSTD::MoovCache::MoovCache(const std::string &directory, uint64_t maxBytes)
+        {
+                this->directory = directory;
+                this->maxBytes = maxBytes;
+        }
+
+/***************************************************************************
+* QtFastStartSTD::MoovCacheKey QtFastStartSTD::MoovCache::makeKey(const byte* in, uint64_t len, const std::vector<QtFastStartSTD::AtomRange> &top, const QtFastStartSTD::AtomRange &moov, uint32_t flags)
+* Description: fingerprints the input of a conversion: its size, the offset
+*               and a hash of the moov, and a hash of the top-level atoms
+*               together with the options that change the output layout
+*
+* Parameters:
+*        in     I/P     const byte*     input file
+*        len    I/P     uint64_t        its size
+*        top    I/P     const std::vector<QtFastStartSTD::AtomRange>&   its top-level atoms
+*        moov   I/P     const QtFastStartSTD::AtomRange&        its moov atom
+*        flags  I/P     uint32_t        options of the conversion that change the output
+*        makeKey        O/P     QtFastStartSTD::MoovCacheKey    the key
+**************************************************************************/
+        QtFastStartSTD::MoovCacheKey QtFastStartSTD::MoovCache::makeKey(const byte* in, uint64_t len,
+                                const std::vector<QtFastStartSTD::AtomRange> &top, const QtFastStartSTD::AtomRange &moov, uint32_t flags)
+        {
+                MoovCacheKey key;
+                key.fileSize = len;
+                key.moovOffset = moov.offset;
+                key.moovHash = fnv(FNV_OFFSET_BASIS, &in[moov.offset], moov.size);
+
+                uint64_t layout = fnv(FNV_OFFSET_BASIS, (const byte*)&flags, sizeof(flags));
+                for(const AtomRange &r : top){
+                        uint64_t fields[3] = {r.type, r.offset, r.size};
+                        layout = fnv(layout, (const byte*)fields, sizeof(fields));
+                }
+                key.layoutHash = layout;
+                return key;
+        }
+
+/***************************************************************************
+* std::string QtFastStartSTD::MoovCache::path(const QtFastStartSTD::MoovCacheKey &key) const
+* Description: returns the file name of an entry, made of the key in hex
+*
+* Parameters:
+*        key    I/P     const QtFastStartSTD::MoovCacheKey&     key of the entry
+*        path   O/P     std::string     path of the entry file
+**************************************************************************/
+        std::string QtFastStartSTD::MoovCache::path(const QtFastStartSTD::MoovCacheKey &key) const
+        {
+                char name[80];
+                snprintf(name, sizeof(name), "/%016llx%016llx%016llx%016llx" ENTRY_SUFFIX,
+                        (unsigned long long)key.moovHash, (unsigned long long)key.layoutHash,
+                        (unsigned long long)key.fileSize, (unsigned long long)key.moovOffset);
+                return this->directory + name;
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::MoovCache::load(const QtFastStartSTD::MoovCacheKey &key, QtFastStartSTD::MoovCacheEntry *entry) const
+* Description: reads the entry of a key. The entry has to carry the same key
+*               and a matching checksum, and its regions have to lie inside
+*               the input. A hit marks the entry as recently used
+*
+* Parameters:
+*        key    I/P     const QtFastStartSTD::MoovCacheKey&     key to look up
+*        entry  O/P     QtFastStartSTD::MoovCacheEntry* the cached moov and layout
+*        load   O/P     bool    false on a miss or an unusable entry
+**************************************************************************/
+        bool QtFastStartSTD::MoovCache::load(const QtFastStartSTD::MoovCacheKey &key, QtFastStartSTD::MoovCacheEntry *entry) const
+        {
+                std::string file = path(key);
+                FILE* f = fopen(file.c_str(), "rb");
+                if(!f)
+                        return false;
+                std::vector<byte> raw;
+                struct stat st;
+                if(fstat(fileno(f), &st) == 0 && st.st_size >= ENTRY_HEADER_SIZE + ENTRY_CRC_SIZE){
+                        raw.resize(st.st_size);
+                        if(fread(raw.data(), 1, raw.size(), f) != raw.size())
+                                raw.clear();
+                }
+                fclose(f);
+                if(raw.empty())
+                        return false;
+
+                uint64_t body = raw.size() - ENTRY_CRC_SIZE;
+                BYTEBUFFER::BigEndianRawCursor c(raw.data(), raw.size());
+                if(crc32(0, raw.data(), body) != c.getUint_32(body))
+                        return false;
+                if(c.getUint_32() != MOOV_CACHE_MAGIC || c.getUint_32() != MOOV_CACHE_VERSION)
+                        return false;
+                if(c.getUint_64() != key.fileSize || c.getUint_64() != key.moovOffset
+                        || c.getUint_64() != key.moovHash || c.getUint_64() != key.layoutHash)
+                        return false;
+                uint64_t moovLen = c.getUint_64();
+                uint32_t regions = c.getUint_32();
+                if((uint64_t)regions * REGION_SIZE > body - ENTRY_HEADER_SIZE
+                        || moovLen != body - ENTRY_HEADER_SIZE - (uint64_t)regions * REGION_SIZE)
+                        return false;
+
+                entry->layout = OffsetMap();
+                for(uint32_t i = 0; i < regions; i++){
+                        uint64_t inStart = c.getUint_64();
+                        uint64_t length = c.getUint_64();
+                        uint64_t outStart = c.getUint_64();
+                        if(inStart > key.fileSize || length > key.fileSize - inStart)
+                                return false;
+                        entry->layout.add(inStart, length, outStart);
+                }
+                entry->moov.assign(raw.begin() + c.getPosition(), raw.begin() + body);
+                utime(file.c_str(), NULL);
+#ifdef DEBUG
+                std::cout << "moov cache hit " << file << std::endl;
+#endif // DEBUG
+                return true;
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::MoovCache::store(const QtFastStartSTD::MoovCacheKey &key, const QtFastStartSTD::MoovCacheEntry &entry) const
+* Description: writes the entry of a key into a temporary file and renames
+*               it into place, then evicts old entries. All fields are big
+*               endian: magic, version, the key, the moov length and region
+*               count, every region, the moov and a crc32 of all of it
+*
+* Parameters:
+*        key    I/P     const QtFastStartSTD::MoovCacheKey&     key of the entry
+*        entry  I/P     const QtFastStartSTD::MoovCacheEntry&   moov and layout to store
+*        store  O/P     bool    false if the entry could not be written
+**************************************************************************/
+        bool QtFastStartSTD::MoovCache::store(const QtFastStartSTD::MoovCacheKey &key, const QtFastStartSTD::MoovCacheEntry &entry) const
+        {
+                const std::vector<Region> &regions = entry.layout.regions;
+                uint64_t body = ENTRY_HEADER_SIZE + (uint64_t)regions.size() * REGION_SIZE + entry.moov.size();
+                std::vector<byte> raw(body + ENTRY_CRC_SIZE);
+                BYTEBUFFER::BigEndianRawCursor c(raw.data(), raw.size());
+                c.putUint_32(MOOV_CACHE_MAGIC);
+                c.putUint_32(MOOV_CACHE_VERSION);
+                c.putUint_64(key.fileSize);
+                c.putUint_64(key.moovOffset);
+                c.putUint_64(key.moovHash);
+                c.putUint_64(key.layoutHash);
+                c.putUint_64(entry.moov.size());
+                c.putUint_32(regions.size());
+                for(const Region &r : regions){
+                        c.putUint_64(r.inStart);
+                        c.putUint_64(r.length);
+                        c.putUint_64(r.outStart);
+                }
+                if(!entry.moov.empty())
+                        memcpy(&raw[c.getPosition()], entry.moov.data(), entry.moov.size());
+                c.putUint_32(body, crc32(0, raw.data(), body));
+
+                std::string temp = this->directory + "/" TEMP_PREFIX "XXXXXX";
+                int fd = mkstemp(&temp[0]);
+                if(fd < 0)
+                        return false;
+                //mkstemp creates the file private, other workers have to read it too
+                fchmod(fd, 0644);
+                uint64_t written = 0;
+                while(written < raw.size()){
+                        ssize_t q = write(fd, &raw[written], raw.size() - written);
+                        if(q <= 0)
+                                break;
+                        written += q;
+                }
+                bool ok = close(fd) == 0 && written == raw.size();
+                //rename replaces an entry another worker stored meanwhile, both hold the same data
+                if(!ok || rename(temp.c_str(), path(key).c_str()) != 0){
+                        unlink(temp.c_str());
+                        return false;
+                }
+                evict();
+                return true;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::MoovCache::evict(void) const
+* Description: removes the least recently used entries, by modification time,
+*               until the cache fits its limit. Temporary files count too, so
+*               ones left behind by crashed workers are removed eventually
+*
+* Parameters:
+**************************************************************************/
+        void QtFastStartSTD::MoovCache::evict(void) const
+        {
+                DIR* dir = opendir(this->directory.c_str());
+                if(!dir)
+                        return;
+                struct File{ time_t used; uint64_t size; std::string path; };
+                std::vector<File> files;
+                uint64_t total = 0;
+                const size_t suffix = sizeof(ENTRY_SUFFIX) - 1;
+                while(struct dirent* e = readdir(dir)){
+                        std::string name = e->d_name;
+                        bool isEntry = name.size() > suffix && name.compare(name.size() - suffix, suffix, ENTRY_SUFFIX) == 0;
+                        if(!isEntry && name.compare(0, sizeof(TEMP_PREFIX) - 1, TEMP_PREFIX) != 0)
+                                continue;
+                        std::string file = this->directory + "/" + name;
+                        struct stat st;
+                        if(stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                                continue;
+                        files.push_back({st.st_mtime, (uint64_t)st.st_size, file});
+                        total += st.st_size;
+                }
+                closedir(dir);
+                if(total <= this->maxBytes)
+                        return;
+
+                std::sort(files.begin(), files.end(), [](const File &a, const File &b){ return a.used < b.used; });
+                for(const File &f : files){
+                        if(total <= this->maxBytes)
+                                break;
+                        //another worker may have removed it already
+                        unlink(f.path.c_str());
+                        total -= f.size;
+                }
+        }
@@ -0,0 +1,74 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef MOOVCACHE_H
+#define MOOVCACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Atom.hpp"
+#include "OffsetMap.hpp"
+
+//first bytes of a cache entry, "QTMC"
+#define MOOV_CACHE_MAGIC        0x51544D43
+#define MOOV_CACHE_VERSION      1
+
+
+namespace QtFastStartSTD{
+
+/*Identifies one conversion. The layout hash covers the top-level atoms and
+the options that change the output layout*/
+        struct MoovCacheKey{
+                uint64_t fileSize = 0;
+                uint64_t moovOffset = 0;
+                uint64_t moovHash = 0;
+                uint64_t layoutHash = 0;
+        };
+
+/*What a conversion needs besides the input: the moov to write and the regions
+to copy behind it*/
+        struct MoovCacheEntry{
+                std::vector<byte> moov;
+                OffsetMap layout;
+        };
+
+/*Directory of patched moov atoms, filled in by fast-start conversions when
+QtFastStartOptions::moovCache points to one. Entries are written to a temporary
+file and renamed into place, so workers sharing the directory only ever see
+complete entries, and the least recently used ones are removed once the
+directory grows past maxBytes. Failing to read or write the cache never fails
+a conversion*/
+        class MoovCache{
+                private:
+                        std::string directory;
+                        uint64_t maxBytes;
+
+                        std::string path(const MoovCacheKey &key) const;
+
+                public:
+                        MoovCache(const std::string &directory, uint64_t maxBytes);
+
+                        static MoovCacheKey makeKey(const byte* in, uint64_t len, const std::vector<AtomRange> &top,
+                                                const AtomRange &moov, uint32_t flags);
+                        bool load(const MoovCacheKey &key, MoovCacheEntry *entry) const;
+                        bool store(const MoovCacheKey &key, const MoovCacheEntry &entry) const;
+                        void evict(void) const;
+        };
+
+}
+
+
+#endif // MOOVCACHE_H
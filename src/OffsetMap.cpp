@@ -0,0 +1,100 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  OffsetMap.cpp
+* Procedures:
+* QtFastStartSTD::OffsetMap::add        -appends a region, merging it with the previous one when both are contiguous
+* QtFastStartSTD::OffsetMap::map        -translates an input offset into the matching output offset
+* QtFastStartSTD::OffsetMap::outputSize -returns the offset one past the last region in the output
+***************************************************************************/
+
+#include <algorithm>
+#include "OffsetMap.hpp"
+
+
+/***************************************************************************
+* void QtFastStartSTD::OffsetMap::add(uint64_t inStart, uint64_t length, uint64_t outStart)
+* Description: appends a region, merging it with the previous one when both
+*               are contiguous in the input and in the output
+*
+* Parameters:
+*        inStart        I/P     uint64_t        offset of the region in the input
+*        length I/P     uint64_t        length of the region
+*        outStart       I/P     uint64_t        offset of the region in the output
+**************************************************************************/
+        void QtFastStartSTD::OffsetMap::add(uint64_t inStart, uint64_t length, uint64_t outStart)
+        {
+                if(length == 0)
+                        return;
+                if(!this->regions.empty()){
+                        Region &last = this->regions.back();
+                        if(last.inStart + last.length == inStart && last.outStart + last.length == outStart){
+                                last.length += length;
+                                return;
+                        }
+                }
+                this->regions.push_back({inStart, length, outStart});
+
+                //keep an index sorted by input offset for map()
+                uint32_t idx = this->regions.size() - 1;
+                std::vector<uint32_t>::iterator at = std::upper_bound(this->byInput.begin(), this->byInput.end(), inStart,
+                                [this](uint64_t v, uint32_t i){ return v < this->regions[i].inStart; });
+                this->byInput.insert(at, idx);
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::OffsetMap::map(uint64_t in, uint64_t *out) const
+* Description: translates an input offset into the matching output offset
+*
+* Parameters:
+*        in     I/P     uint64_t        offset in the input
+*        out    O/P     uint64_t*       offset in the output
+*        map    O/P     bool    false if the offset is not in any copied region
+**************************************************************************/
+        bool QtFastStartSTD::OffsetMap::map(uint64_t in, uint64_t *out) const
+        {
+                if(this->regions.size() == 1){
+                        const Region &r = this->regions[0];
+                        if(in < r.inStart || in - r.inStart > r.length)
+                                return false;
+                        *out = in - r.inStart + r.outStart;
+                        return true;
+                }
+                std::vector<uint32_t>::const_iterator it = std::upper_bound(this->byInput.begin(), this->byInput.end(), in,
+                                [this](uint64_t v, uint32_t i){ return v < this->regions[i].inStart; });
+                if(it == this->byInput.begin())
+                        return false;
+                const Region &r = this->regions[*(it - 1)];
+                if(in - r.inStart > r.length)
+                        return false;
+                *out = in - r.inStart + r.outStart;
+                return true;
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::OffsetMap::outputSize(void) const
+* Description: returns the offset one past the last region in the output
+*
+* Parameters:
+*        outputSize     O/P     uint64_t        end of the mapped output
+**************************************************************************/
+        uint64_t QtFastStartSTD::OffsetMap::outputSize(void) const
+        {
+                uint64_t end = 0;
+                for(const Region &r : this->regions)
+                        end = std::max(end, r.outStart + r.length);
+                return end;
+        }
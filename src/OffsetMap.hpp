@@ -0,0 +1,50 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef OFFSETMAP_H
+#define OFFSETMAP_H
+
+#include <stdint.h>
+#include <vector>
+
+
+namespace QtFastStartSTD{
+
+/*A range of input bytes copied to the output, and where it lands*/
+        struct Region{
+                uint64_t inStart;
+                uint64_t length;
+                uint64_t outStart;
+        };
+
+/*Maps offsets in the input file to offsets in the output file. The regions
+double as the copy plan of the output, in output order
+*/
+        class OffsetMap{
+                public:
+                        std::vector<Region> regions;
+
+                        void add(uint64_t inStart, uint64_t length, uint64_t outStart);
+                        bool map(uint64_t in, uint64_t *out) const;
+                        uint64_t outputSize(void) const;
+
+                private:
+                        std::vector<uint32_t> byInput;
+        };
+
+}
+
+
+#endif // OFFSETMAP_H
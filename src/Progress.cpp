@@ -0,0 +1,138 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Progress.cpp
+* Procedures:
+* QtFastStartSTD::Progress::Progress    -Default constructor, an inactive progress
+* QtFastStartSTD::Progress::Progress    -Overloaded constructor, takes the callback, cancel flag and deadline
+* QtFastStartSTD::Progress::begin       -starts reporting a new phase
+* QtFastStartSTD::Progress::update      -reports how far the current phase is, aborting if needed
+* QtFastStartSTD::Progress::transfer    -copies between streams in slices, reporting after each one
+* QtFastStartSTD::Progress::check       -throws if the conversion was cancelled or is past its deadline
+***************************************************************************/
+
+#include "Progress.hpp"
+#include "QtFastStartCPP.hpp"
+
+
+/***************************************************************************
+* QtFastStartSTD::Progress::Progress(void)
+* Description: Default constructor, an inactive progress
+*
+* Parameters:
+**************************************************************************/
+        QtFastStartSTD::Progress::Progress(void)
+        {
+        }
+
+/***************************************************************************
+* QtFastStartSTD::Progress::Progress(QtFastStartSTD::ProgressCallback callback, void* user, const std::atomic<bool> *cancel, std::chrono::steady_clock::time_point deadline)
+* Description: Overloaded constructor, takes the callback, cancel flag and deadline
+*
+* Parameters:
+*        callback       I/P     QtFastStartSTD::ProgressCallback        progress callback, may be NULL
+*        user   I/P     void*   passed to the callback
+*        cancel I/P     const std::atomic<bool>*        aborts the conversion once true, may be NULL
+*        deadline       I/P     std::chrono::steady_clock::time_point   aborts the conversion once passed,
+*                                       time_point::max() for none
+**************************************************************************/
+        QtFastStartSTD::Progress::Progress(QtFastStartSTD::ProgressCallback callback, void* user,
+                                const std::atomic<bool> *cancel, std::chrono::steady_clock::time_point deadline)
+        {
+                this->callback = callback;
+                this->user = user;
+                this->cancel = cancel;
+                this->deadline = deadline;
+                this->enabled = callback || cancel || deadline != std::chrono::steady_clock::time_point::max();
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Progress::begin(QtFastStartSTD::StatsPhase phase, uint64_t total)
+* Description: starts reporting a new phase
+*
+* Parameters:
+*        phase  I/P     QtFastStartSTD::StatsPhase      phase that starts
+*        total  I/P     uint64_t        amount of work in the phase
+**************************************************************************/
+        void QtFastStartSTD::Progress::begin(QtFastStartSTD::StatsPhase phase, uint64_t total)
+        {
+                this->phase = phase;
+                this->total = total;
+                this->update(0);
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Progress::update(uint64_t done)
+* Description: reports how far the current phase is, after checking whether
+*               the conversion has to be aborted
+*
+* Parameters:
+*        done   I/P     uint64_t        amount of work finished in the phase
+**************************************************************************/
+        void QtFastStartSTD::Progress::update(uint64_t done)
+        {
+                if(!this->enabled)
+                        return;
+                this->check();
+                this->done = done;
+                if(this->callback)
+                        this->callback(this->phase, done, this->total, this->user);
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::Progress::transfer(QtFastStartSTD::ArtificialFileStream *in, uint64_t pos, uint64_t len, QtFastStartSTD::ArtificialFileStream *out)
+* Description: copies between streams in slices of PROGRESS_SLICE bytes,
+*               reporting after each one. An inactive progress copies in one go
+*
+* Parameters:
+*        in     I/O     QtFastStartSTD::ArtificialFileStream*   stream to copy from
+*        pos    I/P     uint64_t        position in the source stream
+*        len    I/P     uint64_t        number of bytes to copy
+*        out    I/O     QtFastStartSTD::ArtificialFileStream*   stream to append to
+*        transfer       O/P     uint64_t        number of bytes copied
+**************************************************************************/
+        uint64_t QtFastStartSTD::Progress::transfer(QtFastStartSTD::ArtificialFileStream *in, uint64_t pos,
+                                uint64_t len, QtFastStartSTD::ArtificialFileStream *out)
+        {
+                if(!this->enabled)
+                        return in->transferTo(pos, len, out);
+
+                uint64_t copied = 0;
+                while(copied < len){
+                        uint64_t slice = len - copied < PROGRESS_SLICE ? len - copied : PROGRESS_SLICE;
+                        uint64_t q = in->transferTo(pos + copied, slice, out);
+                        copied += q;
+                        this->update(this->done + q);
+                        if(q < slice)
+                                break;
+                }
+                return copied;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::Progress::check(void)
+* Description: throws if the conversion was cancelled or is past its deadline
+*
+* Parameters:
+**************************************************************************/
+        void QtFastStartSTD::Progress::check(void)
+        {
+                if(this->cancel && this->cancel->load(std::memory_order_relaxed))
+                        throw Cancelled();
+                if(this->deadline != std::chrono::steady_clock::time_point::max()
+                        && std::chrono::steady_clock::now() > this->deadline)
+                        throw Deadline_Exceeded();
+        }
@@ -0,0 +1,67 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include "ArtificialFS.hpp"
+#include "Stats.hpp"
+
+//bytes copied between two progress reports
+#define PROGRESS_SLICE  (8 * 1024 * 1024)
+//chunk offset entries patched between two progress reports
+#define PATCH_PROGRESS_ENTRIES  65536
+
+
+namespace QtFastStartSTD{
+
+/*Called with how far the patch and copy phases are. done and total are bytes
+of the moov for the patch phase and bytes of media data for the copy phase*/
+        typedef void (*ProgressCallback)(StatsPhase phase, uint64_t done, uint64_t total, void* user);
+
+/*Reports the progress of a conversion and aborts it once it is cancelled or
+past its deadline. Without a callback, cancel flag or deadline it is inactive,
+and copies run as single transfers*/
+        class Progress{
+                private:
+                        ProgressCallback callback = nullptr;
+                        void* user = nullptr;
+                        const std::atomic<bool> *cancel = nullptr;
+                        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+                        bool enabled = false;
+                        StatsPhase phase = PHASE_SCAN;
+                        uint64_t done = 0;
+                        uint64_t total = 0;
+
+                        void check(void);
+
+                public:
+                        Progress(void);
+                        Progress(ProgressCallback callback, void* user, const std::atomic<bool> *cancel,
+                                std::chrono::steady_clock::time_point deadline);
+
+                        bool active(void) const{return this->enabled;}
+                        void begin(StatsPhase phase, uint64_t total);
+                        void update(uint64_t done);
+                        uint64_t transfer(ArtificialFileStream *in, uint64_t pos, uint64_t len, ArtificialFileStream *out);
+        };
+
+}
+
+
+#endif // PROGRESS_H
@@ -22,6 +22,14 @@
 #include <limits.h>
 #include "ByteBuffer.hpp"
 #include "ArtificialFS.hpp"
+#include "Atom.hpp"
+#include "OffsetMap.hpp"
+#include "Stats.hpp"
+#include "Progress.hpp"
+#include "Status.hpp"
+#include "SeekIndex.hpp"
+#include "MoovCache.hpp"
+#include "SampleTable.hpp"
 
 
 #define         FREE_ATOM       1701147238
@@ -36,45 +44,201 @@
 #define         UUID_ATOM       1684632949
 
 #define         CMOV_ATOM       1987013987
+#define         DCOM_ATOM       1836016484
+#define         CMVD_ATOM       1685482851
 #define         STCO_ATOM       1868788851
 #define         CO64_ATOM       875982691
 
+#define         TRAK_ATOM       1801548404
+#define         MDIA_ATOM       1634296941
+#define         MINF_ATOM       1718511981
+#define         STBL_ATOM       1818391667
+#define         EDTS_ATOM       1937007717
+#define         ELST_ATOM       1953721445
+#define         DINF_ATOM       1718511972
+#define         MVHD_ATOM       1684567661
+#define         TKHD_ATOM       1684564852
+#define         MDHD_ATOM       1684563053
+#define         HDLR_ATOM       1919706216
+#define         STSD_ATOM       1685288051
+#define         STTS_ATOM       1937011827
+#define         CTTS_ATOM       1937011811
+#define         STSS_ATOM       1936946291
+#define         STSC_ATOM       1668510835
+#define         STSZ_ATOM       2054386803
+#define         STZ2_ATOM       846886003
+#define         SDTP_ATOM       1886676083
+#define         STPS_ATOM       1936749683
+#define         SBGP_ATOM       1885823603
+#define         SUBS_ATOM       1935832435
+#define         SAIZ_ATOM       2053726579
+#define         SAIO_ATOM       1869177203
+#define         ILOC_ATOM       1668246633
+
+#define         MVEX_ATOM       2019915373
+#define         MEHD_ATOM       1684563309
+#define         TREX_ATOM       2019914356
+#define         MOOF_ATOM       1718579053
+#define         MFHD_ATOM       1684563565
+#define         TRAF_ATOM       1717662324
+#define         TFHD_ATOM       1684563572
+#define         TFDT_ATOM       1952736884
+#define         TRUN_ATOM       1853190772
+#define         MFRA_ATOM       1634887277
+#define         TFRA_ATOM       1634887284
+#define         STYP_ATOM       1887007859
+#define         SIDX_ATOM       2019846515
+#define         SSIX_ATOM       2020176755
+#define         PRFT_ATOM       1952871024
+
+#define         UDTA_ATOM       1635017845
+#define         META_ATOM       1635018093
+
+#define         VIDE_HANDLER    1701079414
+#define         SOUN_HANDLER    1853190003
+#define         ZLIB_COMPRESSION        1651076218
+
+#define         ATOM_PREAMBLE_SIZE      8
+
 
 namespace QtFastStartSTD{
 
+        enum OutputMode{
+        //layout of the file produced by QtFastStart
+                MODE_FASTSTART = 0,     //moov moved in front of the media data
+                MODE_FRAGMENTED         //init segment followed by moof/mdat pairs
+        };
+
+/*Edits the uncompressed moov of the input before the output is laid out: child
+atoms of the moov and its traks may be removed, replaced or inserted. The chunk
+offsets are patched after the edit, so a moov that changed size still points
+at the media data*/
+        typedef void (*MoovEditCallback)(Atom &moov, void* user);
+
+/*Caps on what a conversion of untrusted input may allocate, 0 leaves a limit
+off. Each is checked before the allocation it guards, a conversion over a
+limit fails with STATUS_LIMIT_EXCEEDED*/
+        struct QtFastStartLimits{
+                uint64_t maxMoovSize = 0;               //largest moov atom in bytes, a compressed one also when inflated
+                uint64_t maxFtypSize = 0;               //largest ftyp atom in bytes
+                uint64_t maxMemory = 0;                 //conversion buffers plus the output, which is built in memory
+                uint64_t maxTopLevelAtoms = 0;          //most top-level atoms the input may have
+        };
+
+/*Settings for a conversion, the defaults give the classic qt-faststart behaviour*/
+        struct QtFastStartOptions{
+                OutputMode mode = MODE_FASTSTART;
+                uint32_t fragmentDuration = 2000;       //minimum fragment length in milliseconds, cut at the next sync sample
+                bool stripPadding = false;              //drop top-level free/skip/wide/junk atoms from the output
+                bool compressMoov = false;              //write the moov as a zlib compressed cmov atom instead of a plain one
+                bool compactMoov = false;               //rebuild the sample tables of the moov in their smallest form
+                bool rechunk = false;                   //merge the chunks of a track that lie back to back in the mdat
+                bool inPlace = false;                   //convert inside the input buffer: move the moov into padding in front of the mdat instead of copying the file
+                uint32_t interleaveDuration = 0;        //re-interleave the tracks in chunks of at most this many milliseconds, 0 keeps the input order
+                QtFastStartStats *stats = nullptr;      //counters of the conversion, only collected if set
+                SeekIndex *index = nullptr;             //sync sample index of the output, only built if set
+                MoovCache *moovCache = nullptr;         //patched moov atoms of earlier conversions, only used if set
+                Checksum *checksum = nullptr;           //hashes of the output, computed while it is written if set
+                QtFastStartLimits limits;               //resource limits for untrusted input, none by default
+                uint64_t trimStart = 0;                 //start of the clip in milliseconds, moved back to the previous sync sample
+                uint64_t trimLength = 0;                //length of the clip in milliseconds, 0 runs to the end of the input
+                std::vector<uint32_t> dropTrackIds;     //tracks to leave out of the output, by track ID
+                std::vector<uint32_t> dropHandlers;     //tracks to leave out of the output, by handler type such as SOUN_HANDLER
+                MoovEditCallback moovEdit = nullptr;    //called once with the moov, an already fast-start input is rewritten when set, as for the other output changing options
+                void* moovEditData = nullptr;           //passed to the moov edit callback
+                ProgressCallback progress = nullptr;    //called between copied slices and patched tables
+                void* progressData = nullptr;           //passed to the progress callback
+                const std::atomic<bool> *cancel = nullptr;      //the conversion throws Cancelled once this is set
+                std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); //the conversion throws Deadline_Exceeded once past this
+        };
 
 
         class QtFastStart{
                 private:
-                        const byte* data;
-                        uint64_t data_len;
+                        const byte* data = nullptr;
+                        uint64_t data_len = 0;
+                        byte* input = nullptr;          //the caller's buffer, only written to with options.inPlace
+                        bool unchanged = false;
+                        uint64_t bufferBytes = 0;
+                        QtFastStartResult result;
                         BYTEBUFFER::ByteBuffer *ftypAtom = nullptr;
                         BYTEBUFFER::ByteBuffer *moovAtom = nullptr;
-                        void fastStartImpl(void);
+                        QtFastStartOptions options;
+                        Progress progress;
+                        QtFastStartResult run(void) noexcept;
+                        QtFastStartResult fastStartImpl(void);
+                        QtFastStartResult fragmentImpl(void);
+                        void defragmentImpl(const std::vector<AtomRange> &top);
+                        bool interleaveImpl(const std::vector<AtomRange> &top, const AtomRange *moovRange, const AtomRange *ftypRange);
+                        void passThrough(FallbackReason reason);
+                        void trackBuffer(int64_t bytes);
+                        QtFastStartResult checkMemory(uint64_t bytes) const;
+                        uint64_t moovAllowance(void) const;
+                        QtFastStartResult scanTopLevel(std::vector<AtomRange> &top) const;
+                        Atom parseMoov(const AtomRange &moovRange);
+                        void applyMoovEdit(Atom &moov);
+                        std::vector<uint32_t> dropTracks(Atom &moov) const;
+                        void editMoov(uint32_t *headerSize);
+                        void replaceMoov(const Atom &moov, uint32_t *headerSize);
+                        bool widenChunkOffsets(const OffsetMap &offsets, uint32_t *headerSize);
+                        void compactTables(uint32_t *headerSize);
+                        void trimTracks(Atom &moov, std::vector<SampleTable> &tracks);
+                        void indexMoov(const byte* moov, uint64_t len, uint32_t headerSize);
+                        void writeCached(const MoovCacheEntry &entry, const AtomRange *ftyp);
+                        void finishStats(void);
+                        bool reuseFreeSpace(const std::vector<AtomRange> &top);
 
-                        QtFastStartSTD::ArtificialFileStream *inFile;
-                        QtFastStartSTD::ArtificialFileStream *outFile;
+                        QtFastStartSTD::ArtificialFileStream *inFile = nullptr;
+                        QtFastStartSTD::ArtificialFileStream *outFile = nullptr;
 
                 public:
                         explicit QtFastStart(byte* in = NULL, uint64_t len = 0);
+                        QtFastStart(byte* in, uint64_t len, const QtFastStartOptions &options);
+                        QtFastStart(byte* in, uint64_t len, const QtFastStartOptions &options, QtFastStartResult *result) noexcept;
                         QtFastStartSTD::ArtificialFileStream fastStart(void);
+                        const byte* getData(void) const;
+                        uint64_t getLength(void) const;
+                        bool noChangeNeeded(void) const;
+                        QtFastStartResult getResult(void) const;
+                        static bool fastStartInPlace(byte* in, uint64_t len, uint64_t *newLen);
                         ~QtFastStart(void);
 
 
         };
 
 
-        class Compressed_Moov : std::exception{
+        class Compressed_Moov : public std::exception{
                 public:
-                        const char* what(void) const noexcept{return "This utility does not support compressed moov atoms yet\n";}
+                        const char* what(void) const noexcept{return "This utility only supports zlib compressed moov atoms\n";}
         };
 
-        class Bad_Atom_Size : std::exception{
+        class Bad_Atom_Size : public std::exception{
                 public:
                         const char* what(void) const noexcept{return "Bad atom size\n";}
         };
 
-        class Malformed_Atom : std::exception{
+        class Cancelled : public std::exception{
+                public:
+                        const char* what(void) const noexcept{return "Conversion cancelled\n";}
+        };
+
+        class Deadline_Exceeded : public std::exception{
+                public:
+                        const char* what(void) const noexcept{return "Conversion did not finish before its deadline\n";}
+        };
+
+        class Limit_Exceeded : public std::exception{
+                private:
+                        const char* res = NULL;
+                        uint64_t at = STATUS_NO_OFFSET;
+
+                public:
+                        Limit_Exceeded(const char* msg, uint64_t offset = STATUS_NO_OFFSET){this->res = msg; this->at = offset;}
+                        const char* what(void) const noexcept{return this->res;}
+                        uint64_t offset(void) const noexcept{return this->at;}
+        };
+
+        class Malformed_Atom : public std::exception{
                 private:
                         const char* res = NULL;
 
@@ -86,6 +250,15 @@ namespace QtFastStartSTD{
 
         uint64_t readAndFill(ArtificialFileStream *infile, BYTEBUFFER::ByteBuffer *buffer);
         uint64_t readAndFill(ArtificialFileStream *infile, BYTEBUFFER::ByteBuffer *buffer, uint64_t pos);
+        QtFastStartResult patchChunkOffsets(BYTEBUFFER::ByteBuffer *moov, uint64_t begin, uint64_t end, const OffsetMap &offsets,
+                                        uint64_t *patched = nullptr, Progress *progress = nullptr);
+        void throwResult(const QtFastStartResult &result);
+        QtFastStartResult validateFastStart(const byte* data, uint64_t len, uint64_t expectedMedia = 0) noexcept;
+        uint64_t mediaSize(const std::vector<AtomRange> &top);
+        bool isCompressedMoov(const byte* moov, uint64_t len, uint32_t headerSize);
+        BYTEBUFFER::ByteBuffer* inflateMoov(const byte* moov, uint64_t len, uint32_t headerSize, uint64_t maxSize = UINT64_MAX);
+        BYTEBUFFER::ByteBuffer* deflateMoov(BYTEBUFFER::ByteBuffer *moov, uint64_t minSize);
+        BYTEBUFFER::ByteBuffer* packMoov(const Atom &moov, bool compress, uint64_t minSize);
 
 
 
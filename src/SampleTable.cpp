@@ -0,0 +1,504 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  SampleTable.cpp
+* Procedures:
+* makeStsc      -builds an stsc atom describing chunks
+* makeChunkOffsets      -builds an stco or co64 atom listing the offsets of chunks
+* QtFastStartSTD::SampleTable::getStbl  -returns the stbl atom of a trak atom
+* QtFastStartSTD::SampleTable::parse    -expands the sample tables of a trak atom into samples and chunks
+* QtFastStartSTD::SampleTable::build    -replaces the sample tables of a trak atom with ones built from samples and chunks
+* QtFastStartSTD::SampleTable::buildChunks      -replaces only the stsc and chunk offset table of a trak atom
+* QtFastStartSTD::SampleTable::updateDurations  -rewrites the mdhd and tkhd durations to match the samples
+* QtFastStartSTD::SampleTable::duration -returns the summed duration of all samples, in the media timescale
+* QtFastStartSTD::SampleTable::mergeChunks      -merges chunks of the track that lie back to back in the file
+* QtFastStartSTD::SampleTable::splitChunks      -regroups the samples into chunks of at most a given duration
+***************************************************************************/
+
+#include "SampleTable.hpp"
+#include "QtFastStartCPP.hpp"
+#include "Cursor.hpp"
+
+
+/***************************************************************************
+* static QtFastStartSTD::Atom makeStsc(const std::vector<QtFastStartSTD::Chunk> &chunks)
+* Description: builds an stsc atom describing chunks, with one entry for
+*               every run of chunks sharing a sample count and description
+*
+* Parameters:
+*        chunks I/P     const std::vector<QtFastStartSTD::Chunk>&       chunks of a track
+*        makeStsc       O/P     QtFastStartSTD::Atom    the stsc atom
+**************************************************************************/
+static QtFastStartSTD::Atom makeStsc(const std::vector<QtFastStartSTD::Chunk> &chunks)
+{
+        QtFastStartSTD::Atom stsc(STSC_ATOM);
+        stsc.putUint_32(0);
+        stsc.putUint_32(0);
+        uint32_t entries = 0;
+        for(uint32_t c = 0; c < chunks.size(); c++){
+                if(c > 0 && chunks[c].sampleCount == chunks[c - 1].sampleCount
+                        && chunks[c].descriptionIndex == chunks[c - 1].descriptionIndex)
+                        continue;
+                stsc.putUint_32(c + 1);
+                stsc.putUint_32(chunks[c].sampleCount);
+                stsc.putUint_32(chunks[c].descriptionIndex);
+                entries++;
+        }
+        stsc.setUint_32(4, entries);
+        return stsc;
+}
+
+/***************************************************************************
+* static QtFastStartSTD::Atom makeChunkOffsets(const std::vector<QtFastStartSTD::Chunk> &chunks, bool wide)
+* Description: builds an stco or co64 atom listing the offsets of chunks
+*
+* Parameters:
+*        chunks I/P     const std::vector<QtFastStartSTD::Chunk>&       chunks of a track
+*        wide   I/P     bool    true for co64, false for stco
+*        makeChunkOffsets       O/P     QtFastStartSTD::Atom    the chunk offset atom
+**************************************************************************/
+static QtFastStartSTD::Atom makeChunkOffsets(const std::vector<QtFastStartSTD::Chunk> &chunks, bool wide)
+{
+        QtFastStartSTD::Atom co(wide ? CO64_ATOM : STCO_ATOM);
+        co.putUint_32(0);
+        co.putUint_32(chunks.size());
+        co.data.reserve(8 + chunks.size() * (wide ? 8 : 4));
+        for(const QtFastStartSTD::Chunk &ch : chunks){
+                if(wide)
+                        co.putUint_64(ch.offset);
+                else
+                        co.putUint_32((uint32_t)ch.offset);
+        }
+        return co;
+}
+
+/***************************************************************************
+* QtFastStartSTD::Atom* QtFastStartSTD::SampleTable::getStbl(QtFastStartSTD::Atom &trak)
+* Description: returns the stbl atom of a trak atom
+*
+* Parameters:
+*        trak   I/P     QtFastStartSTD::Atom&   trak atom to search
+*        getStbl        O/P     QtFastStartSTD::Atom*   the stbl atom, or nullptr if missing
+**************************************************************************/
+        QtFastStartSTD::Atom* QtFastStartSTD::SampleTable::getStbl(QtFastStartSTD::Atom &trak)
+        {
+                const uint32_t path[] = {MDIA_ATOM, MINF_ATOM, STBL_ATOM};
+                return trak.findPath(path, 3);
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::SampleTable::parse(QtFastStartSTD::Atom &trak)
+* Description: expands the sample tables of a trak atom into samples and chunks.
+*               Chunks stsc gives no samples are kept, empty, so the chunks
+*               still match the offset table; users of firstSample have to
+*               skip them
+*
+* Parameters:
+*        trak   I/P     QtFastStartSTD::Atom&   trak atom to read
+**************************************************************************/
+        void QtFastStartSTD::SampleTable::parse(QtFastStartSTD::Atom &trak)
+        {
+                Atom* tkhd = trak.find(TKHD_ATOM);
+                Atom* mdia = trak.find(MDIA_ATOM);
+                Atom* stbl = getStbl(trak);
+                if(!tkhd || !mdia || !stbl)
+                        throw Malformed_Atom("trak atom is missing tkhd, mdia or stbl\n");
+
+                this->trackId = tkhd->getUint_32(tkhd->getUint_8(0) == 1 ? 20 : 12);
+
+                Atom* mdhd = mdia->find(MDHD_ATOM);
+                if(!mdhd)
+                        throw Malformed_Atom("mdia atom is missing mdhd\n");
+                this->timescale = mdhd->getUint_32(mdhd->getUint_8(0) == 1 ? 20 : 12);
+
+                Atom* hdlr = mdia->find(HDLR_ATOM);
+                if(hdlr && hdlr->data.size() >= 12)
+                        memcpy(&this->handler, &hdlr->data[8], 4);
+
+                Atom* stts = stbl->find(STTS_ATOM);
+                Atom* ctts = stbl->find(CTTS_ATOM);
+                Atom* stss = stbl->find(STSS_ATOM);
+                Atom* stsc = stbl->find(STSC_ATOM);
+                Atom* stsz = stbl->find(STSZ_ATOM);
+                Atom* stz2 = stbl->find(STZ2_ATOM);
+                Atom* stco = stbl->find(STCO_ATOM);
+                Atom* co64 = stbl->find(CO64_ATOM);
+                if(!stts || !stsc || (!stsz && !stz2) || (!stco && !co64))
+                        throw Malformed_Atom("stbl atom is missing a required table\n");
+
+                //sample sizes
+                uint32_t sampleCount;
+                this->samples.clear();
+                if(stsz){
+                        uint32_t constant = stsz->getUint_32(4);
+                        sampleCount = stsz->getUint_32(8);
+                        if(constant == 0 && (uint64_t)sampleCount * 4 > stsz->data.size() - 12)
+                                throw Malformed_Atom("Bad atom size/element count\n");
+                        this->samples.resize(sampleCount);
+                        BYTEBUFFER::BigEndianRawCursor sizes(stsz->data.data(), stsz->data.size());
+                        for(uint32_t i = 0; i < sampleCount; i++)
+                                this->samples[i].size = constant ? constant : sizes.getUint_32(12 + (uint64_t)i * 4);
+                }
+                else{
+                        uint8_t fieldSize = stz2->getUint_8(7);
+                        sampleCount = stz2->getUint_32(8);
+                        if(fieldSize != 4 && fieldSize != 8 && fieldSize != 16)
+                                throw Malformed_Atom("Bad stz2 field size\n");
+                        if(((uint64_t)sampleCount * fieldSize + 7) / 8 > stz2->data.size() - 12)
+                                throw Malformed_Atom("Bad atom size/element count\n");
+                        this->samples.resize(sampleCount);
+                        for(uint32_t i = 0; i < sampleCount; i++){
+                                if(fieldSize == 16)
+                                        this->samples[i].size = stz2->getUint_16(12 + (uint64_t)i * 2);
+                                else if(fieldSize == 8)
+                                        this->samples[i].size = stz2->getUint_8(12 + i);
+                                else
+                                        this->samples[i].size = (stz2->getUint_8(12 + i / 2) >> ((i & 1) ? 0 : 4)) & 0x0f;
+                        }
+                }
+
+                //decode times
+                uint32_t entries = stts->getUint_32(4);
+                if((uint64_t)entries * 8 > stts->data.size() - 8)
+                        throw Malformed_Atom("Bad atom size/element count\n");
+                uint64_t s = 0, t = 0;
+                BYTEBUFFER::BigEndianRawCursor times(stts->data.data(), stts->data.size());
+                for(uint32_t e = 0; e < entries; e++){
+                        uint32_t count = times.getUint_32(8 + (uint64_t)e * 8);
+                        uint32_t delta = times.getUint_32(12 + (uint64_t)e * 8);
+                        for(uint32_t i = 0; i < count && s < sampleCount; i++, s++){
+                                this->samples[s].decodeTime = t;
+                                this->samples[s].duration = delta;
+                                t += delta;
+                        }
+                }
+                for(; s < sampleCount; s++){
+                        this->samples[s].decodeTime = t;
+                        this->samples[s].duration = 0;
+                }
+
+                //composition offsets
+                this->hasCompositionOffsets = ctts != nullptr;
+                s = 0;
+                if(ctts){
+                        entries = ctts->getUint_32(4);
+                        if((uint64_t)entries * 8 > ctts->data.size() - 8)
+                                throw Malformed_Atom("Bad atom size/element count\n");
+                        BYTEBUFFER::BigEndianRawCursor offsets(ctts->data.data(), ctts->data.size());
+                        for(uint32_t e = 0; e < entries; e++){
+                                uint32_t count = offsets.getUint_32(8 + (uint64_t)e * 8);
+                                int32_t offset = (int32_t)offsets.getUint_32(12 + (uint64_t)e * 8);
+                                for(uint32_t i = 0; i < count && s < sampleCount; i++, s++)
+                                        this->samples[s].compositionOffset = offset;
+                        }
+                }
+                for(; s < sampleCount; s++)
+                        this->samples[s].compositionOffset = 0;
+
+                //sync samples
+                this->hasSyncTable = stss != nullptr;
+                for(Sample &smp : this->samples)
+                        smp.sync = !stss;
+                if(stss){
+                        entries = stss->getUint_32(4);
+                        if((uint64_t)entries * 4 > stss->data.size() - 8)
+                                throw Malformed_Atom("Bad atom size/element count\n");
+                        BYTEBUFFER::BigEndianRawCursor syncs(stss->data.data(), stss->data.size());
+                        for(uint32_t e = 0; e < entries; e++){
+                                uint32_t n = syncs.getUint_32(8 + (uint64_t)e * 4);
+                                if(n >= 1 && n <= sampleCount)
+                                        this->samples[n - 1].sync = true;
+                        }
+                }
+
+                //chunk offsets
+                this->chunks.clear();
+                uint32_t chunkCount = co64 ? co64->getUint_32(4) : stco->getUint_32(4);
+                if((uint64_t)chunkCount * (co64 ? 8 : 4) > (co64 ? co64->data.size() : stco->data.size()) - 8)
+                        throw Malformed_Atom("Bad atom size/element count\n");
+                this->chunks.resize(chunkCount);
+                Atom* offsetTable = co64 ? co64 : stco;
+                BYTEBUFFER::BigEndianRawCursor chunkOffsets(offsetTable->data.data(), offsetTable->data.size());
+                for(uint32_t c = 0; c < chunkCount; c++){
+                        this->chunks[c].offset = co64 ? chunkOffsets.getUint_64(8 + (uint64_t)c * 8)
+                                                      : chunkOffsets.getUint_32(8 + (uint64_t)c * 4);
+                        this->chunks[c].firstSample = 0;
+                        this->chunks[c].sampleCount = 0;
+                        this->chunks[c].descriptionIndex = 1;
+                }
+
+                //sample to chunk mapping
+                entries = stsc->getUint_32(4);
+                if((uint64_t)entries * 12 > stsc->data.size() - 8)
+                        throw Malformed_Atom("Bad atom size/element count\n");
+                s = 0;
+                BYTEBUFFER::BigEndianRawCursor runs(stsc->data.data(), stsc->data.size());
+                for(uint32_t e = 0; e < entries; e++){
+                        uint32_t first = runs.getUint_32(8 + (uint64_t)e * 12);
+                        uint32_t perChunk = runs.getUint_32(12 + (uint64_t)e * 12);
+                        uint32_t desc = runs.getUint_32(16 + (uint64_t)e * 12);
+                        uint32_t last = e + 1 < entries ? runs.getUint_32(20 + (uint64_t)e * 12) : chunkCount + 1;
+                        if(first == 0 || last < first)
+                                throw Malformed_Atom("Bad stsc entry\n");
+                        for(uint32_t c = first - 1; c < last - 1 && c < chunkCount; c++){
+                                Chunk &ch = this->chunks[c];
+                                uint64_t off = ch.offset;
+                                ch.firstSample = s;
+                                ch.descriptionIndex = desc;
+                                for(uint32_t i = 0; i < perChunk && s < sampleCount; i++, s++){
+                                        this->samples[s].offset = off;
+                                        this->samples[s].descriptionIndex = desc;
+                                        off += this->samples[s].size;
+                                        ch.sampleCount++;
+                                }
+                        }
+                }
+                if(s != sampleCount)
+                        throw Malformed_Atom("stsc does not cover every sample\n");
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::SampleTable::build(QtFastStartSTD::Atom &trak, uint64_t maxNarrowOffset) const
+* Description: replaces the sample tables of a trak atom with ones built from
+*               samples and chunks. Chunk offsets are written as co64 only if
+*               one of them is above maxNarrowOffset, which defaults to the
+*               largest 32 bit offset.
+*
+* Parameters:
+*        trak   I/O     QtFastStartSTD::Atom&   trak atom to rewrite
+*        maxNarrowOffset        I/P     uint64_t        largest chunk offset stco may hold
+**************************************************************************/
+        void QtFastStartSTD::SampleTable::build(QtFastStartSTD::Atom &trak, uint64_t maxNarrowOffset) const
+        {
+                Atom* stbl = getStbl(trak);
+                if(!stbl)
+                        throw Malformed_Atom("trak atom is missing stbl\n");
+
+                std::vector<Atom> tables;
+                uint32_t n = this->samples.size();
+
+                Atom stts(STTS_ATOM);
+                stts.putUint_32(0);
+                stts.putUint_32(0);
+                uint32_t entries = 0;
+                for(uint32_t i = 0; i < n; ){
+                        uint32_t j = i + 1;
+                        while(j < n && this->samples[j].duration == this->samples[i].duration)
+                                j++;
+                        stts.putUint_32(j - i);
+                        stts.putUint_32(this->samples[i].duration);
+                        entries++;
+                        i = j;
+                }
+                stts.setUint_32(4, entries);
+                tables.push_back(std::move(stts));
+
+                if(this->hasCompositionOffsets){
+                        Atom ctts(CTTS_ATOM);
+                        bool negative = false;
+                        for(const Sample &smp : this->samples)
+                                negative |= smp.compositionOffset < 0;
+                        ctts.putUint_32(negative ? 0x01000000 : 0);
+                        ctts.putUint_32(0);
+                        entries = 0;
+                        for(uint32_t i = 0; i < n; ){
+                                uint32_t j = i + 1;
+                                while(j < n && this->samples[j].compositionOffset == this->samples[i].compositionOffset)
+                                        j++;
+                                ctts.putUint_32(j - i);
+                                ctts.putUint_32((uint32_t)this->samples[i].compositionOffset);
+                                entries++;
+                                i = j;
+                        }
+                        ctts.setUint_32(4, entries);
+                        tables.push_back(std::move(ctts));
+                }
+
+                bool allSync = true;
+                for(const Sample &smp : this->samples)
+                        allSync &= smp.sync;
+                if(!allSync){
+                        Atom stss(STSS_ATOM);
+                        stss.putUint_32(0);
+                        stss.putUint_32(0);
+                        entries = 0;
+                        for(uint32_t i = 0; i < n; i++){
+                                if(this->samples[i].sync){
+                                        stss.putUint_32(i + 1);
+                                        entries++;
+                                }
+                        }
+                        stss.setUint_32(4, entries);
+                        tables.push_back(std::move(stss));
+                }
+
+                tables.push_back(makeStsc(this->chunks));
+
+                Atom stsz(STSZ_ATOM);
+                bool constant = n > 0;
+                for(uint32_t i = 1; i < n && constant; i++)
+                        constant = this->samples[i].size == this->samples[0].size;
+                stsz.putUint_32(0);
+                stsz.putUint_32(constant ? this->samples[0].size : 0);
+                stsz.putUint_32(n);
+                if(!constant){
+                        stsz.data.reserve(12 + (uint64_t)n * 4);
+                        for(const Sample &smp : this->samples)
+                                stsz.putUint_32(smp.size);
+                }
+                tables.push_back(std::move(stsz));
+
+                bool wide = false;
+                for(const Chunk &ch : this->chunks)
+                        wide |= ch.offset > maxNarrowOffset;
+                tables.push_back(makeChunkOffsets(this->chunks, wide));
+
+                const uint32_t rebuilt[] = {STTS_ATOM, CTTS_ATOM, STSS_ATOM, STSC_ATOM, STSZ_ATOM, STZ2_ATOM, STCO_ATOM, CO64_ATOM};
+                for(uint32_t type : rebuilt)
+                        stbl->remove(type);
+
+                //keep the tables right after stsd, where muxers normally place them
+                std::vector<Atom>::iterator at = stbl->children.begin();
+                if(!stbl->children.empty() && stbl->children[0].type == STSD_ATOM)
+                        at++;
+                stbl->children.insert(at, std::make_move_iterator(tables.begin()), std::make_move_iterator(tables.end()));
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::SampleTable::buildChunks(QtFastStartSTD::Atom &trak) const
+* Description: replaces only the stsc and the chunk offset table of a trak
+*               atom with ones built from chunks, in place. The offset table
+*               keeps its width, every other table is left byte for byte
+*
+* Parameters:
+*        trak   I/O     QtFastStartSTD::Atom&   trak atom to rewrite
+**************************************************************************/
+        void QtFastStartSTD::SampleTable::buildChunks(Atom &trak) const
+        {
+                Atom* stbl = getStbl(trak);
+                if(!stbl)
+                        throw Malformed_Atom("trak atom is missing stbl\n");
+                for(Atom &child : stbl->children){
+                        if(child.type == STSC_ATOM)
+                                child = makeStsc(this->chunks);
+                        else if(child.type == STCO_ATOM || child.type == CO64_ATOM)
+                                child = makeChunkOffsets(this->chunks, child.type == CO64_ATOM);
+                }
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::SampleTable::updateDurations(QtFastStartSTD::Atom &trak, uint32_t movieTimescale) const
+* Description: rewrites the mdhd and tkhd durations to match the samples
+*
+* Parameters:
+*        trak   I/O     QtFastStartSTD::Atom&   trak atom to rewrite
+*        movieTimescale I/P     uint32_t        timescale of the mvhd atom
+**************************************************************************/
+        void QtFastStartSTD::SampleTable::updateDurations(QtFastStartSTD::Atom &trak, uint32_t movieTimescale) const
+        {
+                uint64_t media = this->duration();
+                uint64_t movie = this->timescale ? media * movieTimescale / this->timescale : 0;
+
+                Atom* mdia = trak.find(MDIA_ATOM);
+                Atom* mdhd = mdia ? mdia->find(MDHD_ATOM) : nullptr;
+                if(mdhd){
+                        if(mdhd->getUint_8(0) == 1)
+                                mdhd->setUint_64(24, media);
+                        else
+                                mdhd->setUint_32(16, media > UINT32_MAX ? UINT32_MAX : (uint32_t)media);
+                }
+                Atom* tkhd = trak.find(TKHD_ATOM);
+                if(tkhd){
+                        if(tkhd->getUint_8(0) == 1)
+                                tkhd->setUint_64(28, movie);
+                        else
+                                tkhd->setUint_32(20, movie > UINT32_MAX ? UINT32_MAX : (uint32_t)movie);
+                }
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::SampleTable::duration(void) const
+* Description: returns the summed duration of all samples, in the media timescale
+*
+* Parameters:
+*        duration       O/P     uint64_t        total duration
+**************************************************************************/
+        uint64_t QtFastStartSTD::SampleTable::duration(void) const
+        {
+                if(this->samples.empty())
+                        return 0;
+                const Sample &last = this->samples.back();
+                return last.decodeTime + last.duration - this->samples[0].decodeTime;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::SampleTable::mergeChunks(void)
+* Description: merges every chunk into the one before it if its samples start
+*               where that chunk ends and share its sample description. No
+*               sample moves, only stsc and the chunk offset table shrink.
+*               Empty chunks hold no media and are dropped
+*
+* Parameters:
+*        none
+**************************************************************************/
+        void QtFastStartSTD::SampleTable::mergeChunks(void)
+        {
+                std::vector<Chunk> merged;
+                uint64_t end = 0;
+                for(const Chunk &ch : this->chunks){
+                        if(ch.sampleCount == 0)
+                                continue;
+                        bool adjacent = !merged.empty() && ch.offset == end
+                                        && ch.descriptionIndex == merged.back().descriptionIndex
+                                        && ch.firstSample == merged.back().firstSample + merged.back().sampleCount;
+                        if(adjacent)
+                                merged.back().sampleCount += ch.sampleCount;
+                        else{
+                                merged.push_back(ch);
+                                end = ch.offset;
+                        }
+                        for(uint32_t i = ch.firstSample; i < ch.firstSample + ch.sampleCount; i++)
+                                end += this->samples[i].size;
+                }
+                this->chunks.swap(merged);
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::SampleTable::splitChunks(uint32_t duration)
+* Description: regroups the samples into chunks that span at most the given
+*               duration. A chunk also ends where the sample description
+*               changes, since stsc gives one per chunk
+*
+* Parameters:
+*        duration       I/P     uint32_t        longest chunk in milliseconds, the chunk offsets are left at 0
+**************************************************************************/
+        void QtFastStartSTD::SampleTable::splitChunks(uint32_t duration)
+        {
+                uint64_t ticks = (uint64_t)duration * this->timescale / 1000;
+                if(ticks == 0)
+                        ticks = 1;
+                this->chunks.clear();
+                for(uint32_t i = 0; i < this->samples.size(); ){
+                        const Sample &first = this->samples[i];
+                        Chunk ch = {0, i, 0, first.descriptionIndex};
+                        while(i < this->samples.size() && this->samples[i].descriptionIndex == first.descriptionIndex
+                                && this->samples[i].decodeTime - first.decodeTime < ticks){
+                                ch.sampleCount++;
+                                i++;
+                        }
+                        this->chunks.push_back(ch);
+                }
+        }
@@ -0,0 +1,72 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef SAMPLETABLE_H
+#define SAMPLETABLE_H
+
+#include <stdint.h>
+#include <vector>
+#include "Atom.hpp"
+
+
+namespace QtFastStartSTD{
+
+/*One media sample, with its absolute offset in the file it was read from*/
+        struct Sample{
+                uint64_t offset;
+                uint64_t decodeTime;
+                uint32_t size;
+                uint32_t duration;
+                int32_t compositionOffset;
+                uint32_t descriptionIndex;
+                bool sync;
+        };
+
+/*A run of consecutive samples stored back to back in the file*/
+        struct Chunk{
+                uint64_t offset;
+                uint32_t firstSample;           //not a valid sample index when sampleCount is 0
+                uint32_t sampleCount;
+                uint32_t descriptionIndex;
+        };
+
+/*Expanded form of the stbl of one trak, built from stts/ctts/stss/stsc/stsz/stco/co64
+and able to write those tables back out
+*/
+        class SampleTable{
+                public:
+                        uint32_t trackId = 0;
+                        uint32_t timescale = 0;
+                        uint32_t handler = 0;
+                        bool hasCompositionOffsets = false;
+                        bool hasSyncTable = false;
+                        std::vector<Sample> samples;
+                        std::vector<Chunk> chunks;
+
+                        void parse(Atom &trak);
+                        void build(Atom &trak, uint64_t maxNarrowOffset = UINT32_MAX) const;
+                        void buildChunks(Atom &trak) const;
+                        void updateDurations(Atom &trak, uint32_t movieTimescale) const;
+                        uint64_t duration(void) const;
+                        void mergeChunks(void);
+                        void splitChunks(uint32_t duration);
+
+                        static Atom* getStbl(Atom &trak);
+        };
+
+}
+
+
+#endif // SAMPLETABLE_H
@@ -0,0 +1,204 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  SeekIndex.cpp
+* Procedures:
+* QtFastStartSTD::SeekIndex::clear      -removes every track from the index
+* QtFastStartSTD::SeekIndex::addMoov    -adds the sync samples of every trak of a moov atom
+* QtFastStartSTD::SeekIndex::findTrack  -returns a track by ID, or the first video track
+* QtFastStartSTD::SeekIndex::seek       -finds the sync sample at or before a time
+* QtFastStartSTD::SeekIndex::serialize  -writes the index as a sidecar file
+* QtFastStartSTD::SeekIndex::deserialize        -reads an index written by serialize
+***************************************************************************/
+
+#include <algorithm>
+#include "SeekIndex.hpp"
+#include "QtFastStartCPP.hpp"
+#include "Cursor.hpp"
+
+//bytes of the file header, of a track header and of a seek point
+#define INDEX_HEADER_SIZE       20
+#define TRACK_HEADER_SIZE       16
+#define POINT_SIZE              20
+
+
+/***************************************************************************
+* void QtFastStartSTD::SeekIndex::clear(void)
+* Description: removes every track from the index
+*
+* Parameters:
+**************************************************************************/
+        void QtFastStartSTD::SeekIndex::clear(void)
+        {
+                this->fileSize = 0;
+                this->tracks.clear();
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::SeekIndex::addMoov(QtFastStartSTD::Atom &moov)
+* Description: adds the sync samples of every trak of a moov atom. The chunk
+*               offsets of the moov have to be the ones of the output file
+*
+* Parameters:
+*        moov   I/P     QtFastStartSTD::Atom&   parsed moov atom
+**************************************************************************/
+        void QtFastStartSTD::SeekIndex::addMoov(QtFastStartSTD::Atom &moov)
+        {
+                for(Atom &trak : moov.children){
+                        if(trak.type != TRAK_ATOM)
+                                continue;
+                        SampleTable table;
+                        table.parse(trak);
+
+                        SeekTrack track;
+                        track.trackId = table.trackId;
+                        track.timescale = table.timescale;
+                        track.handler = table.handler;
+                        for(uint32_t i = 0; i < table.samples.size(); i++){
+                                const Sample &s = table.samples[i];
+                                if(s.sync)
+                                        track.points.push_back({s.decodeTime, s.offset, i});
+                        }
+                        this->tracks.push_back(std::move(track));
+                }
+        }
+
+/***************************************************************************
+* const QtFastStartSTD::SeekTrack* QtFastStartSTD::SeekIndex::findTrack(uint32_t trackId) const
+* Description: returns a track by ID. ID 0 selects the first video track, or
+*               the first track with samples if there is no video
+*
+* Parameters:
+*        trackId        I/P     uint32_t        track ID from the tkhd, or 0
+*        findTrack      O/P     const QtFastStartSTD::SeekTrack*        the track, or nullptr if missing
+**************************************************************************/
+        const QtFastStartSTD::SeekTrack* QtFastStartSTD::SeekIndex::findTrack(uint32_t trackId) const
+        {
+                const SeekTrack* fallback = nullptr;
+                for(const SeekTrack &t : this->tracks){
+                        if(trackId != 0 && t.trackId == trackId)
+                                return &t;
+                        if(trackId == 0 && !t.points.empty()){
+                                if(t.handler == VIDE_HANDLER)
+                                        return &t;
+                                if(!fallback)
+                                        fallback = &t;
+                        }
+                }
+                return fallback;
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::SeekIndex::seek(uint32_t trackId, uint64_t milliseconds, QtFastStartSTD::SeekPoint *point) const
+* Description: finds the sync sample at or before a decode time with a binary
+*               search. Times before the first sync sample give the first one
+*
+* Parameters:
+*        trackId        I/P     uint32_t        track to seek in, 0 for the first video track
+*        milliseconds   I/P     uint64_t        time to seek to
+*        point  O/P     QtFastStartSTD::SeekPoint*      the sync sample found
+*        seek   O/P     bool    false if the track does not exist or has no samples
+**************************************************************************/
+        bool QtFastStartSTD::SeekIndex::seek(uint32_t trackId, uint64_t milliseconds, QtFastStartSTD::SeekPoint *point) const
+        {
+                const SeekTrack* track = findTrack(trackId);
+                if(!track || track->points.empty())
+                        return false;
+                uint64_t time = milliseconds / 1000 * track->timescale + milliseconds % 1000 * track->timescale / 1000;
+                auto it = std::upper_bound(track->points.begin(), track->points.end(), time,
+                                [](uint64_t t, const SeekPoint &p){ return t < p.decodeTime; });
+                *point = it == track->points.begin() ? *it : *(it - 1);
+                return true;
+        }
+
+/***************************************************************************
+* std::vector<byte> QtFastStartSTD::SeekIndex::serialize(void) const
+* Description: writes the index as a sidecar file. All fields are big endian:
+*               magic, version, file size and track count, then for every
+*               track its ID, timescale, handler and point count followed by
+*               the decode time, offset and sample number of each point
+*
+* Parameters:
+*        serialize      O/P     std::vector<byte>       the serialized index
+**************************************************************************/
+        std::vector<byte> QtFastStartSTD::SeekIndex::serialize(void) const
+        {
+                uint64_t size = INDEX_HEADER_SIZE;
+                for(const SeekTrack &t : this->tracks)
+                        size += TRACK_HEADER_SIZE + (uint64_t)t.points.size() * POINT_SIZE;
+
+                std::vector<byte> out(size);
+                BYTEBUFFER::BigEndianRawCursor c(out.data(), size);
+                c.putUint_32(SEEK_INDEX_MAGIC);
+                c.putUint_32(SEEK_INDEX_VERSION);
+                c.putUint_64(this->fileSize);
+                c.putUint_32(this->tracks.size());
+                for(const SeekTrack &t : this->tracks){
+                        c.putUint_32(t.trackId);
+                        c.putUint_32(t.timescale);
+                        c.putUint_32(be32toh(t.handler));
+                        c.putUint_32(t.points.size());
+                        for(const SeekPoint &p : t.points){
+                                c.putUint_64(p.decodeTime);
+                                c.putUint_64(p.offset);
+                                c.putUint_32(p.sample);
+                        }
+                }
+                return out;
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::SeekIndex::deserialize(const byte* in, uint64_t len)
+* Description: reads an index written by serialize, replacing the contents
+*
+* Parameters:
+*        in     I/P     const byte*     serialized index
+*        len    I/P     uint64_t        its length
+*        deserialize    O/P     bool    false if the data is not a valid index, which leaves the index empty
+**************************************************************************/
+        bool QtFastStartSTD::SeekIndex::deserialize(const byte* in, uint64_t len)
+        {
+                clear();
+                //the cursor only reads, every range is checked before it is walked
+                BYTEBUFFER::BigEndianRawCursor c(const_cast<byte*>(in), len);
+                if(len < INDEX_HEADER_SIZE || c.getUint_32() != SEEK_INDEX_MAGIC || c.getUint_32() != SEEK_INDEX_VERSION)
+                        return false;
+                this->fileSize = c.getUint_64();
+                uint32_t trackCount = c.getUint_32();
+                for(uint32_t i = 0; i < trackCount; i++){
+                        if(!c.fits(c.getPosition(), 1, TRACK_HEADER_SIZE)){
+                                clear();
+                                return false;
+                        }
+                        SeekTrack t;
+                        t.trackId = c.getUint_32();
+                        t.timescale = c.getUint_32();
+                        t.handler = htobe32(c.getUint_32());
+                        uint32_t points = c.getUint_32();
+                        if(!c.fits(c.getPosition(), points, POINT_SIZE)){
+                                clear();
+                                return false;
+                        }
+                        t.points.resize(points);
+                        for(SeekPoint &p : t.points){
+                                p.decodeTime = c.getUint_64();
+                                p.offset = c.getUint_64();
+                                p.sample = c.getUint_32();
+                        }
+                        this->tracks.push_back(std::move(t));
+                }
+                return true;
+        }
@@ -0,0 +1,64 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <stdint.h>
+#include <vector>
+#include "Atom.hpp"
+#include "SampleTable.hpp"
+
+//first bytes of a serialized index, "QTSI"
+#define SEEK_INDEX_MAGIC        0x51545349
+#define SEEK_INDEX_VERSION      1
+
+
+namespace QtFastStartSTD{
+
+/*A sync sample, the only places playback can start from*/
+        struct SeekPoint{
+                uint64_t decodeTime;    //in the track's timescale
+                uint64_t offset;        //byte offset of the sample in the output file
+                uint32_t sample;        //zero based sample number
+        };
+
+        struct SeekTrack{
+                uint32_t trackId = 0;
+                uint32_t timescale = 0;
+                uint32_t handler = 0;
+                std::vector<SeekPoint> points;  //in decode order
+        };
+
+/*Maps a time to the sync sample at or before it and that sample's byte offset
+in the output file. Filled in when QtFastStartOptions::index points to one, and
+can be saved next to the file so seeks do not need to parse the moov again*/
+        class SeekIndex{
+                public:
+                        uint64_t fileSize = 0;  //size of the output file
+                        std::vector<SeekTrack> tracks;
+
+                        void clear(void);
+                        void addMoov(Atom &moov);
+                        const SeekTrack* findTrack(uint32_t trackId) const;
+                        bool seek(uint32_t trackId, uint64_t milliseconds, SeekPoint *point) const;
+                        std::vector<byte> serialize(void) const;
+                        bool deserialize(const byte* in, uint64_t len);
+        };
+
+}
+
+
+#endif // SEEKINDEX_H
@@ -0,0 +1,92 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Stats.cpp
+* Procedures:
+* QtFastStartSTD::QtFastStartStats::toJson      -returns the counters as a JSON object
+* QtFastStartSTD::QtFastStartStats::phaseName   -returns the JSON name of a phase
+* QtFastStartSTD::QtFastStartStats::fallbackName        -returns the JSON name of a fallback reason
+***************************************************************************/
+
+#include <sstream>
+#include "Stats.hpp"
+
+
+/***************************************************************************
+* std::string QtFastStartSTD::QtFastStartStats::toJson(void) const
+* Description: returns the counters as a JSON object
+*
+* Parameters:
+*        toJson O/P     std::string     JSON text, without a trailing newline
+**************************************************************************/
+        std::string QtFastStartSTD::QtFastStartStats::toJson(void) const
+        {
+                std::stringstream ss;
+                ss << "{\"phases_ns\": {";
+                for(int p = 0; p < PHASE_COUNT; p++){
+                        ss << (p ? ", " : "") << "\"" << phaseName((StatsPhase)p) << "\": " << this->phaseNs[p];
+                }
+                ss << "}, \"bytes_read\": " << this->bytesRead
+                   << ", \"bytes_written\": " << this->bytesWritten
+                   << ", \"bytes_copied\": " << this->bytesCopied
+                   << ", \"allocations\": " << this->allocations
+                   << ", \"peak_bytes\": " << this->peakBytes
+                   << ", \"entries_patched\": " << this->entriesPatched
+                   << ", \"cache_hit\": " << (this->cacheHit ? "true" : "false")
+                   << ", \"fallback\": \"" << fallbackName(this->fallback) << "\"}";
+                return ss.str();
+        }
+
+/***************************************************************************
+* const char* QtFastStartSTD::QtFastStartStats::phaseName(QtFastStartSTD::StatsPhase phase)
+* Description: returns the JSON name of a phase
+*
+* Parameters:
+*        phase  I/P     QtFastStartSTD::StatsPhase      the phase
+*        phaseName      O/P     const char*     its name
+**************************************************************************/
+        const char* QtFastStartSTD::QtFastStartStats::phaseName(QtFastStartSTD::StatsPhase phase)
+        {
+                switch(phase){
+                        case PHASE_SCAN:        return "scan";
+                        case PHASE_MOOV_READ:   return "moov_read";
+                        case PHASE_PATCH:       return "patch";
+                        case PHASE_COPY:        return "copy";
+                        default:                return "unknown";
+                }
+        }
+
+/***************************************************************************
+* const char* QtFastStartSTD::QtFastStartStats::fallbackName(QtFastStartSTD::FallbackReason reason)
+* Description: returns the JSON name of a fallback reason
+*
+* Parameters:
+*        reason I/P     QtFastStartSTD::FallbackReason  the reason
+*        fallbackName   O/P     const char*     its name
+**************************************************************************/
+        const char* QtFastStartSTD::QtFastStartStats::fallbackName(QtFastStartSTD::FallbackReason reason)
+        {
+                switch(reason){
+                        case FALLBACK_NONE:                     return "none";
+                        case FALLBACK_BAD_ATOM_SIZES:           return "bad_atom_sizes";
+                        case FALLBACK_NOT_QUICKTIME:            return "not_quicktime";
+                        case FALLBACK_NO_MOOV:                  return "no_moov";
+                        case FALLBACK_DUPLICATE_MOOV:           return "duplicate_moov";
+                        case FALLBACK_ALREADY_FASTSTART:        return "already_faststart";
+                        case FALLBACK_ALREADY_FRAGMENTED:       return "already_fragmented";
+                        default:                                return "unknown";
+                }
+        }
@@ -0,0 +1,95 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <string>
+#include <chrono>
+
+
+namespace QtFastStartSTD{
+
+        enum StatsPhase{
+        //phases of a conversion, in the order they run
+                PHASE_SCAN = 0,         //walking the top-level atoms
+                PHASE_MOOV_READ,        //loading (and decompressing) the moov
+                PHASE_PATCH,            //rewriting the sample tables
+                PHASE_COPY,             //writing the output
+                PHASE_COUNT
+        };
+
+        enum FallbackReason{
+        //why the input was passed through unchanged
+                FALLBACK_NONE = 0,              //the file was converted
+                FALLBACK_BAD_ATOM_SIZES,        //top-level atom sizes do not add up to the file size
+                FALLBACK_NOT_QUICKTIME,         //a top-level atom type is not printable
+                FALLBACK_NO_MOOV,               //there is no moov atom
+                FALLBACK_DUPLICATE_MOOV,        //there is more than one moov atom
+                FALLBACK_ALREADY_FASTSTART,     //the moov already is in front of the media data
+                FALLBACK_ALREADY_FRAGMENTED     //fragmented output was asked for a fragmented file
+        };
+
+/*Counters of one conversion, filled in when QtFastStartOptions::stats points to one.
+Allocations only cover the conversion buffers (moov, ftyp and output), not small
+bookkeeping containers*/
+        struct QtFastStartStats{
+                uint64_t phaseNs[PHASE_COUNT] = {0};
+                uint64_t bytesRead = 0;         //bytes loaded from the input into conversion buffers
+                uint64_t bytesWritten = 0;      //bytes written to the output, 0 when it references the input
+                uint64_t bytesCopied = 0;       //bytes copied from the input to the output unchanged
+                uint64_t allocations = 0;
+                uint64_t peakBytes = 0;
+                uint64_t entriesPatched = 0;    //chunk offsets rewritten
+                bool cacheHit = false;          //the patched moov came from the moov cache
+                FallbackReason fallback = FALLBACK_NONE;
+
+                std::string toJson(void) const;
+                static const char* phaseName(StatsPhase phase);
+                static const char* fallbackName(FallbackReason reason);
+        };
+
+/*Adds the time from construction to stop() or destruction to one phase. Does
+not even read the clock when there are no stats*/
+        class PhaseTimer{
+                private:
+                        QtFastStartStats *stats;
+                        StatsPhase phase;
+                        std::chrono::steady_clock::time_point start;
+
+                public:
+                        PhaseTimer(QtFastStartStats *stats, StatsPhase phase) : stats(stats), phase(phase)
+                        {
+                                if(stats)
+                                        start = std::chrono::steady_clock::now();
+                        }
+
+                        void stop(void)
+                        {
+                                if(!stats)
+                                        return;
+                                stats->phaseNs[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                        std::chrono::steady_clock::now() - start).count();
+                                stats = nullptr;
+                        }
+
+                        ~PhaseTimer(void){stop();}
+        };
+
+}
+
+
+#endif // STATS_H
@@ -0,0 +1,47 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Status.cpp
+* Procedures:
+* QtFastStartSTD::QtFastStartResult::statusName -returns the name of a status
+***************************************************************************/
+
+#include "Status.hpp"
+
+
+/***************************************************************************
+* const char* QtFastStartSTD::QtFastStartResult::statusName(QtFastStartSTD::QtFastStartStatus status)
+* Description: returns the name of a status
+*
+* Parameters:
+*        status I/P     QtFastStartSTD::QtFastStartStatus       the status
+*        statusName     O/P     const char*     its name
+**************************************************************************/
+        const char* QtFastStartSTD::QtFastStartResult::statusName(QtFastStartSTD::QtFastStartStatus status)
+        {
+                switch(status){
+                        case STATUS_OK:                 return "ok";
+                        case STATUS_BAD_ATOM_SIZE:      return "bad_atom_size";
+                        case STATUS_MALFORMED_ATOM:     return "malformed_atom";
+                        case STATUS_COMPRESSED_MOOV:    return "compressed_moov";
+                        case STATUS_OUT_OF_BOUNDS:      return "out_of_bounds";
+                        case STATUS_ALLOC_FAIL:         return "alloc_fail";
+                        case STATUS_CANCELLED:          return "cancelled";
+                        case STATUS_DEADLINE_EXCEEDED:  return "deadline_exceeded";
+                        case STATUS_LIMIT_EXCEEDED:     return "limit_exceeded";
+                        default:                        return "internal";
+                }
+        }
@@ -0,0 +1,58 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdint.h>
+
+//offset of a result that is not tied to a position in the input
+#define STATUS_NO_OFFSET        UINT64_MAX
+
+
+namespace QtFastStartSTD{
+
+        enum QtFastStartStatus{
+        //outcome of a conversion
+                STATUS_OK = 0,                  //converted, or passed through unchanged
+                STATUS_BAD_ATOM_SIZE,           //atom sizes do not add up to their parent
+                STATUS_MALFORMED_ATOM,          //an atom's contents are inconsistent
+                STATUS_COMPRESSED_MOOV,         //the moov is compressed with something other than zlib
+                STATUS_OUT_OF_BOUNDS,           //a field lies outside of the buffer holding it
+                STATUS_ALLOC_FAIL,              //a conversion buffer could not be allocated
+                STATUS_CANCELLED,               //the cancel flag was set
+                STATUS_DEADLINE_EXCEEDED,       //the deadline passed
+                STATUS_LIMIT_EXCEEDED,          //the input needs more than a configured limit allows
+                STATUS_INTERNAL                 //any other failure
+        };
+
+/*Status of a conversion with the input offset it was detected at. message is a
+static string, never freed*/
+        struct QtFastStartResult{
+                QtFastStartStatus status = STATUS_OK;
+                uint64_t offset = STATUS_NO_OFFSET;
+                const char* message = nullptr;
+
+                QtFastStartResult(void){}
+                QtFastStartResult(QtFastStartStatus status, uint64_t offset, const char* message)
+                        : status(status), offset(offset), message(message){}
+                bool ok(void) const{return this->status == STATUS_OK;}
+                static const char* statusName(QtFastStartStatus status);
+        };
+
+}
+
+
+#endif // STATUS_H
@@ -0,0 +1,214 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Trim.cpp
+* Procedures:
+* QtFastStartSTD::QtFastStart::trimTracks       -cuts the sample tables of every track to the trim range
+* trimStart     -returns the decode time, in seconds, the trimmed clip starts at
+* cutTrack      -keeps only the samples of a track that fall into a time range
+* trimEditList  -fits the edit list of a trak to its trimmed duration
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+
+#include <limits>
+#include "QtFastStartCPP.hpp"
+#include "SampleTable.hpp"
+
+
+namespace{
+
+        using QtFastStartSTD::Atom;
+        using QtFastStartSTD::Chunk;
+        using QtFastStartSTD::Sample;
+        using QtFastStartSTD::SampleTable;
+
+/***************************************************************************
+* long double trimStart(const std::vector<SampleTable> &tracks, uint64_t start)
+* Description: returns the decode time, in seconds, the trimmed clip starts
+*               at: the last sync sample at or before the requested start in
+*               the first video track, or in the first track with samples if
+*               there is no video
+*
+* Parameters:
+*        tracks I/P     const std::vector<SampleTable>& sample tables of every track
+*        start  I/P     uint64_t        requested start in milliseconds
+*        trimStart      O/P     long double     start of the clip in seconds
+**************************************************************************/
+        long double trimStart(const std::vector<SampleTable> &tracks, uint64_t start)
+        {
+                const SampleTable* ref = nullptr;
+                for(const SampleTable &t : tracks){
+                        if(t.handler == VIDE_HANDLER && !t.samples.empty() && t.timescale){
+                                ref = &t;
+                                break;
+                        }
+                }
+                for(uint32_t i = 0; !ref && i < tracks.size(); i++){
+                        if(!tracks[i].samples.empty() && tracks[i].timescale)
+                                ref = &tracks[i];
+                }
+                if(!ref)
+                        return 0;
+
+                uint64_t ticks = start * ref->timescale / 1000;
+                uint64_t snapped = ref->samples[0].decodeTime;
+                for(const Sample &s : ref->samples){
+                        if(s.decodeTime > ticks)
+                                break;
+                        if(s.sync)
+                                snapped = s.decodeTime;
+                }
+                return (long double)snapped / ref->timescale;
+        }
+
+/***************************************************************************
+* void cutTrack(SampleTable &track, long double start, long double end)
+* Description: keeps only the samples of a track that overlap a time range,
+*               starting earlier at a sync sample if the first one is not.
+*               Chunks are cut to the kept samples and point at the input
+*               offset of their first one, decode times start at 0
+*
+* Parameters:
+*        track  I/O     SampleTable&    track to cut
+*        start  I/P     long double     start of the range in seconds
+*        end    I/P     long double     end of the range in seconds
+**************************************************************************/
+        void cutTrack(SampleTable &track, long double start, long double end)
+        {
+                uint32_t n = track.samples.size();
+                uint32_t first = n, last = n;
+                if(track.timescale){
+                        long double from = start * track.timescale;
+                        long double to = end * track.timescale;
+                        first = 0;
+                        while(first < n && (long double)(track.samples[first].decodeTime + track.samples[first].duration) <= from)
+                                first++;
+                        //decoding has to begin at a sync sample
+                        while(first > 0 && first < n && !track.samples[first].sync)
+                                first--;
+                        last = first;
+                        while(last < n && (long double)track.samples[last].decodeTime < to)
+                                last++;
+                }
+                if(first >= last){
+                        track.samples.clear();
+                        track.chunks.clear();
+                        return;
+                }
+
+                std::vector<Chunk> chunks;
+                for(const Chunk &ch : track.chunks){
+                        uint32_t lo = ch.firstSample > first ? ch.firstSample : first;
+                        uint32_t hi = ch.firstSample + ch.sampleCount < last ? ch.firstSample + ch.sampleCount : last;
+                        if(lo < hi)
+                                chunks.push_back({track.samples[lo].offset, lo - first, hi - lo, ch.descriptionIndex});
+                }
+                track.chunks.swap(chunks);
+
+                uint64_t base = track.samples[first].decodeTime;
+                track.samples.erase(track.samples.begin() + last, track.samples.end());
+                track.samples.erase(track.samples.begin(), track.samples.begin() + first);
+                for(Sample &s : track.samples)
+                        s.decodeTime -= base;
+        }
+
+/***************************************************************************
+* void trimEditList(Atom &trak, uint64_t duration)
+* Description: fits the edit list of a trak to its trimmed duration. A single
+*               edit keeps its media time, which shifts out the composition
+*               delay, and only gets the new length. Longer edit lists
+*               describe the untrimmed timeline and are removed
+*
+* Parameters:
+*        trak   I/O     Atom&   trak atom to rewrite
+*        duration       I/P     uint64_t        trimmed track duration in the movie timescale
+**************************************************************************/
+        void trimEditList(Atom &trak, uint64_t duration)
+        {
+                Atom* edts = trak.find(EDTS_ATOM);
+                if(!edts)
+                        return;
+                Atom* elst = edts->find(ELST_ATOM);
+                if(!elst || elst->data.size() < 8 || elst->getUint_32(4) != 1){
+                        trak.remove(EDTS_ATOM);
+                        return;
+                }
+                if(elst->getUint_8(0) == 1)
+                        elst->setUint_64(8, duration);
+                else
+                        elst->setUint_32(8, duration > UINT32_MAX ? UINT32_MAX : (uint32_t)duration);
+        }
+
+}
+
+
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::trimTracks(QtFastStartSTD::Atom &moov, std::vector<QtFastStartSTD::SampleTable> &tracks)
+* Description: cuts the sample tables of every track to the trim range. The
+*               range starts at the last sync sample at or before the
+*               requested start, so the clip decodes without re-encoding.
+*               The per-sample tables that build() does not rewrite are
+*               removed, and the track, movie and edit list durations are
+*               set to the clip. The caller builds the sample tables and
+*               copies only the chunks that are left
+*
+* Parameters:
+*        moov   I/O     QtFastStartSTD::Atom&   uncompressed moov atom
+*        tracks I/O     std::vector<QtFastStartSTD::SampleTable>&       sample tables of the traks of the moov, in order
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::trimTracks(QtFastStartSTD::Atom &moov, std::vector<QtFastStartSTD::SampleTable> &tracks)
+        {
+                const uint32_t perSample[] = {SDTP_ATOM, STPS_ATOM, SBGP_ATOM, SUBS_ATOM};
+                long double start = trimStart(tracks, this->options.trimStart);
+                long double end = this->options.trimLength
+                                ? (long double)(this->options.trimStart + this->options.trimLength) / 1000
+                                : std::numeric_limits<long double>::infinity();
+
+                Atom* mvhd = moov.find(MVHD_ATOM);
+                if(!mvhd)
+                        throw Malformed_Atom("moov atom is missing mvhd\n");
+                uint32_t movieTimescale = mvhd->getUint_32(mvhd->getUint_8(0) == 1 ? 20 : 12);
+
+                uint64_t movieDuration = 0;
+                uint32_t t = 0;
+                for(Atom &trak : moov.children){
+                        if(trak.type != TRAK_ATOM)
+                                continue;
+                        SampleTable &track = tracks[t++];
+                        cutTrack(track, start, end);
+                        Atom* stbl = SampleTable::getStbl(trak);
+                        for(uint32_t type : perSample)
+                                stbl->remove(type);
+                        track.updateDurations(trak, movieTimescale);
+                        uint64_t duration = track.timescale ? track.duration() * movieTimescale / track.timescale : 0;
+                        trimEditList(trak, duration);
+                        if(duration > movieDuration)
+                                movieDuration = duration;
+                }
+                if(mvhd->getUint_8(0) == 1)
+                        mvhd->setUint_64(24, movieDuration);
+                else
+                        mvhd->setUint_32(16, movieDuration > UINT32_MAX ? UINT32_MAX : (uint32_t)movieDuration);
+#ifdef DEBUG
+                std::cout << "trimmed to " << (double)start << "s - " << (double)end << "s, "
+                        << movieDuration << " movie ticks" << std::endl;
+#endif // DEBUG
+        }
@@ -0,0 +1,238 @@
+/**
+    MOV QT FastStart Implementation library
+    Copyright (C) 2022  SkibbleBip
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+/***************************************************************************
+* File:  Validate.cpp
+* Procedures:
+* QtFastStartSTD::validateFastStart     -checks the structure of a fast-start file without reading its media data
+* QtFastStartSTD::mediaSize     -returns the summed payload size of the mdat atoms of a file
+* findStray     -returns the first chunk offset of a table that lies outside of every mdat
+* validateAtoms -checks that the atoms of a range nest and that their chunk offsets land in an mdat
+***************************************************************************/
+
+//#define DEBUG
+
+#ifdef DEBUG
+#include <iostream>
+#endif // DEBUG
+
+#include <new>
+#include <memory>
+#include <algorithm>
+#include "QtFastStartCPP.hpp"
+#include "Cursor.hpp"
+
+
+namespace{
+
+        using QtFastStartSTD::AtomRange;
+        using QtFastStartSTD::QtFastStartResult;
+
+/*Where the payload of an mdat atom lies in the file*/
+        struct Payload{
+                uint64_t begin;
+                uint64_t end;
+        };
+
+/***************************************************************************
+* uint64_t findStray(const byte* table, uint64_t count, bool wide, const std::vector<Payload> &mdats)
+* Description: returns the first chunk offset of a table that lies outside of
+*               every mdat payload. The smallest and largest offsets are found
+*               in one branch free pass, which the compiler vectorizes, and
+*               only a table that spans more than one mdat is then checked
+*               entry by entry
+*
+* Parameters:
+*        table  I/P     const byte*     first entry of a stco or co64 table
+*        count  I/P     uint64_t        number of entries
+*        wide   I/P     bool    whether the entries are 64 bit
+*        mdats  I/P     const std::vector<Payload>&     mdat payloads, in file order
+*        findStray      O/P     uint64_t        index of the first stray entry, count if there is none
+**************************************************************************/
+        uint64_t findStray(const byte* table, uint64_t count, bool wide, const std::vector<Payload> &mdats)
+        {
+                if(count == 0)
+                        return count;
+                uint64_t lo = UINT64_MAX, hi = 0;
+                if(wide){
+                        for(uint64_t i = 0; i < count; i++){
+                                uint64_t v = BYTEBUFFER::BigEndian::load64(&table[i * 8]);
+                                lo = v < lo ? v : lo;
+                                hi = v > hi ? v : hi;
+                        }
+                }
+                else{
+                        uint32_t lo32 = UINT32_MAX, hi32 = 0;
+                        for(uint64_t i = 0; i < count; i++){
+                                uint32_t v = BYTEBUFFER::BigEndian::load32(&table[i * 4]);
+                                lo32 = v < lo32 ? v : lo32;
+                                hi32 = v > hi32 ? v : hi32;
+                        }
+                        lo = lo32;
+                        hi = hi32;
+                }
+                for(const Payload &m : mdats){
+                        if(lo >= m.begin && hi < m.end)
+                                return count;
+                }
+
+                for(uint64_t i = 0; i < count; i++){
+                        uint64_t v = wide ? BYTEBUFFER::BigEndian::load64(&table[i * 8]) : BYTEBUFFER::BigEndian::load32(&table[i * 4]);
+                        std::vector<Payload>::const_iterator it = std::upper_bound(mdats.begin(), mdats.end(), v,
+                                        [](uint64_t off, const Payload &m){ return off < m.begin; });
+                        if(it == mdats.begin() || v >= (it - 1)->end)
+                                return i;
+                }
+                return count;
+        }
+
+/***************************************************************************
+* QtFastStartResult validateAtoms(const byte* in, uint64_t begin, uint64_t end, const std::vector<Payload> &mdats, uint64_t base)
+* Description: checks that the atoms of a range nest, descending into
+*               container atoms, and that the entries of every stco and co64
+*               atom land inside an mdat
+*
+* Parameters:
+*        in     I/P     const byte*     buffer holding the range
+*        begin  I/P     uint64_t        offset of the first atom
+*        end    I/P     uint64_t        offset one past the last atom
+*        mdats  I/P     const std::vector<Payload>&     mdat payloads of the file
+*        base   I/P     uint64_t        file offset of in[0], STATUS_NO_OFFSET if in is not part of the file
+*        validateAtoms  O/P     QtFastStartResult       the first problem found, with its file offset
+**************************************************************************/
+        QtFastStartResult validateAtoms(const byte* in, uint64_t begin, uint64_t end, const std::vector<Payload> &mdats, uint64_t base)
+        {
+                std::vector<AtomRange> atoms;
+                if(!QtFastStartSTD::scanAtoms(in, begin, end, atoms))
+                        return QtFastStartResult(QtFastStartSTD::STATUS_BAD_ATOM_SIZE, base == STATUS_NO_OFFSET ? base : base + begin,
+                                        "Atom sizes do not add up to their parent\n");
+
+                for(const AtomRange &r : atoms){
+                        uint64_t at = base == STATUS_NO_OFFSET ? base : base + r.offset;
+                        if(QtFastStartSTD::Atom::isContainer(r.type)){
+                                QtFastStartResult res = validateAtoms(in, r.offset + r.headerSize, r.offset + r.size, mdats, base);
+                                if(!res.ok())
+                                        return res;
+                        }
+                        else if(r.type == STCO_ATOM || r.type == CO64_ATOM){
+                                bool wide = r.type == CO64_ATOM;
+                                uint64_t payload = r.size - r.headerSize;
+                                BYTEBUFFER::BigEndianRawCursor c(const_cast<byte*>(&in[r.offset + r.headerSize]), payload);
+                                if(payload < 8 || !c.fits(8, c.getUint_32(4), wide ? 8 : 4))
+                                        return QtFastStartResult(QtFastStartSTD::STATUS_MALFORMED_ATOM, at, "Bad atom size/element count\n");
+                                uint64_t count = c.getUint_32(4);
+                                const byte* table = &in[r.offset + r.headerSize + 8];
+                                uint64_t stray = findStray(table, count, wide, mdats);
+                                if(stray != count){
+                                        uint64_t entry = base == STATUS_NO_OFFSET ? base : at + r.headerSize + 8 + stray * (wide ? 8 : 4);
+                                        return QtFastStartResult(QtFastStartSTD::STATUS_OUT_OF_BOUNDS, entry,
+                                                        "Chunk offset outside of every mdat atom\n");
+                                }
+                        }
+                }
+                return QtFastStartResult();
+        }
+
+}
+
+
+/***************************************************************************
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::validateFastStart(const byte* data, uint64_t len, uint64_t expectedMedia)
+* Description: checks the structure of a fast-start file: the top-level atom
+*               sizes add up to the file size, there is one moov and it comes
+*               before the first mdat, the atoms of the moov nest, and every
+*               stco and co64 entry points into an mdat payload. Only the
+*               atom headers and the moov are read, never the media data.
+*               The file size itself is no invariant, reusing free space and
+*               (de)compressing the moov change it, so the mdat payloads are
+*               compared instead
+*
+* Parameters:
+*        data   I/P     const byte*     file to check
+*        len    I/P     uint64_t        its size
+*        expectedMedia  I/P     uint64_t        bytes the mdat payloads have to add up to, 0 to skip the check
+*        validateFastStart      O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, or the first problem
+*                                       found with its offset in the file
+**************************************************************************/
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::validateFastStart(const byte* data, uint64_t len, uint64_t expectedMedia) noexcept
+        {
+                try{
+                        std::vector<AtomRange> top;
+                        if(!scanAtoms(data, 0, len, top))
+                                return QtFastStartResult(STATUS_BAD_ATOM_SIZE, top.empty() ? 0 : top.back().offset + top.back().size,
+                                                "Top-level atom sizes do not add up to the file size\n");
+
+                        const AtomRange* moov = nullptr;
+                        std::vector<Payload> mdats;
+                        for(const AtomRange &r : top){
+                                if(r.type == MOOV_ATOM){
+                                        if(moov)
+                                                return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "More than one moov atom\n");
+                                        if(!mdats.empty())
+                                                return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "moov atom is behind the media data\n");
+                                        moov = &r;
+                                }
+                                else if(r.type == MDAT_ATOM)
+                                        mdats.push_back({r.offset + r.headerSize, r.offset + r.size});
+                        }
+                        if(!moov)
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, STATUS_NO_OFFSET, "No moov atom\n");
+                        if(expectedMedia != 0 && mediaSize(top) != expectedMedia)
+                                return QtFastStartResult(STATUS_BAD_ATOM_SIZE, STATUS_NO_OFFSET, "mdat atoms differ in size from the input\n");
+
+                        //a compressed moov is checked after inflating, its problems point to the cmov
+                        if(isCompressedMoov(&data[moov->offset], moov->size, moov->headerSize)){
+                                std::unique_ptr<BYTEBUFFER::ByteBuffer> plain(inflateMoov(&data[moov->offset], moov->size, moov->headerSize));
+                                uint64_t plainLen = plain->getLimit();
+                                uint32_t headerSize = plain->getUint_32(0) == 1 ? 16 : ATOM_PREAMBLE_SIZE;
+                                QtFastStartResult res = validateAtoms(plain->getData(), headerSize, plainLen, mdats, STATUS_NO_OFFSET);
+                                if(!res.ok())
+                                        res.offset = moov->offset;
+                                return res;
+                        }
+                        return validateAtoms(data, moov->offset + moov->headerSize, moov->offset + moov->size, mdats, 0);
+                }
+                catch(const Compressed_Moov&){
+                        return QtFastStartResult(STATUS_COMPRESSED_MOOV, STATUS_NO_OFFSET, "Unsupported moov compression\n");
+                }
+                catch(const Malformed_Atom &e){
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, STATUS_NO_OFFSET, e.what());
+                }
+                catch(const std::bad_alloc&){
+                        return QtFastStartResult(STATUS_ALLOC_FAIL, STATUS_NO_OFFSET, "Failed to malloc/realloc data\n");
+                }
+                catch(...){
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, STATUS_NO_OFFSET, "Malformed moov atom\n");
+                }
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::mediaSize(const std::vector<QtFastStartSTD::AtomRange> &top)
+* Description: returns the summed payload size of the mdat atoms of a file,
+*               which a fast-start conversion keeps byte for byte
+*
+* Parameters:
+*        top    I/P     const std::vector<QtFastStartSTD::AtomRange>&   top-level atoms of the file
+*        mediaSize      O/P     uint64_t        bytes of media data
+**************************************************************************/
+        uint64_t QtFastStartSTD::mediaSize(const std::vector<QtFastStartSTD::AtomRange> &top)
+        {
+                uint64_t total = 0;
+                for(const AtomRange &r : top){
+                        if(r.type == MDAT_ATOM)
+                                total += r.size - r.headerSize;
+                }
+                return total;
+        }
@@ -19,8 +19,43 @@
 * Procedures:
 * QtFastStartSTD::readAndFill   -Overloaded function for reading from artificial file stream and fully fill a bytebuffer
 * QtFastStartSTD::readAndFill   -Overloader function to read from artificial file stream into a bytebuffer at specified position in the stream
+* QtFastStartSTD::patchChunkOffsets    -walks a range of atoms and rewrites every file offset they hold through an offset map
 * QtFastStartSTD::QtFastStart::fastStart        -Returns an artificial file stream that contains the brand new fast-start converted mp4
+* QtFastStartSTD::QtFastStart::getData  -returns the output file without copying it
+* QtFastStartSTD::QtFastStart::getLength        -returns the length of the output file
+* QtFastStartSTD::QtFastStart::noChangeNeeded   -returns whether the output is the unmodified input
 * QtFastStartSTD::QtFastStart::QtFastStart      -Constructor, takes in byte array and length of byte array as params
+* QtFastStartSTD::QtFastStart::QtFastStart      -Overloaded constructor, also takes in the options of the conversion
+* QtFastStartSTD::QtFastStart::QtFastStart      -Overloaded constructor that never throws, reports failures through a result
+* QtFastStartSTD::QtFastStart::run      -runs the conversion, turning every failure into a status
+* QtFastStartSTD::QtFastStart::getResult        -returns the status of the conversion
+* QtFastStartSTD::throwResult   -throws the exception matching a failed status
+* QtFastStartSTD::QtFastStart::passThrough      -makes the output reference the unchanged input file
+* QtFastStartSTD::QtFastStart::trackBuffer      -records a conversion buffer being allocated or freed, enforcing the memory limit
+* QtFastStartSTD::QtFastStart::checkMemory      -checks whether a buffer of the given size would exceed the memory limit
+* QtFastStartSTD::QtFastStart::moovAllowance    -returns the largest moov buffer the limits still allow
+* QtFastStartSTD::QtFastStart::scanTopLevel     -lists the top-level atoms of the input, enforcing the atom count and size limits
+* QtFastStartSTD::QtFastStart::parseMoov        -parses the moov atom of the input into a tree, inflating a compressed one
+* QtFastStartSTD::QtFastStart::applyMoovEdit    -runs the moov edit callback on a parsed moov atom
+* QtFastStartSTD::QtFastStart::dropTracks       -removes the traks selected by the drop options from a moov atom
+* QtFastStartSTD::QtFastStart::editMoov -runs the moov edit callback on the loaded moov buffer, replacing it
+* QtFastStartSTD::QtFastStart::replaceMoov      -replaces the loaded moov buffer with a serialized moov atom
+* QtFastStartSTD::QtFastStart::widenChunkOffsets        -turns the stco tables of the loaded moov that would overflow into co64
+* QtFastStartSTD::QtFastStart::indexMoov        -adds the sync samples of a moov atom to the seek index
+* QtFastStartSTD::QtFastStart::finishStats      -adds the output stream's allocations to the stats
+* QtFastStartSTD::QtFastStart::writeCached      -writes the output from a moov cache entry
+* QtFastStartSTD::QtFastStart::reuseFreeSpace   -moves the moov into padding in front of the mdat, without moving any media data
+* QtFastStartSTD::QtFastStart::fastStartInPlace -in place variant of reuseFreeSpace, operating on the caller's buffer
+* isPadding     -returns whether a top-level atom type only holds padding
+* isAtomType    -returns whether four bytes look like an atom type
+* findFreeSlot  -finds a run of padding atoms in front of the media data that the moov fits into
+* fitsField     -returns whether a value fits a big endian field of 0, 4 or 8 bytes
+* loadField     -reads a big endian field of 0, 4 or 8 bytes
+* storeField    -writes a big endian field of 0, 4 or 8 bytes
+* patchSaio     -rewrites the offsets of an saio atom through an offset map
+* patchIloc     -rewrites the extents of an iloc atom through an offset map
+* patchTfra     -rewrites the moof offsets of a tfra atom through an offset map
+* countNarrowOffsets    -counts the stco entries in a range of atoms
 * QtFastStartSTD::QtFastStart::~QtFastStart     -Destructor
 * QtFastStartSTD::QtFastStart::fastStartImpl    -performs the implementation of converting the mp4 file into a faststart mp4
 ***************************************************************************/
@@ -28,7 +63,6 @@
 
 
 //#define DEBUG
-#define ATOM_PREAMBLE_SIZE 8
 
 #ifdef DEBUG
 #include <iostream>
@@ -36,35 +70,16 @@
 //for debugging only
 
 
+#include <new>
+#include <memory>
+#include <algorithm>
 #include "QtFastStartCPP.hpp"
 #include "ArtificialFS.hpp"
+#include "Endian.hpp"
+#include "Cursor.hpp"
 
-
-
-
-#ifdef __unix__
-#include <endian.h>
-#elif defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
-/*Definitions of endian byte swapping for windows*/
-const int16_t __num = 1;
-const bool __littleEndian = (*(int8_t *)&__num == 1 ? true : false);
-
-
-    #if defined(__GNUC__ )
-    /*For GCC*/
-    #define htobe32(X) (__littleEndian ? __builtin_bswap32(X) : X)
-
-
-    #elif defined(_MSC_VER)
-    /*For MSVC*/
-    #define htobe32(X) (__littleEndian ? _byteswap_ulong(X) : X)
-
-    #endif // defined
-
-
-#else
-        #error Operating system not supported
-#endif // linux
+//chunk offsets rewritten per bulk read and write
+#define PATCH_BLOCK_ENTRIES     1024
 
 
 
@@ -116,6 +131,486 @@ const bool __littleEndian = (*(int8_t *)&__num == 1 ? true : false);
         }
 
 
+/***************************************************************************
+* static bool isPadding(uint32_t type)
+* Description: returns whether a top-level atom type only holds padding
+*
+* Parameters:
+*        type   I/P     uint32_t        atom type
+*        isPadding      O/P     bool    true for free, skip, wide and junk atoms
+**************************************************************************/
+        static bool isPadding(uint32_t type)
+        {
+                return type == FREE_ATOM || type == SKIP_ATOM || type == WIDE_ATOM || type == JUNK_ATOM;
+        }
+
+/***************************************************************************
+* static bool isAtomType(uint32_t type)
+* Description: returns whether four bytes look like an atom type, used to tell
+*               QuickTime files apart from other data that happens to parse
+*
+* Parameters:
+*        type   I/P     uint32_t        atom type, in the byte order it was read in
+*        isAtomType     O/P     bool    true if every byte is a printable character
+**************************************************************************/
+        static bool isAtomType(uint32_t type)
+        {
+                const byte* c = (const byte*)&type;
+                for(int i = 0; i < 4; i++){
+                        if((c[i] < 0x20 || c[i] > 0x7e) && c[i] != 0xa9)
+                                return false;
+                }
+                return true;
+        }
+
+/***************************************************************************
+* static bool findFreeSlot(const std::vector<QtFastStartSTD::AtomRange> &top, uint32_t *moovIndex, uint64_t *slotStart, uint64_t *slotEnd)
+* Description: finds a run of padding atoms in front of the first mdat that the
+*               moov atom fits into. The moov has to fill the run exactly or
+*               leave room for a free atom header behind it
+*
+* Parameters:
+*        top    I/P     const std::vector<QtFastStartSTD::AtomRange>&   top-level atoms of the file
+*        moovIndex      O/P     uint32_t*       index of the moov atom in top
+*        slotStart      O/P     uint64_t*       offset of the first padding atom of the run
+*        slotEnd        O/P     uint64_t*       offset one past the last padding atom of the run
+*        findFreeSlot   O/P     bool    true if a usable run was found
+**************************************************************************/
+        static bool findFreeSlot(const std::vector<QtFastStartSTD::AtomRange> &top,
+                                uint32_t *moovIndex, uint64_t *slotStart, uint64_t *slotEnd)
+        {
+                uint32_t firstMdat = top.size();
+                uint32_t moov = top.size();
+                for(uint32_t i = 0; i < top.size(); i++){
+                        if(top[i].type == MDAT_ATOM && firstMdat == top.size())
+                                firstMdat = i;
+                        else if(top[i].type == MOOV_ATOM){
+                                if(moov != top.size())
+                                        return false;
+                                moov = i;
+                        }
+                }
+                if(moov == top.size() || firstMdat == top.size() || moov < firstMdat)
+                        return false;
+
+                uint64_t moovSize = top[moov].size;
+                for(uint32_t i = 0; i < firstMdat; ){
+                        if(!isPadding(top[i].type)){
+                                i++;
+                                continue;
+                        }
+                        uint32_t j = i;
+                        uint64_t end = top[i].offset;
+                        while(j < firstMdat && isPadding(top[j].type)){
+                                end += top[j].size;
+                                j++;
+                        }
+                        uint64_t room = end - top[i].offset;
+                        if(room == moovSize || (room >= moovSize + ATOM_PREAMBLE_SIZE && room - moovSize <= UINT32_MAX)){
+                                *moovIndex = moov;
+                                *slotStart = top[i].offset;
+                                *slotEnd = end;
+                                return true;
+                        }
+                        i = j;
+                }
+                return false;
+        }
+
+/***************************************************************************
+* static bool fitsField(uint64_t value, uint32_t size)
+* Description: returns whether a value fits a big endian field of 0, 4 or 8 bytes
+*
+* Parameters:
+*        value  I/P     uint64_t        value to store
+*        size   I/P     uint32_t        size of the field in bytes
+*        fitsField      O/P     bool    true if the value can be stored without losing bits
+**************************************************************************/
+        static bool fitsField(uint64_t value, uint32_t size)
+        {
+                return size == 8 || value >> (size * 8) == 0;
+        }
+
+/***************************************************************************
+* static uint64_t loadField(const byte* p, uint32_t size)
+* Description: reads a big endian field of 0, 4 or 8 bytes, a missing field reads as 0
+*
+* Parameters:
+*        p      I/P     const byte*     start of the field
+*        size   I/P     uint32_t        size of the field in bytes
+*        loadField      O/P     uint64_t        value of the field
+**************************************************************************/
+        static uint64_t loadField(const byte* p, uint32_t size)
+        {
+                if(size == 8)
+                        return BYTEBUFFER::BigEndian::load64(p);
+                return size == 4 ? BYTEBUFFER::BigEndian::load32(p) : 0;
+        }
+
+/***************************************************************************
+* static void storeField(byte* p, uint32_t size, uint64_t value)
+* Description: writes a big endian field of 0, 4 or 8 bytes
+*
+* Parameters:
+*        p      O/P     byte*   start of the field
+*        size   I/P     uint32_t        size of the field in bytes
+*        value  I/P     uint64_t        value to write, already checked with fitsField
+**************************************************************************/
+        static void storeField(byte* p, uint32_t size, uint64_t value)
+        {
+                if(size == 8)
+                        BYTEBUFFER::BigEndian::store64(p, value);
+                else if(size == 4)
+                        BYTEBUFFER::BigEndian::store32(p, (uint32_t)value);
+        }
+
+/***************************************************************************
+* static QtFastStartSTD::QtFastStartResult patchSaio(byte* data, const QtFastStartSTD::AtomRange &r, const QtFastStartSTD::OffsetMap &offsets, uint64_t *count)
+* Description: rewrites the offsets of an saio atom through an offset map.
+*               Outside of a movie fragment they are file offsets of the
+*               sample auxiliary information, such as the CENC per sample
+*               IVs. Version 0 holds 32 bit offsets, version 1 64 bit ones
+*
+* Parameters:
+*        data   I/O     byte*   buffer holding the atom
+*        r      I/P     const QtFastStartSTD::AtomRange&        the saio atom within data
+*        offsets        I/P     const QtFastStartSTD::OffsetMap&        input to output offset mapping
+*        count  O/P     uint64_t*       number of offsets rewritten
+*        patchSaio      O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, or the failure
+*                                       with an offset relative to data
+**************************************************************************/
+        static QtFastStartSTD::QtFastStartResult patchSaio(byte* data, const QtFastStartSTD::AtomRange &r,
+                                        const QtFastStartSTD::OffsetMap &offsets, uint64_t *count)
+        {
+                using namespace QtFastStartSTD;
+                uint64_t pos = r.offset + r.headerSize;
+                uint64_t end = r.offset + r.size;
+                if(end - pos < 8)
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Malformed atom\n");
+                uint32_t version = data[pos];
+                // aux_info_type and aux_info_type_parameter follow the flags when flag 1 is set
+                uint32_t skip = (BYTEBUFFER::BigEndian::load32(&data[pos]) & 1) ? 8 : 0;
+                pos += 4;
+                if(end - pos < skip + 4)
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Malformed atom\n");
+                pos += skip;
+                uint32_t entryCount = BYTEBUFFER::BigEndian::load32(&data[pos]);
+                pos += 4;
+                uint32_t entrySize = version == 0 ? 4 : 8;
+                if(end - pos < (uint64_t)entryCount * entrySize)
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Bad atom size/element count\n");
+
+                for(uint32_t i = 0; i < entryCount; i++, pos += entrySize){
+                        uint64_t newOffset;
+                        if(!offsets.map(loadField(&data[pos], entrySize), &newOffset))
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, pos,
+                                                "Auxiliary information offset outside of the copied data\n");
+                        if(!fitsField(newOffset, entrySize))
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, pos,
+                                                "Auxiliary information offset does not fit 32 bits\n");
+                        storeField(&data[pos], entrySize, newOffset);
+                }
+                *count = entryCount;
+                return QtFastStartResult();
+        }
+
+/***************************************************************************
+* static QtFastStartSTD::QtFastStartResult patchIloc(byte* data, const QtFastStartSTD::AtomRange &r, const QtFastStartSTD::OffsetMap &offsets, uint64_t *count)
+* Description: rewrites the extents of an iloc atom through an offset map.
+*               Versions 0 to 2 are understood, with every combination of
+*               offset, length, base offset and index sizes. Only items
+*               stored in this file by file offset (construction method 0,
+*               data reference 0) are touched. An item's base offset moves
+*               with its first extent, later extents are rewritten relative
+*               to it. Unknown versions are left as they are
+*
+* Parameters:
+*        data   I/O     byte*   buffer holding the atom
+*        r      I/P     const QtFastStartSTD::AtomRange&        the iloc atom within data
+*        offsets        I/P     const QtFastStartSTD::OffsetMap&        input to output offset mapping
+*        count  O/P     uint64_t*       number of extents rewritten
+*        patchIloc      O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, or the failure
+*                                       with an offset relative to data
+**************************************************************************/
+        static QtFastStartSTD::QtFastStartResult patchIloc(byte* data, const QtFastStartSTD::AtomRange &r,
+                                        const QtFastStartSTD::OffsetMap &offsets, uint64_t *count)
+        {
+                using namespace QtFastStartSTD;
+                uint64_t pos = r.offset + r.headerSize;
+                uint64_t end = r.offset + r.size;
+                *count = 0;
+                if(end - pos < 4 || data[pos] > 2)
+                        return end - pos < 4 ? QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Malformed atom\n")
+                                                : QtFastStartResult();
+                uint32_t version = data[pos];
+                uint32_t countSize = version < 2 ? 2 : 4;
+                pos += 4;
+                if(end - pos < 2 + countSize)
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Malformed atom\n");
+                uint32_t offsetSize = data[pos] >> 4;
+                uint32_t lengthSize = data[pos] & 15;
+                uint32_t baseSize = data[pos + 1] >> 4;
+                uint32_t indexSize = version > 0 ? data[pos + 1] & 15 : 0;
+                for(uint32_t size : {offsetSize, lengthSize, baseSize, indexSize}){
+                        if(size != 0 && size != 4 && size != 8)
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, pos, "Bad iloc field size\n");
+                }
+                pos += 2;
+                uint32_t itemCount = version < 2 ? BYTEBUFFER::BigEndian::load16(&data[pos])
+                                                : BYTEBUFFER::BigEndian::load32(&data[pos]);
+                pos += countSize;
+
+                // item_ID, construction_method (versions 1 and 2), data_reference_index,
+                // base_offset and extent_count
+                uint32_t itemSize = countSize + (version > 0 ? 2 : 0) + 2 + baseSize + 2;
+                uint32_t extentSize = indexSize + offsetSize + lengthSize;
+                for(uint32_t item = 0; item < itemCount; item++){
+                        if(end - pos < itemSize)
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Bad atom size/element count\n");
+                        pos += countSize;
+                        uint32_t method = 0;
+                        if(version > 0){
+                                method = BYTEBUFFER::BigEndian::load16(&data[pos]) & 15;
+                                pos += 2;
+                        }
+                        uint32_t dataReference = BYTEBUFFER::BigEndian::load16(&data[pos]);
+                        pos += 2;
+                        uint64_t basePos = pos;
+                        uint64_t base = loadField(&data[pos], baseSize);
+                        pos += baseSize;
+                        uint32_t extentCount = BYTEBUFFER::BigEndian::load16(&data[pos]);
+                        pos += 2;
+                        if(end - pos < (uint64_t)extentCount * extentSize)
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Bad atom size/element count\n");
+
+                        //items in idat, in other items or in other files, and items without any offset, stay
+                        if(method == 0 && dataReference == 0 && (baseSize || offsetSize)){
+                                uint64_t newBase = base;
+                                for(uint32_t i = 0; i < extentCount; i++){
+                                        uint64_t at = pos + (uint64_t)i * extentSize + indexSize;
+                                        uint64_t extent = loadField(&data[at], offsetSize);
+                                        uint64_t newOffset;
+                                        if(!offsets.map(base + extent, &newOffset))
+                                                return QtFastStartResult(STATUS_MALFORMED_ATOM, at,
+                                                                "Item offset outside of the copied data\n");
+                                        if(i == 0 && baseSize)
+                                                newBase = newOffset >= extent ? newOffset - extent : 0;
+                                        if(newOffset < newBase || !fitsField(newOffset - newBase, offsetSize))
+                                                return QtFastStartResult(STATUS_MALFORMED_ATOM, at,
+                                                                "Item offset does not fit its field\n");
+                                        storeField(&data[at], offsetSize, newOffset - newBase);
+                                }
+                                if(!fitsField(newBase, baseSize))
+                                        return QtFastStartResult(STATUS_MALFORMED_ATOM, basePos,
+                                                        "Item base offset does not fit its field\n");
+                                storeField(&data[basePos], baseSize, newBase);
+                                *count += extentCount;
+                        }
+                        pos += (uint64_t)extentCount * extentSize;
+                }
+                return QtFastStartResult();
+        }
+
+/***************************************************************************
+* static QtFastStartSTD::QtFastStartResult patchTfra(byte* data, const QtFastStartSTD::AtomRange &r, const QtFastStartSTD::OffsetMap &offsets, uint64_t *count)
+* Description: rewrites the moof offsets of a tfra atom through an offset map.
+*               Version 0 holds 32 bit times and offsets, version 1 64 bit
+*               ones. The traf, trun and sample numbers are 1 to 4 bytes each,
+*               as given by the atom
+*
+* Parameters:
+*        data   I/O     byte*   buffer holding the atom
+*        r      I/P     const QtFastStartSTD::AtomRange&        the tfra atom within data
+*        offsets        I/P     const QtFastStartSTD::OffsetMap&        input to output offset mapping
+*        count  O/P     uint64_t*       number of offsets rewritten
+*        patchTfra      O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, or the failure
+*                                       with an offset relative to data
+**************************************************************************/
+        static QtFastStartSTD::QtFastStartResult patchTfra(byte* data, const QtFastStartSTD::AtomRange &r,
+                                        const QtFastStartSTD::OffsetMap &offsets, uint64_t *count)
+        {
+                using namespace QtFastStartSTD;
+                uint64_t pos = r.offset + r.headerSize;
+                uint64_t end = r.offset + r.size;
+                // version and flags, track_ID, field sizes and entry count
+                if(end - pos < 16)
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Malformed atom\n");
+                uint32_t fieldSize = data[pos] == 1 ? 8 : 4;
+                uint32_t sizes = BYTEBUFFER::BigEndian::load32(&data[pos + 8]);
+                uint32_t entryCount = BYTEBUFFER::BigEndian::load32(&data[pos + 12]);
+                pos += 16;
+                uint32_t entrySize = 2 * fieldSize + ((sizes >> 4) & 3) + ((sizes >> 2) & 3) + (sizes & 3) + 3;
+                if(end - pos < (uint64_t)entryCount * entrySize)
+                        return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Bad atom size/element count\n");
+
+                for(uint32_t i = 0; i < entryCount; i++, pos += entrySize){
+                        uint64_t at = pos + fieldSize;
+                        uint64_t newOffset;
+                        if(!offsets.map(loadField(&data[at], fieldSize), &newOffset))
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, at,
+                                                "Fragment offset outside of the copied data\n");
+                        if(!fitsField(newOffset, fieldSize))
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, at,
+                                                "Fragment offset does not fit 32 bits\n");
+                        storeField(&data[at], fieldSize, newOffset);
+                }
+                *count = entryCount;
+                return QtFastStartResult();
+        }
+
+/***************************************************************************
+* static uint64_t countNarrowOffsets(const byte* data, uint64_t begin, uint64_t end)
+* Description: counts the stco entries in a range of atoms, descending into
+*               containers only. Only the atom headers and the entry counts
+*               are read, a range that does not parse counts as empty
+*
+* Parameters:
+*        data   I/P     const byte*     buffer holding the atoms
+*        begin  I/P     uint64_t        offset of the first atom to walk
+*        end    I/P     uint64_t        offset one past the last atom to walk
+*        countNarrowOffsets     O/P     uint64_t        number of stco entries
+**************************************************************************/
+        static uint64_t countNarrowOffsets(const byte* data, uint64_t begin, uint64_t end)
+        {
+                std::vector<QtFastStartSTD::AtomRange> atoms;
+                if(!QtFastStartSTD::scanAtoms(data, begin, end, atoms))
+                        return 0;
+                uint64_t count = 0;
+                for(const QtFastStartSTD::AtomRange &r : atoms){
+                        if(QtFastStartSTD::Atom::isContainer(r.type))
+                                count += countNarrowOffsets(data, r.offset + r.headerSize, r.offset + r.size);
+                        else if(r.type == STCO_ATOM && r.size >= r.headerSize + 8)
+                                count += BYTEBUFFER::BigEndian::load32(&data[r.offset + r.headerSize + 4]);
+                }
+                return count;
+        }
+
+/***************************************************************************
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::patchChunkOffsets(BYTEBUFFER::ByteBuffer *moov, uint64_t begin, uint64_t end, const QtFastStartSTD::OffsetMap &offsets, uint64_t *patched, QtFastStartSTD::Progress *progress)
+* Description: walks a range of atoms and rewrites every file offset they hold
+*               through an offset map: stco and co64 entries, saio auxiliary
+*               information offsets, iloc item extents and tfra moof offsets.
+*               Only container and meta atoms are descended into, so atom types
+*               appearing inside of payloads are not mistaken for tables. Progress is reported in bytes of the moov walked,
+*               after every table and every PATCH_PROGRESS_ENTRIES entries.
+*               Malformed tables are reported in the result instead of thrown,
+*               with offsets relative to the moov buffer. Tables are rewritten
+*               in blocks of PATCH_BLOCK_ENTRIES, a failing block is left as it was
+*
+* Parameters:
+*        moov   I/O     BYTEBUFFER::ByteBuffer* buffer holding the atoms
+*        begin  I/P     uint64_t        offset of the first atom to walk
+*        end    I/P     uint64_t        offset one past the last atom to walk
+*        offsets        I/P     const QtFastStartSTD::OffsetMap&        input to output offset mapping
+*        patched        I/O     uint64_t*       incremented by the number of entries rewritten, may be NULL
+*        progress       I/O     QtFastStartSTD::Progress*       progress to report to, may be NULL
+*        QtFastStartSTD::patchChunkOffsets      O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, or where
+*                                               the walk stopped. Blocks before that point are already rewritten
+**************************************************************************/
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::patchChunkOffsets(BYTEBUFFER::ByteBuffer *moov,
+                                        uint64_t begin, uint64_t end, const QtFastStartSTD::OffsetMap &offsets,
+                                        uint64_t *patched, QtFastStartSTD::Progress *progress)
+        {
+                std::vector<AtomRange> atoms;
+                const byte* data = moov->getData();
+                if(end > moov->getLimit() || !scanAtoms(data, begin, end, atoms))
+                        return QtFastStartResult(STATUS_BAD_ATOM_SIZE, begin, "Bad atom size\n");
+
+                for(const AtomRange &r : atoms){
+                        uint32_t atomType = r.type;
+                        if(Atom::isContainer(atomType)){
+                                QtFastStartResult res = patchChunkOffsets(moov, r.offset + r.headerSize, r.offset + r.size,
+                                                        offsets, patched, progress);
+                                if(!res.ok())
+                                        return res;
+                                continue;
+                        }
+                        if(atomType == META_ATOM){
+                                //ISO meta atoms carry a version and flags, QuickTime ones start with their first child
+                                uint64_t first = r.offset + r.headerSize;
+                                if(r.size - r.headerSize >= 4 && BYTEBUFFER::BigEndian::load32(&data[first]) == 0)
+                                        first += 4;
+                                QtFastStartResult res = patchChunkOffsets(moov, first, r.offset + r.size,
+                                                        offsets, patched, progress);
+                                if(!res.ok())
+                                        return res;
+                                continue;
+                        }
+                        if(atomType == SAIO_ATOM || atomType == ILOC_ATOM || atomType == TFRA_ATOM){
+                                uint64_t count = 0;
+                                byte* writable = moov->getWritableData();
+                                QtFastStartResult res = atomType == SAIO_ATOM ? patchSaio(writable, r, offsets, &count)
+                                                        : atomType == ILOC_ATOM ? patchIloc(writable, r, offsets, &count)
+                                                        : patchTfra(writable, r, offsets, &count);
+                                if(!res.ok())
+                                        return res;
+                                if(patched)
+                                        *patched += count;
+                                if(progress)
+                                        progress->update(r.offset + r.size);
+                                continue;
+                        }
+                        if(!(atomType == STCO_ATOM || atomType == CO64_ATOM))
+                                continue;
+
+                        if(r.size < r.headerSize + 8)
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Malformed atom\n");
+                        // skip size, type, version (1 byte) and flags (3 bytes)
+                        uint64_t pos = r.offset + r.headerSize + 4;
+                        uint32_t offsetCount = BYTEBUFFER::BigEndian::load32(&data[pos]);
+                        pos += 4;
+                        uint64_t tableEnd = r.offset + r.size;
+                        uint32_t entrySize = atomType == STCO_ATOM ? 4 : 8;
+                        if(tableEnd - pos < (uint64_t)offsetCount * entrySize)
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, r.offset, "Bad atom size/element count\n");
+
+                        //the table is bounds checked as a whole, so the entries are accessed unchecked,
+                        //a block at a time
+                        BYTEBUFFER::BigEndianRawCursor table(moov->getWritableData(), moov->getLimit());
+                        for(uint32_t done = 0; done < offsetCount; ){
+                                uint32_t n = offsetCount - done < PATCH_BLOCK_ENTRIES ? offsetCount - done : PATCH_BLOCK_ENTRIES;
+                                uint64_t at = pos + (uint64_t)done * entrySize;
+                                if(atomType == STCO_ATOM){
+                                        uint32_t block32[PATCH_BLOCK_ENTRIES];
+                                        table.getArray_32(at, block32, n);
+                                        for(uint32_t i = 0; i < n; i++){
+                                                uint64_t newOffset;
+                                                if(!offsets.map(block32[i], &newOffset))
+                                                        return QtFastStartResult(STATUS_MALFORMED_ATOM, at + (uint64_t)i * 4,
+                                                                        "Chunk offset outside of the copied data\n");
+                                                if(!fitsField(newOffset, 4))
+                                                        return QtFastStartResult(STATUS_MALFORMED_ATOM, at + (uint64_t)i * 4,
+                                                                        "Chunk offset does not fit stco\n");
+                                                block32[i] = (uint32_t)newOffset;
+                                        }
+                                        table.putArray_32(at, block32, n);
+                                }
+                                else{
+                                        uint64_t block[PATCH_BLOCK_ENTRIES];
+                                        table.getArray_64(at, block, n);
+                                        for(uint32_t i = 0; i < n; i++){
+                                                if(!offsets.map(block[i], &block[i]))
+                                                        return QtFastStartResult(STATUS_MALFORMED_ATOM, at + (uint64_t)i * 8,
+                                                                        "Chunk offset outside of the copied data\n");
+                                        }
+                                        table.putArray_64(at, block, n);
+                                }
+                                done += n;
+                                if(progress && done % PATCH_PROGRESS_ENTRIES == 0)
+                                        progress->update(pos + (uint64_t)done * entrySize);
+                        }
+#ifdef DEBUG
+                        std::cout << "patched " << offsetCount << (atomType == STCO_ATOM ? " stco" : " co64")
+                                << " entries" << std::endl;
+#endif // DEBUG
+                        if(patched)
+                                *patched += offsetCount;
+                        if(progress)
+                                progress->update(tableEnd);
+                }
+                return QtFastStartResult();
+        }
+
 /***************************************************************************
 * QtFastStartSTD::ArtificialFileStream QtFastStartSTD::QtFastStart::fastStart(void)
 * Author: SkibbleBip
@@ -132,6 +627,45 @@ const bool __littleEndian = (*(int8_t *)&__num == 1 ? true : false);
 
         }
 
+/***************************************************************************
+* const byte* QtFastStartSTD::QtFastStart::getData(void) const
+* Description: returns the output file without copying it. If no change was
+*               needed, this points into the caller's input array
+*
+* Parameters:
+*        QtFastStartSTD::QtFastStart::getData   O/P     const byte*     output file, valid for the lifetime
+*                                               of this object (and of the input array if unchanged)
+**************************************************************************/
+        const byte* QtFastStartSTD::QtFastStart::getData(void) const
+        {
+                return this->data;
+        }
+
+/***************************************************************************
+* uint64_t QtFastStartSTD::QtFastStart::getLength(void) const
+* Description: returns the length of the output file
+*
+* Parameters:
+*        QtFastStartSTD::QtFastStart::getLength O/P     uint64_t        length of the array getData returns
+**************************************************************************/
+        uint64_t QtFastStartSTD::QtFastStart::getLength(void) const
+        {
+                return this->data_len;
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::QtFastStart::noChangeNeeded(void) const
+* Description: returns whether the output is the unmodified input, because the
+*               file already is fast-start or can not be converted
+*
+* Parameters:
+*        QtFastStartSTD::QtFastStart::noChangeNeeded    O/P     bool    true if getData references the input
+**************************************************************************/
+        bool QtFastStartSTD::QtFastStart::noChangeNeeded(void) const
+        {
+                return this->unchanged;
+        }
+
 /***************************************************************************
 * QtFastStartSTD::QtFastStart::QtFastStart(byte* in, uint64_t len)
 * Author: SkibbleBip
@@ -143,197 +677,1030 @@ const bool __littleEndian = (*(int8_t *)&__num == 1 ? true : false);
 *        len    I/P     uint64_t        length of array
 **************************************************************************/
         QtFastStartSTD::QtFastStart::QtFastStart(byte* in, uint64_t len)
+                : QtFastStart(in, len, QtFastStartSTD::QtFastStartOptions())
         {
-                this->inFile = new QtFastStartSTD::ArtificialFileStream(in, len);
-                this->outFile = new QtFastStartSTD::ArtificialFileStream();
-                QtFastStartSTD::QtFastStart::fastStartImpl();
-
         }
 
 /***************************************************************************
-* QtFastStartSTD::QtFastStart::~QtFastStart(void)
-* Author: SkibbleBip
-* Date: 08/02/2022
-* Description: Destructor
+* QtFastStartSTD::QtFastStart::QtFastStart(byte* in, uint64_t len, const QtFastStartSTD::QtFastStartOptions &options)
+* Description: Overloaded constructor, also takes in the options of the conversion.
+*               Throws the exception matching the status of a failed conversion
 *
 * Parameters:
+*        in     I/P     byte*   input byte array of input file
+*        len    I/P     uint64_t        length of array
+*        options        I/P     const QtFastStartSTD::QtFastStartOptions&       conversion settings
 **************************************************************************/
-        QtFastStartSTD::QtFastStart::~QtFastStart(void)
+        QtFastStartSTD::QtFastStart::QtFastStart(byte* in, uint64_t len, const QtFastStartSTD::QtFastStartOptions &options)
+                : QtFastStart(in, len, options, nullptr)
         {
-                delete this->ftypAtom;
-                delete this->moovAtom;
-                delete this->inFile;
-                delete this->outFile;
+                if(!this->result.ok())
+                        throwResult(this->result);
         }
 
+/***************************************************************************
+* QtFastStartSTD::QtFastStart::QtFastStart(byte* in, uint64_t len, const QtFastStartSTD::QtFastStartOptions &options, QtFastStartSTD::QtFastStartResult *result)
+* Description: Overloaded constructor that never throws. A failed conversion
+*               leaves an empty output and is reported through result
+*
+* Parameters:
+*        in     I/P     byte*   input byte array of input file
+*        len    I/P     uint64_t        length of array
+*        options        I/P     const QtFastStartSTD::QtFastStartOptions&       conversion settings
+*        result O/P     QtFastStartSTD::QtFastStartResult*      status of the conversion, may be NULL
+**************************************************************************/
+        QtFastStartSTD::QtFastStart::QtFastStart(byte* in, uint64_t len, const QtFastStartSTD::QtFastStartOptions &options,
+                                QtFastStartSTD::QtFastStartResult *result) noexcept
+        {
+                this->options = options;
+                this->progress = Progress(options.progress, options.progressData, options.cancel, options.deadline);
+                if(options.stats)
+                        *options.stats = QtFastStartStats();
+                if(options.index)
+                        options.index->clear();
+                this->input = in;
+                this->data = in;
+                this->data_len = len;
+                this->result = run();
+                if(result)
+                        *result = this->result;
+        }
 
 /***************************************************************************
-* void QtFastStartSTD::QtFastStart::fastStartImpl(void)
-* Author: SkibbleBip
-* Date: 08/02/2022
-* Description: performs the implementation of converting the mp4 file into a faststart mp4
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::run(void) noexcept
+* Description: runs the conversion of the input held in data. Malformed input
+*               in the fast-start path and the scan and memory limits are
+*               returned as a status without unwinding; failures thrown by the
+*               other paths are caught here and turned into their status
 *
 * Parameters:
+*        run    O/P     QtFastStartSTD::QtFastStartResult       status of the conversion
 **************************************************************************/
-        void QtFastStartSTD::QtFastStart::fastStartImpl(void)
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::run(void) noexcept
         {
+                QtFastStartResult res;
+                try{
+                        //the input is only read during the conversion, no need to copy it
+                        this->inFile = new QtFastStartSTD::ArtificialFileStream(this->data, this->data_len, STREAM_BORROW);
+                        this->data = nullptr;
+                        this->data_len = 0;
+                        this->outFile = new QtFastStartSTD::ArtificialFileStream();
+                        if(this->options.checksum){
+                                this->options.checksum->reset();
+                                this->outFile->setChecksum(this->options.checksum);
+                        }
+                        if(options.mode == MODE_FRAGMENTED)
+                                res = QtFastStartSTD::QtFastStart::fragmentImpl();
+                        else
+                                res = QtFastStartSTD::QtFastStart::fastStartImpl();
+                }
+                catch(const Bad_Atom_Size&){
+                        res = QtFastStartResult(STATUS_BAD_ATOM_SIZE, STATUS_NO_OFFSET, "Bad atom size\n");
+                }
+                catch(const Malformed_Atom &e){
+                        //every Malformed_Atom message is a string literal
+                        res = QtFastStartResult(STATUS_MALFORMED_ATOM, STATUS_NO_OFFSET, e.what());
+                }
+                catch(const Compressed_Moov&){
+                        res = QtFastStartResult(STATUS_COMPRESSED_MOOV, STATUS_NO_OFFSET, "Unsupported moov compression\n");
+                }
+                catch(const Cancelled&){
+                        res = QtFastStartResult(STATUS_CANCELLED, STATUS_NO_OFFSET, "Conversion cancelled\n");
+                }
+                catch(const Deadline_Exceeded&){
+                        res = QtFastStartResult(STATUS_DEADLINE_EXCEEDED, STATUS_NO_OFFSET,
+                                        "Conversion did not finish before its deadline\n");
+                }
+                catch(const Limit_Exceeded &e){
+                        //every Limit_Exceeded message is a string literal
+                        res = QtFastStartResult(STATUS_LIMIT_EXCEEDED, e.offset(), e.what());
+                }
+                catch(const BYTEBUFFER::Buffer_Underflow&){
+                        res = QtFastStartResult(STATUS_OUT_OF_BOUNDS, STATUS_NO_OFFSET, "Field outside of its atom\n");
+                }
+                catch(const BYTEBUFFER::Buffer_Overflow&){
+                        res = QtFastStartResult(STATUS_OUT_OF_BOUNDS, STATUS_NO_OFFSET, "Field outside of its atom\n");
+                }
+                catch(const BYTEBUFFER::IndexOutOfBounds&){
+                        res = QtFastStartResult(STATUS_OUT_OF_BOUNDS, STATUS_NO_OFFSET, "Field outside of its atom\n");
+                }
+                catch(const BYTEBUFFER::Bad_Position&){
+                        res = QtFastStartResult(STATUS_OUT_OF_BOUNDS, STATUS_NO_OFFSET, "Field outside of its atom\n");
+                }
+                catch(const QtFastStartSTD::Bad_Position&){
+                        res = QtFastStartResult(STATUS_OUT_OF_BOUNDS, STATUS_NO_OFFSET, "Field outside of the file\n");
+                }
+                catch(const Alloc_Fail&){
+                        res = QtFastStartResult(STATUS_ALLOC_FAIL, STATUS_NO_OFFSET, "Failed to malloc/realloc data\n");
+                }
+                catch(const std::bad_alloc&){
+                        res = QtFastStartResult(STATUS_ALLOC_FAIL, STATUS_NO_OFFSET, "Failed to malloc/realloc data\n");
+                }
+                catch(...){
+                        res = QtFastStartResult(STATUS_INTERNAL, STATUS_NO_OFFSET, "Conversion failed\n");
+                }
 
-                BYTEBUFFER::ByteBuffer atomBytes = BYTEBUFFER::ByteBuffer(ATOM_PREAMBLE_SIZE, BYTEBUFFER::B_ENDIAN);
-                uint32_t atomType = 0;
-                uint64_t atomSize = 0;
-                uint64_t lastOffset;
-                uint32_t moovAtomSize;
-                uint64_t startOffset = 0;
+                if(!res.ok()){
+                        this->data = nullptr;
+                        this->data_len = 0;
+                        this->unchanged = false;
+                }
+                if(this->outFile)
+                        finishStats();
+                //a passed through input was never written, it is hashed here in one go
+                if(this->options.checksum){
+                        if(res.ok())
+                                this->options.checksum->finish(this->data, this->data_len);
+                        else
+                                this->options.checksum->reset();
+                }
+                if(this->options.index)
+                        this->options.index->fileSize = this->data_len;
+                return res;
+        }
 
+/***************************************************************************
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::getResult(void) const
+* Description: returns the status of the conversion
+*
+* Parameters:
+*        QtFastStartSTD::QtFastStart::getResult O/P     QtFastStartSTD::QtFastStartResult       status and input offset
+**************************************************************************/
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::getResult(void) const
+        {
+                return this->result;
+        }
 
-                uint64_t orig = ATOM_PREAMBLE_SIZE;
-                readAndFill(inFile, &atomBytes);
-                while(orig == atomBytes.getLimit()){
-                        atomSize = (uint32_t)atomBytes.getUint_32();
-                        atomType = htobe32(atomBytes.getUint_32());
-                        //hack for converting it into a usuable format
+/***************************************************************************
+* void QtFastStartSTD::throwResult(const QtFastStartSTD::QtFastStartResult &result)
+* Description: throws the exception matching a failed status, the exception API
+*               on top of the status codes
+*
+* Parameters:
+*        result I/P     const QtFastStartSTD::QtFastStartResult&        status to throw, nothing is thrown for STATUS_OK
+**************************************************************************/
+        void QtFastStartSTD::throwResult(const QtFastStartSTD::QtFastStartResult &result)
+        {
+                switch(result.status){
+                        case STATUS_OK:
+                                return;
+                        case STATUS_BAD_ATOM_SIZE:
+                                throw Bad_Atom_Size();
+                        case STATUS_COMPRESSED_MOOV:
+                                throw Compressed_Moov();
+                        case STATUS_ALLOC_FAIL:
+                                throw Alloc_Fail();
+                        case STATUS_CANCELLED:
+                                throw Cancelled();
+                        case STATUS_DEADLINE_EXCEEDED:
+                                throw Deadline_Exceeded();
+                        case STATUS_LIMIT_EXCEEDED:
+                                throw Limit_Exceeded(result.message, result.offset);
+                        default:
+                                throw Malformed_Atom(result.message);
+                }
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::passThrough(QtFastStartSTD::FallbackReason reason)
+* Description: makes the output reference the unchanged input file, used
+*               whenever the input can not or does not need to be converted.
+*               Nothing is copied until fastStart is called
+*
+* Parameters:
+*        reason I/P     QtFastStartSTD::FallbackReason  why the input is not converted, for the stats
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::passThrough(QtFastStartSTD::FallbackReason reason)
+        {
+                if(this->options.stats)
+                        this->options.stats->fallback = reason;
+                delete outFile;
+                outFile = new QtFastStartSTD::ArtificialFileStream(inFile->getByteArray(), inFile->size(), STREAM_BORROW);
+                this->data = outFile->getByteArray();
+                this->data_len = outFile->size();
+                this->unchanged = true;
+        }
 
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::trackBuffer(int64_t bytes)
+* Description: records a conversion buffer being allocated or freed in the
+*               stats. Called before the allocation, so a buffer that would
+*               exceed the memory limit is never allocated
+*
+* Parameters:
+*        bytes  I/P     int64_t size of the buffer, negative when it is freed
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::trackBuffer(int64_t bytes)
+        {
+                if(bytes > 0)
+                        throwResult(checkMemory(bytes));
+                this->bufferBytes += bytes;
+                QtFastStartStats *stats = this->options.stats;
+                if(!stats)
+                        return;
+                if(bytes > 0)
+                        stats->allocations++;
+                if(this->bufferBytes > stats->peakBytes)
+                        stats->peakBytes = this->bufferBytes;
+        }
 
-                        if(atomType == FTYP_ATOM){
+/***************************************************************************
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::checkMemory(uint64_t bytes) const
+* Description: checks whether a buffer of the given size would take the
+*               conversion past its memory limit. The output stream is
+*               checked with this before it is reserved
+*
+* Parameters:
+*        bytes  I/P     uint64_t        size of the buffer about to be allocated
+*        checkMemory    O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, or STATUS_LIMIT_EXCEEDED
+**************************************************************************/
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::checkMemory(uint64_t bytes) const
+        {
+                uint64_t limit = this->options.limits.maxMemory;
+                if(limit != 0 && (bytes > limit || this->bufferBytes > limit - bytes))
+                        return QtFastStartResult(STATUS_LIMIT_EXCEEDED, STATUS_NO_OFFSET,
+                                        "Conversion needs more memory than the limit allows\n");
+                return QtFastStartResult();
+        }
 
-                                uint32_t ftypAtomSize = atomSize;
-                                ftypAtom = new BYTEBUFFER::ByteBuffer(ftypAtomSize, BYTEBUFFER::B_ENDIAN);
-                                atomBytes.rewind();
-                                ftypAtom->put(&atomBytes);
+/***************************************************************************
+* uint64_t QtFastStartSTD::QtFastStart::moovAllowance(void) const
+* Description: returns the largest moov buffer the moov size and memory limits
+*               still allow, which bounds the size a cmov may inflate to
+*
+* Parameters:
+*        moovAllowance  O/P     uint64_t        bytes, UINT64_MAX without limits
+**************************************************************************/
+        uint64_t QtFastStartSTD::QtFastStart::moovAllowance(void) const
+        {
+                const QtFastStartLimits &limits = this->options.limits;
+                uint64_t allowance = limits.maxMoovSize ? limits.maxMoovSize : UINT64_MAX;
+                if(limits.maxMemory){
+                        uint64_t left = limits.maxMemory > this->bufferBytes ? limits.maxMemory - this->bufferBytes : 0;
+                        if(left < allowance)
+                                allowance = left;
+                }
+                return allowance;
+        }
 
-                                inFile->read(ftypAtom);
+/***************************************************************************
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::scanTopLevel(std::vector<QtFastStartSTD::AtomRange> &top) const
+* Description: lists the top-level atoms of the input. The scan stops at the
+*               atom count limit, and the sizes the ftyp and moov headers
+*               claim are checked against their limits before anything is
+*               allocated for them
+*
+* Parameters:
+*        top    O/P     std::vector<QtFastStartSTD::AtomRange>& top-level atoms of the input
+*        scanTopLevel   O/P     QtFastStartSTD::QtFastStartResult       STATUS_OK, STATUS_BAD_ATOM_SIZE if the atom
+*                                               sizes do not add up to the file size, or STATUS_LIMIT_EXCEEDED
+**************************************************************************/
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::scanTopLevel(std::vector<QtFastStartSTD::AtomRange> &top) const
+        {
+                const QtFastStartLimits &limits = this->options.limits;
+                uint64_t maxAtoms = limits.maxTopLevelAtoms ? limits.maxTopLevelAtoms : UINT64_MAX;
+                if(!scanAtoms(inFile->getByteArray(), 0, inFile->size(), top, maxAtoms)){
+                        //a full list that ends before the file does was cut by the limit
+                        if(top.size() == maxAtoms && top.back().offset + top.back().size < inFile->size())
+                                return QtFastStartResult(STATUS_LIMIT_EXCEEDED, top.back().offset + top.back().size,
+                                                "Input has more top-level atoms than the limit allows\n");
+                        return QtFastStartResult(STATUS_BAD_ATOM_SIZE, STATUS_NO_OFFSET, "Bad atom size\n");
+                }
+                for(const AtomRange &r : top){
+                        if(r.type == MOOV_ATOM && limits.maxMoovSize && r.size > limits.maxMoovSize)
+                                return QtFastStartResult(STATUS_LIMIT_EXCEEDED, r.offset, "moov atom exceeds the size limit\n");
+                        if(r.type == FTYP_ATOM && limits.maxFtypSize && r.size > limits.maxFtypSize)
+                                return QtFastStartResult(STATUS_LIMIT_EXCEEDED, r.offset, "ftyp atom exceeds the size limit\n");
+                }
+                return QtFastStartResult();
+        }
 
-                                if(ftypAtom->getCapacity() < ftypAtomSize - ATOM_PREAMBLE_SIZE)
-                                        break;
-                                startOffset = inFile->getPosition();
+/***************************************************************************
+* QtFastStartSTD::Atom QtFastStartSTD::QtFastStart::parseMoov(const QtFastStartSTD::AtomRange &moovRange)
+* Description: parses the moov atom of the input into a tree, inflating a
+*               compressed one first. The tree copies the atom, so it is
+*               counted against the memory limit before parsing
+*
+* Parameters:
+*        moovRange      I/P     const QtFastStartSTD::AtomRange&        the moov atom
+*        parseMoov      O/P     QtFastStartSTD::Atom    the parsed, uncompressed moov atom
+**************************************************************************/
+        QtFastStartSTD::Atom QtFastStartSTD::QtFastStart::parseMoov(const QtFastStartSTD::AtomRange &moovRange)
+        {
+                const byte* in = inFile->getByteArray();
+                trackBuffer(moovRange.size);
+                Atom moov = Atom::parse(&in[moovRange.offset], moovRange.size);
+                if(moov.find(CMOV_ATOM)){
+                        std::unique_ptr<BYTEBUFFER::ByteBuffer> plain(
+                                inflateMoov(&in[moovRange.offset], moovRange.size, moovRange.headerSize, moovAllowance()));
+                        trackBuffer(plain->getLimit());
+                        moov = Atom::parse(plain->getData(), plain->getLimit());
+                }
+                return moov;
+        }
 
-                        }
-                        else{
-                                if(atomSize == 1){
-                                        atomBytes.clear();
-                                        readAndFill(inFile, &atomBytes);
-                                        if(orig != atomBytes.getCapacity())
-                                                break;
-                                        atomSize = atomBytes.getUint_64();
-                                        inFile->setPosition(inFile->getPosition() + atomSize - ATOM_PREAMBLE_SIZE * 2);
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::applyMoovEdit(QtFastStartSTD::Atom &moov)
+* Description: runs the moov edit callback on a parsed moov atom, if one was
+*               given. The callback may change anything but the type of the
+*               moov itself
+*
+* Parameters:
+*        moov   I/O     QtFastStartSTD::Atom&   uncompressed moov atom to edit
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::applyMoovEdit(QtFastStartSTD::Atom &moov)
+        {
+                if(!this->options.moovEdit)
+                        return;
+                this->options.moovEdit(moov, this->options.moovEditData);
+                if(moov.type != MOOV_ATOM || !moov.container)
+                        throw Malformed_Atom("moov edit did not return a moov atom\n");
+        }
 
-                                }
-                                else{
-                                        inFile->setPosition(inFile->getPosition() + atomSize - ATOM_PREAMBLE_SIZE);
+/***************************************************************************
+* std::vector<uint32_t> QtFastStartSTD::QtFastStart::dropTracks(QtFastStartSTD::Atom &moov) const
+* Description: removes the traks whose track ID or handler type the drop
+*               options list from a moov atom. Their chunks are left to the
+*               caller, which either skips them or leaves them in the mdat
+*
+* Parameters:
+*        moov   I/O     QtFastStartSTD::Atom&   uncompressed moov atom
+*        dropTracks     O/P     std::vector<uint32_t>   track IDs of the removed traks
+**************************************************************************/
+        std::vector<uint32_t> QtFastStartSTD::QtFastStart::dropTracks(QtFastStartSTD::Atom &moov) const
+        {
+                const std::vector<uint32_t> &ids = this->options.dropTrackIds;
+                const std::vector<uint32_t> &handlers = this->options.dropHandlers;
+                std::vector<uint32_t> dropped;
+                if(ids.empty() && handlers.empty())
+                        return dropped;
+
+                std::vector<Atom> kept;
+                kept.reserve(moov.children.size());
+                for(Atom &c : moov.children){
+                        if(c.type == TRAK_ATOM){
+                                Atom* tkhd = c.find(TKHD_ATOM);
+                                if(!tkhd)
+                                        throw Malformed_Atom("trak atom is missing tkhd\n");
+                                uint32_t trackId = tkhd->getUint_32(tkhd->getUint_8(0) == 1 ? 20 : 12);
+                                uint32_t handler = 0;
+                                Atom* mdia = c.find(MDIA_ATOM);
+                                Atom* hdlr = mdia ? mdia->find(HDLR_ATOM) : nullptr;
+                                if(hdlr && hdlr->data.size() >= 12)
+                                        memcpy(&handler, &hdlr->data[8], 4);
+                                if(std::find(ids.begin(), ids.end(), trackId) != ids.end()
+                                        || std::find(handlers.begin(), handlers.end(), handler) != handlers.end()){
+                                        dropped.push_back(trackId);
+                                        continue;
                                 }
                         }
-                        if ((atomType != FREE_ATOM)
-                                && (atomType != JUNK_ATOM)
-                                && (atomType != MDAT_ATOM)
-                                && (atomType != MOOV_ATOM)
-                                && (atomType != PNOT_ATOM)
-                                && (atomType != SKIP_ATOM)
-                                && (atomType != WIDE_ATOM)
-                                && (atomType != PICT_ATOM)
-                                && (atomType != UUID_ATOM)
-                                && (atomType != FTYP_ATOM)) {
+                        kept.push_back(std::move(c));
+                }
+                moov.children.swap(kept);
 #ifdef DEBUG
-                                std::cerr << "encountered non-QT top-level atom (is this a QuickTime file?)" << std::endl;
+                std::cout << "dropped " << dropped.size() << " traks" << std::endl;
 #endif // DEBUG
-                                break;
-                        }
-                         /* The atom header is 8 (or 16 bytes), if the atom size (which
-                        * includes these 8 or 16 bytes) is less than that, we won't be
-                        * able to continue scanning sensibly after this atom, so break. */
-                        if (atomSize < 8)
-                                break;
-                        readAndFill(inFile, &atomBytes);
+                return dropped;
+        }
 
-                }//while
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::editMoov(uint32_t *headerSize)
+* Description: drops the selected traks from the loaded moov buffer, runs the
+*               moov edit callback on it and replaces the buffer with the
+*               result. The chunks of dropped traks stay in the mdat. The
+*               chunk offsets are still those of the input, they are patched
+*               afterwards
+*
+* Parameters:
+*        headerSize     O/P     uint32_t*       header size of the edited moov atom
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::editMoov(uint32_t *headerSize)
+        {
+                uint64_t oldSize = moovAtom->getLimit();
+                trackBuffer(oldSize);
+                Atom moov = Atom::parse(moovAtom->getData(), oldSize);
+                dropTracks(moov);
+                applyMoovEdit(moov);
+                replaceMoov(moov, headerSize);
+                trackBuffer(-(int64_t)oldSize);
+        }
 
-                if(atomType != MOOV_ATOM){
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::replaceMoov(const QtFastStartSTD::Atom &moov, uint32_t *headerSize)
+* Description: replaces the loaded moov buffer with the serialized moov atom
+*
+* Parameters:
+*        moov   I/P     const QtFastStartSTD::Atom&     uncompressed moov atom to load
+*        headerSize     O/P     uint32_t*       header size of the new moov atom
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::replaceMoov(const QtFastStartSTD::Atom &moov, uint32_t *headerSize)
+        {
+                uint64_t oldSize = moovAtom->getLimit();
+                uint64_t newSize = moov.size();
+                trackBuffer(newSize);
+                std::vector<byte> plain;
+                plain.reserve(newSize);
+                moov.serialize(plain);
+
+                trackBuffer(newSize);
+                BYTEBUFFER::ByteBuffer* replaced = new BYTEBUFFER::ByteBuffer(newSize, BYTEBUFFER::B_ENDIAN);
+                replaced->put(plain.data(), newSize);
+                replaced->rewind();
+                delete moovAtom;
+                moovAtom = replaced;
+                trackBuffer(-(int64_t)oldSize);
+                trackBuffer(-(int64_t)newSize);
+                *headerSize = newSize > UINT32_MAX ? 16 : ATOM_PREAMBLE_SIZE;
 #ifdef DEBUG
-                        std::cerr << "Last atom in file was not moov atom" << std::endl;
+                std::cout << "moov changed from " << oldSize << " to " << newSize << " bytes" << std::endl;
 #endif // DEBUG
-                        inFile->setPosition(0);
-                        inFile->transferTo(0, inFile->size(), outFile);
-                        this->data = outFile->getByteArray();
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::QtFastStart::widenChunkOffsets(const QtFastStartSTD::OffsetMap &offsets, uint32_t *headerSize)
+* Description: turns every stco table of the loaded moov with an entry that
+*               maps past 4GB into a co64 table, before the offsets are
+*               patched. The entries keep their input offsets
+*
+* Parameters:
+*        offsets        I/P     const QtFastStartSTD::OffsetMap&        input to output offset mapping to check against
+*        headerSize     O/P     uint32_t*       header size of the moov atom, if it was replaced
+*        widenChunkOffsets      O/P     bool    true if a table was widened and the moov replaced
+**************************************************************************/
+        bool QtFastStartSTD::QtFastStart::widenChunkOffsets(const QtFastStartSTD::OffsetMap &offsets, uint32_t *headerSize)
+        {
+                uint64_t size = moovAtom->getLimit();
+                trackBuffer(size);
+                Atom moov = Atom::parse(moovAtom->getData(), size);
+                bool widened = false;
+                for(Atom* stco : moov.findAll(STCO_ATOM)){
+                        //malformed tables are left to the patch, which reports where they are
+                        if(stco->data.size() < 8 || stco->data.size() - 8 < (uint64_t)stco->getUint_32(4) * 4)
+                                continue;
+                        uint32_t count = stco->getUint_32(4);
+                        bool overflows = false;
+                        for(uint32_t i = 0; i < count && !overflows; i++){
+                                uint64_t out;
+                                overflows = offsets.map(stco->getUint_32(8 + (uint64_t)i * 4), &out) && !fitsField(out, 4);
+                        }
+                        if(!overflows)
+                                continue;
+
+                        Atom co64(CO64_ATOM);
+                        co64.data.reserve(8 + (uint64_t)count * 8);
+                        co64.putUint_32(stco->getUint_32(0));
+                        co64.putUint_32(count);
+                        for(uint32_t i = 0; i < count; i++)
+                                co64.putUint_64(stco->getUint_32(8 + (uint64_t)i * 4));
+                        *stco = std::move(co64);
+                        widened = true;
+                }
+                if(widened)
+                        replaceMoov(moov, headerSize);
+                trackBuffer(-(int64_t)size);
+                return widened;
+        }
+
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::indexMoov(const byte* moov, uint64_t len, uint32_t headerSize)
+* Description: adds the sync samples of a moov atom to the seek index, if one
+*               was asked for. The moov has to hold the output chunk offsets
+*
+* Parameters:
+*        moov   I/P     const byte*     moov atom, plain or compressed
+*        len    I/P     uint64_t        its size
+*        headerSize     I/P     uint32_t        size of its header
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::indexMoov(const byte* moov, uint64_t len, uint32_t headerSize)
+        {
+                if(!this->options.index)
                         return;
+                std::unique_ptr<BYTEBUFFER::ByteBuffer> plain;
+                if(isCompressedMoov(moov, len, headerSize)){
+                        plain.reset(inflateMoov(moov, len, headerSize, moovAllowance()));
+                        moov = plain->getData();
+                        len = plain->getLimit();
                 }
+                Atom parsed = Atom::parse(moov, len);
+                this->options.index->addMoov(parsed);
+        }
 
-                // moov atom was, in fact, the last atom in the chunk; load the whole moov atom
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::writeCached(const QtFastStartSTD::MoovCacheEntry &entry, const QtFastStartSTD::AtomRange *ftyp)
+* Description: writes the output from a moov cache entry: the ftyp of the
+*               input, the cached moov and the cached regions of the input
+*
+* Parameters:
+*        entry  I/P     const QtFastStartSTD::MoovCacheEntry&   patched moov and copy plan
+*        ftyp   I/P     const QtFastStartSTD::AtomRange*        the ftyp atom of the input, or nullptr
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::writeCached(const QtFastStartSTD::MoovCacheEntry &entry, const QtFastStartSTD::AtomRange *ftyp)
+        {
+                QtFastStartStats *stats = this->options.stats;
+                if(stats)
+                        stats->cacheHit = true;
+                if(entry.moov.size() < ATOM_PREAMBLE_SIZE)
+                        throw Malformed_Atom("Bad moov atom in the moov cache\n");
+                uint32_t headerSize = BYTEBUFFER::BigEndian::load32(entry.moov.data()) == 1 ? 16 : ATOM_PREAMBLE_SIZE;
+                indexMoov(entry.moov.data(), entry.moov.size(), headerSize);
+
+                PhaseTimer copyTimer(stats, PHASE_COPY);
+                uint64_t ftypSize = ftyp ? ftyp->size : 0;
+                uint64_t media = 0;
+                for(const Region &r : entry.layout.regions)
+                        media += r.length;
+                throwResult(checkMemory(ftypSize + entry.moov.size() + media));
+                outFile->reserve(ftypSize + entry.moov.size() + media);
+                if(ftyp)
+                        outFile->write(&inFile->getByteArray()[ftyp->offset], ftyp->size);
+                outFile->write(entry.moov.data(), entry.moov.size());
+
+                this->progress.begin(PHASE_COPY, media);
+                for(const Region &r : entry.layout.regions)
+                        this->progress.transfer(inFile, r.inStart, r.length, outFile);
+                if(stats)
+                        stats->bytesCopied = media;
 
-                moovAtomSize = atomSize;
-                lastOffset = inFile->size() - moovAtomSize; // NOTE: assuming no extra data after moov, as qt-faststart.c
-                moovAtom =  new BYTEBUFFER::ByteBuffer(moovAtomSize, BYTEBUFFER::B_ENDIAN);
+                this->data = outFile->getByteArray();
+                this->data_len = outFile->size();
+        }
 
-                orig = moovAtom->getCapacity();
-                readAndFill(inFile, moovAtom, lastOffset);
-                if(orig != moovAtom->getCapacity()){
-                        throw Malformed_Atom("Failed to read moov atom\n");
-                }
-                if(moovAtom->getUint_32(12) == CMOV_ATOM){
-                        throw Compressed_Moov();
-                }
+/***************************************************************************
+* void QtFastStartSTD::QtFastStart::finishStats(void)
+* Description: adds the output stream's allocations to the stats. The output
+*               grows while the remaining conversion buffers are alive, so
+*               its final capacity counts on top of them
+*
+* Parameters:
+**************************************************************************/
+        void QtFastStartSTD::QtFastStart::finishStats(void)
+        {
+                QtFastStartStats *stats = this->options.stats;
+                if(!stats)
+                        return;
+                stats->allocations += outFile->getAllocations();
+                if(this->bufferBytes + outFile->getCapacity() > stats->peakBytes)
+                        stats->peakBytes = this->bufferBytes + outFile->getCapacity();
+                if(!this->unchanged)
+                        stats->bytesWritten = outFile->size();
+        }
 
-                while(moovAtom->remaining() >= 8){
-                        uint64_t atomHead = moovAtom->getPosition();
-                        atomType = htobe32(moovAtom->getUint_32(atomHead + 4));
-                        //printf("%.5s\n", &atomType);
-                        if(!(atomType == STCO_ATOM || atomType == CO64_ATOM)){
-                                moovAtom->setPosition(moovAtom->getPosition()+1);
-                                continue;
-                        }
-                        atomSize = moovAtom->getUint_32(atomHead);
-                        if(atomSize > moovAtom->remaining()){
-                                throw Bad_Atom_Size();
-                        }
-                        moovAtom->setPosition(atomHead + 12); // skip size (4 bytes), type (4 bytes), version (1 byte) and flags (3 bytes)
-                        if(moovAtom->remaining() < 4){
-                                throw Malformed_Atom("Malformed atom\n");
-                        }
-                        // uint32_t, but assuming moovAtomSize is in int32 range, so this will be in int32 range
-                        uint32_t offsetCount = moovAtom->getUint_32();
-                        if (atomType == STCO_ATOM) {
+/***************************************************************************
+* QtFastStartSTD::QtFastStart::~QtFastStart(void)
+* Author: SkibbleBip
+* Date: 08/02/2022
+* Description: Destructor
+*
+* Parameters:
+**************************************************************************/
+        QtFastStartSTD::QtFastStart::~QtFastStart(void)
+        {
+                delete this->ftypAtom;
+                delete this->moovAtom;
+                delete this->inFile;
+                delete this->outFile;
+        }
+
+
+/***************************************************************************
+* bool QtFastStartSTD::QtFastStart::reuseFreeSpace(const std::vector<QtFastStartSTD::AtomRange> &top)
+* Description: moves the moov into padding in front of the mdat. No media data
+*               moves, so no chunk offset needs patching. The old moov becomes
+*               a free atom, or is dropped if it was the last atom. The output
+*               is still a copy of the whole file, unless options.inPlace lets
+*               the moov be moved inside the caller's buffer, which the output
+*               then borrows
+*
+* Parameters:
+*        top    I/P     const std::vector<QtFastStartSTD::AtomRange>&   top-level atoms of the input
+*        reuseFreeSpace O/P     bool    false if there is no padding the moov fits into
+**************************************************************************/
+        bool QtFastStartSTD::QtFastStart::reuseFreeSpace(const std::vector<QtFastStartSTD::AtomRange> &top)
+        {
+                uint32_t moovIndex;
+                uint64_t slotStart, slotEnd;
+                if(!findFreeSlot(top, &moovIndex, &slotStart, &slotEnd))
+                        return false;
 #ifdef DEBUG
-                                std::cout << "patching stco atom..." << std::endl;
+                std::cout << "moving moov atom into free space at " << slotStart << "..." << std::endl;
 #endif // DEBUG
 
-                                if(moovAtom->remaining() < offsetCount * 4){
-                                        throw Malformed_Atom("Bad atom size/element count\n");
-                                }
+                PhaseTimer timer(this->options.stats, PHASE_COPY);
+                const AtomRange &moov = top[moovIndex];
+                const byte* in = inFile->getByteArray();
+                uint64_t left = slotEnd - slotStart - moov.size;
+                indexMoov(&in[moov.offset], moov.size, moov.headerSize);
+                uint64_t newLen = moov.offset + moov.size == inFile->size() ? moov.offset : inFile->size();
+                uint32_t freeType = FREE_ATOM;
+
+                //only the moov bytes are written, O(moov) instead of O(file)
+                if(this->options.inPlace){
+                        fastStartInPlace(this->input, inFile->size(), &newLen);
+                        delete outFile;
+                        outFile = new QtFastStartSTD::ArtificialFileStream(this->input, newLen, STREAM_BORROW);
+                        if(this->options.stats)
+                                this->options.stats->bytesCopied = moov.size;
+                        this->data = outFile->getByteArray();
+                        this->data_len = outFile->size();
+                        return true;
+                }
 
-                                for(uint32_t i = 0; i < offsetCount; i++){
-                                        uint32_t currentOffset = moovAtom->getUint_32(moovAtom->getPosition());
-                                        uint32_t newOffset = currentOffset + moovAtomSize;
+                //every atom keeps its offset, only the moov and padding bytes change. The
+                //output is appended front to back, so a checksum hashes it as it goes
+                throwResult(checkMemory(newLen));
+                outFile->reserve(newLen);
+                this->progress.begin(PHASE_COPY, newLen);
+                this->progress.transfer(inFile, 0, slotStart, outFile);
+                outFile->write(&in[moov.offset], moov.size);
+                if(left){
+                        byte header[ATOM_PREAMBLE_SIZE];
+                        uint32_t size = htobe32((uint32_t)left);
+                        memcpy(&header[0], &size, 4);
+                        memcpy(&header[4], &freeType, 4);
+                        outFile->write(header, ATOM_PREAMBLE_SIZE);
+                        this->progress.update(outFile->size());
+                        this->progress.transfer(inFile, slotStart + moov.size + ATOM_PREAMBLE_SIZE, left - ATOM_PREAMBLE_SIZE, outFile);
+                }
+                this->progress.update(outFile->size());
+                this->progress.transfer(inFile, slotEnd, moov.offset - slotEnd, outFile);
+                if(newLen != moov.offset){
+                        this->progress.transfer(inFile, moov.offset, 4, outFile);
+                        outFile->write((const byte*)&freeType, 4);
+                        this->progress.update(outFile->size());
+                        this->progress.transfer(inFile, moov.offset + 8, newLen - moov.offset - 8, outFile);
+                }
+                if(this->options.stats)
+                        this->options.stats->bytesCopied = newLen;
 
-                                        /*if (currentOffset < 0 && newOffset >= 0) {
-#ifdef DEBUG                            //no clue if I even need this.
-                                                std::cerr << "This is bug in original qt-faststart.c: "
-                                                << "stco atom should be extended to co64 atom as new offset value overflows uint32, "
-                                                << "but is not implemented." << std::endl;
-#endif // DEBUG
-                                                throw QT_BUG;
-                                        }*/
-                                        moovAtom->putUint_32(newOffset);
+                this->data = outFile->getByteArray();
+                this->data_len = outFile->size();
+                return true;
+        }
+
+/***************************************************************************
+* bool QtFastStartSTD::QtFastStart::fastStartInPlace(byte* in, uint64_t len, uint64_t *newLen)
+* Description: in place variant of reuseFreeSpace. Copies the moov into the
+*               padding in front of the mdat of the caller's buffer and turns
+*               the old moov into a free atom. Only the moov bytes are touched
+*
+* Parameters:
+*        in     I/O     byte*   input file, modified in place
+*        len    I/P     uint64_t        length of the input
+*        newLen O/P     uint64_t*       new length of the file. Smaller than len if the
+*                                       moov was the last atom, the caller should truncate
+*        fastStartInPlace       O/P     bool    false if the file was left untouched because
+*                                       there is no padding the moov fits into
+**************************************************************************/
+        bool QtFastStartSTD::QtFastStart::fastStartInPlace(byte* in, uint64_t len, uint64_t *newLen)
+        {
+                std::vector<AtomRange> top;
+                uint32_t moovIndex;
+                uint64_t slotStart, slotEnd;
+                *newLen = len;
+                if(!scanAtoms(in, 0, len, top) || !findFreeSlot(top, &moovIndex, &slotStart, &slotEnd))
+                        return false;
+
+                const AtomRange &moov = top[moovIndex];
+                uint64_t left = slotEnd - slotStart - moov.size;
+                uint32_t freeType = FREE_ATOM;
+
+                memcpy(&in[slotStart], &in[moov.offset], moov.size);
+                if(left){
+                        uint32_t size = htobe32((uint32_t)left);
+                        memcpy(&in[slotStart + moov.size], &size, 4);
+                        memcpy(&in[slotStart + moov.size + 4], &freeType, 4);
+                }
+                if(moov.offset + moov.size == len)
+                        *newLen = moov.offset;
+                else
+                        memcpy(&in[moov.offset + 4], &freeType, 4);
+                return true;
+        }
 
+/***************************************************************************
+* QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::fastStartImpl(void)
+* Author: SkibbleBip
+* Date: 08/02/2022
+* Description: performs the implementation of converting the mp4 file into a faststart mp4
+*
+* Parameters:
+*        fastStartImpl  O/P     QtFastStartSTD::QtFastStartResult       status of the conversion, with the input
+*                                       offset of malformed chunk offset tables
+**************************************************************************/
+        QtFastStartSTD::QtFastStartResult QtFastStartSTD::QtFastStart::fastStartImpl(void)
+        {
+                std::vector<AtomRange> top;
+                const AtomRange* moov = nullptr;
+                const AtomRange* ftyp = nullptr;
+                bool mdatBeforeMoov = false;
+                bool offsetAtoms = false;
+                bool padded = false;
+                QtFastStartStats *stats = this->options.stats;
+
+                PhaseTimer scanTimer(stats, PHASE_SCAN);
+                this->progress.begin(PHASE_SCAN, inFile->size());
+                QtFastStartResult scanned = scanTopLevel(top);
+                if(scanned.status == STATUS_BAD_ATOM_SIZE){
+#ifdef DEBUG
+                        std::cerr << "top-level atoms do not add up to the file size" << std::endl;
+#endif // DEBUG
+                        passThrough(FALLBACK_BAD_ATOM_SIZES);
+                        return QtFastStartResult();
+                }
+                if(!scanned.ok())
+                        return scanned;
+                for(const AtomRange &r : top){
+                        if(!isAtomType(r.type)){
+#ifdef DEBUG
+                                std::cerr << "encountered non-QT top-level atom (is this a QuickTime file?)" << std::endl;
+#endif // DEBUG
+                                passThrough(FALLBACK_NOT_QUICKTIME);
+                                return QtFastStartResult();
+                        }
+                        if(r.type == MOOF_ATOM){
+                                //fragmented input, merge the fragments back into one moov
+                                scanTimer.stop();
+                                defragmentImpl(top);
+                                return QtFastStartResult();
+                        }
+                        if(r.type == MOOV_ATOM){
+                                if(moov){
+                                        passThrough(FALLBACK_DUPLICATE_MOOV);
+                                        return QtFastStartResult();
                                 }
+                                moov = &r;
+                        }
+                        else if(r.type == FTYP_ATOM && !ftyp)
+                                ftyp = &r;
+                        else if(r.type == MDAT_ATOM && !moov)
+                                mdatBeforeMoov = true;
+                        else if(r.type == META_ATOM || r.type == MFRA_ATOM)
+                                offsetAtoms = true;
+                        if(isPadding(r.type))
+                                padded = true;
+                }
 
+                //re-interleaving and dropping tracks rewrite the media data, so they also apply to fast-start input
+                bool dropping = !this->options.dropTrackIds.empty() || !this->options.dropHandlers.empty();
+                bool trimming = this->options.trimStart || this->options.trimLength;
+                bool editing = this->options.moovEdit || dropping;
+                bool compacting = this->options.compactMoov || this->options.rechunk;
+                //every option that changes the output also rewrites an already fast-start input
+                bool compressing = this->options.compressMoov && moov
+                                && !isCompressedMoov(&inFile->getByteArray()[moov->offset], moov->size, moov->headerSize);
+                bool rewriting = editing || compacting || compressing || (this->options.stripPadding && padded);
+                if(moov && (this->options.interleaveDuration || dropping || trimming)){
+                        scanTimer.stop();
+                        if(interleaveImpl(top, moov, ftyp))
+                                return QtFastStartResult();
+                        //unlike the other rewrites, a trim can not fall back to moving the moov
+                        if(trimming)
+                                throw Malformed_Atom("Input can not be trimmed, it has no traks or saio auxiliary data\n");
+                }
+
+                //an edited or otherwise rewritten moov is written even if it already is in front
+                if(!moov || (!mdatBeforeMoov && !rewriting)){
+#ifdef DEBUG
+                        std::cerr << "No moov atom behind the media data" << std::endl;
+#endif // DEBUG
+                        //a fast-start input is the output, so its moov already holds the output offsets
+                        if(moov)
+                                indexMoov(&inFile->getByteArray()[moov->offset], moov->size, moov->headerSize);
+                        passThrough(moov ? FALLBACK_ALREADY_FASTSTART : FALLBACK_NO_MOOV);
+                        return QtFastStartResult();
+                }
+                scanTimer.stop();
+                if(!this->options.stripPadding && !this->options.compressMoov && !editing && !compacting && reuseFreeSpace(top))
+                        return QtFastStartResult();
+
+                //a cached conversion of the same input leaves only the copy. The
+                //edit options are not part of the key, so edited output is never cached,
+                //and neither is output with top-level atoms that have to be patched
+                MoovCacheKey cacheKey;
+                bool cacheable = this->options.moovCache && !editing && !offsetAtoms;
+                if(cacheable){
+                        PhaseTimer hashTimer(stats, PHASE_MOOV_READ);
+                        this->progress.begin(PHASE_MOOV_READ, moov->size);
+                        uint32_t flags = (this->options.stripPadding ? 1 : 0) | (this->options.compressMoov ? 2 : 0)
+                                        | (this->options.compactMoov ? 4 : 0) | (this->options.rechunk ? 8 : 0);
+                        cacheKey = MoovCache::makeKey(inFile->getByteArray(), inFile->size(), top, *moov, flags);
+                        MoovCacheEntry cached;
+                        if(this->options.moovCache->load(cacheKey, &cached)){
+                                hashTimer.stop();
+                                writeCached(cached, ftyp);
+                                return QtFastStartResult();
                         }
-                        else if(atomType == CO64_ATOM){
+                }
+
+                // load the whole moov atom, wherever it is in the file
+                PhaseTimer readTimer(stats, PHASE_MOOV_READ);
+                this->progress.begin(PHASE_MOOV_READ, moov->size);
+                uint32_t moovHeaderSize = moov->headerSize;
+                bool compressed = isCompressedMoov(&inFile->getByteArray()[moov->offset], moov->size, moov->headerSize);
+                if(compressed){
 #ifdef DEBUG
-                                std::cout << "patching co64 atom..." << std::endl;
+                        std::cout << "decompressing cmov atom..." << std::endl;
 #endif // DEBUG
+                        moovAtom = inflateMoov(&inFile->getByteArray()[moov->offset], moov->size, moov->headerSize, moovAllowance());
+                        moovHeaderSize = moovAtom->getUint_32(0) == 1 ? 16 : ATOM_PREAMBLE_SIZE;
+                        trackBuffer(moovAtom->getLimit());
+                }
+                else{
+                        trackBuffer(moov->size);
+                        moovAtom =  new BYTEBUFFER::ByteBuffer(moov->size, BYTEBUFFER::B_ENDIAN);
+                        if(readAndFill(inFile, moovAtom, moov->offset) != moov->size)
+                                return QtFastStartResult(STATUS_MALFORMED_ATOM, moov->offset, "Failed to read moov atom\n");
+                }
+                if(editing)
+                        editMoov(&moovHeaderSize);
+                uint64_t moovAtomSize = moovAtom->getLimit();
+                if(ftyp){
+                        trackBuffer(ftyp->size);
+                        ftypAtom = new BYTEBUFFER::ByteBuffer(ftyp->size, BYTEBUFFER::B_ENDIAN);
+                        readAndFill(inFile, ftypAtom, ftyp->offset);
+                }
+                if(stats)
+                        stats->bytesRead = moov->size + (ftyp ? ftyp->size : 0);
+                readTimer.stop();
+
+                // lay out the output: ftyp, moov, then every other atom in input order
+                PhaseTimer patchTimer(stats, PHASE_PATCH);
+                uint64_t patched = 0;
+                uint64_t ftypSize = ftyp ? ftyp->size : 0;
+                uint64_t moovOutSize = moovAtomSize;
+                if(this->options.compressMoov){
+                        BYTEBUFFER::ByteBuffer* probe = deflateMoov(moovAtom, 0);
+                        moovOutSize = probe->getLimit();
+                        trackBuffer(moovOutSize);
+                        delete probe;
+                        trackBuffer(-(int64_t)moovOutSize);
+                }
+                this->progress.begin(PHASE_PATCH, moovAtomSize);
+                auto layout = [&](uint64_t start){
+                        OffsetMap map;
+                        for(const AtomRange &r : top){
+                                if(&r == moov || &r == ftyp || (this->options.stripPadding && isPadding(r.type)))
+                                        continue;
+                                map.add(r.offset, r.size, start);
+                                start += r.size;
+                        }
+                        return map;
+                };
+
+                /* every stco entry widened to co64 grows the moov by 4 bytes, so the
+                 * tables are checked against a layout behind a moov grown by all of
+                 * them. With compressMoov, zlib's worst case expansion and the cmov
+                 * headers are added on top */
+                uint64_t grownSize = moovAtomSize + 4 * countNarrowOffsets(moovAtom->getData(), moovHeaderSize, moovAtomSize);
+                if(this->options.compressMoov)
+                        grownSize += grownSize / 1024 + 64;
+                OffsetMap worst = layout(ftypSize + (grownSize > moovOutSize ? grownSize : moovOutSize));
+                if(worst.outputSize() > (uint64_t)UINT32_MAX + 1 && widenChunkOffsets(worst, &moovHeaderSize)){
+                        moovAtomSize = moovAtom->getLimit();
+                        moovOutSize = moovAtomSize;
+                        if(this->options.compressMoov){
+                                BYTEBUFFER::ByteBuffer* probe = deflateMoov(moovAtom, 0);
+                                moovOutSize = probe->getLimit();
+                                trackBuffer(moovOutSize);
+                                delete probe;
+                                trackBuffer(-(int64_t)moovOutSize);
+                        }
+                }
+                OffsetMap offsets = layout(ftypSize + moovOutSize);
+                uint64_t outPos = ftypSize + moovOutSize;
+                for(const Region &r : offsets.regions)
+                        outPos += r.length;
+
+                //errors inside a decompressed moov can only be pointed to by the cmov
+                QtFastStartResult res = patchChunkOffsets(moovAtom, moovHeaderSize, moovAtomSize, offsets, &patched, &this->progress);
+                if(!res.ok()){
+                        res.offset = compressed ? moov->offset : moov->offset + res.offset;
+                        return res;
+                }
 
-                                if(moovAtom->remaining() < offsetCount * 8){
-                                        throw Malformed_Atom("Bad atom size/element count\n");
+                /* compacting after the patch lets the stco/co64 choice see the
+                 * output offsets. The smaller moov moves everything behind it,
+                 * so the offsets are shifted once more by the difference */
+                std::unique_ptr<BYTEBUFFER::ByteBuffer> packed;
+                if(compacting){
+                        //deflate can pack the repetitive tables tighter than their compact form
+                        std::vector<byte> original;
+                        std::unique_ptr<BYTEBUFFER::ByteBuffer> originalPacked;
+                        uint64_t originalOutSize = moovOutSize;
+                        if(this->options.compressMoov){
+                                trackBuffer(moovAtomSize);
+                                original.assign(moovAtom->getData(), moovAtom->getData() + moovAtomSize);
+                                originalPacked.reset(deflateMoov(moovAtom, 0));
+                                originalOutSize = originalPacked->getLimit();
+                                trackBuffer(originalOutSize);
+                        }
+                        compactTables(&moovHeaderSize);
+                        uint64_t compactOutSize = moovAtom->getLimit();
+                        if(this->options.compressMoov){
+                                packed.reset(deflateMoov(moovAtom, 0));
+                                compactOutSize = packed->getLimit();
+                                trackBuffer(compactOutSize);
+                                //the probe of the moov that is kept is reused below, the other one is dropped
+                                if(compactOutSize >= originalOutSize){
+                                        trackBuffer(original.size());
+                                        replaceMoov(Atom::parse(original.data(), original.size()), &moovHeaderSize);
+                                        trackBuffer(-(int64_t)original.size());
+                                        packed.swap(originalPacked);
+                                        compactOutSize = moovOutSize;
                                 }
-                                for(uint32_t i = 0; i < offsetCount; i++){
-                                        uint64_t currentOffset = moovAtom->getUint_64(moovAtom->getPosition());
-                                        moovAtom->putUint_64(currentOffset + moovAtomSize);
+                                trackBuffer(-(int64_t)originalPacked->getLimit());
+                                originalPacked.reset();
+                                trackBuffer(-(int64_t)original.size());
+                                original = std::vector<byte>();
+                        }
+                        moovAtomSize = moovAtom->getLimit();
+                        if(compactOutSize != moovOutSize){
+                                OffsetMap shift;
+                                shift.add(ftypSize + moovOutSize, outPos - ftypSize - moovOutSize, ftypSize + compactOutSize);
+                                res = patchChunkOffsets(moovAtom, moovHeaderSize, moovAtomSize, shift, &patched);
+                                if(!res.ok()){
+                                        res.offset = compressed ? moov->offset : moov->offset + res.offset;
+                                        return res;
+                                }
+                                outPos = outPos - moovOutSize + compactOutSize;
+                                moovOutSize = compactOutSize;
+                                //the shifted offsets are not what the probe compressed
+                                if(packed){
+                                        trackBuffer(-(int64_t)packed->getLimit());
+                                        packed.reset();
                                 }
                         }
+                }
 
+                if(!this->options.compressMoov)
+                        indexMoov(moovAtom->getData(), moovAtomSize, moovHeaderSize);
+
+                /* the compressed size depends on the patched offsets. Recompress
+                 * until it fits the size the layout assumed, padding a smaller
+                 * result and shifting every offset again by a larger one. A probe
+                 * of the moov as it is now is used if it already has that size */
+                if(packed && packed->getLimit() != moovOutSize){
+                        trackBuffer(-(int64_t)packed->getLimit());
+                        packed.reset();
+                }
+                while(this->options.compressMoov){
+                        if(!packed){
+                                packed.reset(deflateMoov(moovAtom, moovOutSize));
+                                trackBuffer(packed->getLimit());
+                        }
+                        uint64_t packedSize = packed->getLimit();
+                        if(packedSize == moovOutSize){
+                                indexMoov(moovAtom->getData(), moovAtomSize, moovHeaderSize);
+                                delete moovAtom;
+                                moovAtom = packed.release();
+                                trackBuffer(-(int64_t)moovAtomSize);
+                                break;
+                        }
+                        packed.reset();
+                        trackBuffer(-(int64_t)packedSize);
+                        OffsetMap shift;
+                        shift.add(ftypSize + moovOutSize, outPos - ftypSize - moovOutSize, ftypSize + packedSize);
+                        //a larger moov can still push an stco entry past 32 bits
+                        res = patchChunkOffsets(moovAtom, moovHeaderSize, moovAtomSize, shift, &patched);
+                        if(!res.ok()){
+                                res.offset = compressed ? moov->offset : moov->offset + res.offset;
+                                return res;
+                        }
+                        outPos += packedSize - moovOutSize;
+                        moovOutSize = packedSize;
                 }
-                inFile->setPosition(startOffset);
-                // seek after ftyp atom
 
-                if(ftypAtom->getCapacity() != 0){
+                /* iloc atoms of a top-level meta and tfra atoms of an mfra hold
+                 * file offsets as well. The moov size is final now, so they are
+                 * patched once, against the final layout, and written in place
+                 * of the input bytes */
+                std::vector<std::pair<const AtomRange*, std::unique_ptr<BYTEBUFFER::ByteBuffer>>> patchedAtoms;
+                if(offsetAtoms){
+                        offsets = layout(ftypSize + moovOutSize);
+                        for(const AtomRange &r : top){
+                                if(r.type != META_ATOM && r.type != MFRA_ATOM)
+                                        continue;
+                                trackBuffer(r.size);
+                                std::unique_ptr<BYTEBUFFER::ByteBuffer> atom(new BYTEBUFFER::ByteBuffer(r.size, BYTEBUFFER::B_ENDIAN));
+                                readAndFill(inFile, atom.get(), r.offset);
+                                QtFastStartResult atomRes = patchChunkOffsets(atom.get(), 0, r.size, offsets, &patched);
+                                if(!atomRes.ok()){
+                                        atomRes.offset += r.offset;
+                                        return atomRes;
+                                }
+                                patchedAtoms.emplace_back(&r, std::move(atom));
+                        }
+                }
+                if(stats)
+                        stats->entriesPatched = patched;
+                patchTimer.stop();
+
+                PhaseTimer copyTimer(stats, PHASE_COPY);
+                QtFastStartResult memory = checkMemory(outPos);
+                if(!memory.ok())
+                        return memory;
+                outFile->reserve(outPos);
+                if(ftypSize != 0){
 #ifdef DEBUG
                         std::cout << "writing ftyp atom..." << std::endl;
 #endif // DEBUG
@@ -353,9 +1720,37 @@ const bool __littleEndian = (*(int8_t *)&__num == 1 ? true : false);
                 std::cout << "copying rest of file..." << std::endl;
 #endif // DEBUG
 
-                inFile->transferTo(startOffset, lastOffset - startOffset, outFile);
+                this->progress.begin(PHASE_COPY, outPos - ftypSize - moovOutSize);
+                uint32_t nextPatched = 0;
+                for(const Region &r : offsets.regions){
+                        uint64_t at = r.inStart;
+                        uint64_t regionEnd = r.inStart + r.length;
+                        while(nextPatched < patchedAtoms.size() && patchedAtoms[nextPatched].first->offset < regionEnd){
+                                const AtomRange* atom = patchedAtoms[nextPatched].first;
+                                this->progress.transfer(inFile, at, atom->offset - at, outFile);
+                                patchedAtoms[nextPatched].second->rewind();
+                                outFile->write(patchedAtoms[nextPatched].second.get());
+                                this->progress.update(outFile->size() - ftypSize - moovOutSize);
+                                at = atom->offset + atom->size;
+                                nextPatched++;
+                        }
+                        this->progress.transfer(inFile, at, regionEnd - at, outFile);
+                }
+                for(const auto &atom : patchedAtoms)
+                        trackBuffer(-(int64_t)atom.first->size);
+                if(stats)
+                        stats->bytesCopied = outPos - ftypSize - moovOutSize;
+
+                if(cacheable){
+                        MoovCacheEntry entry;
+                        entry.moov.assign(moovAtom->getData(), moovAtom->getData() + moovAtom->getLimit());
+                        entry.layout = offsets;
+                        this->options.moovCache->store(cacheKey, entry);
+                }
 
                 this->data = outFile->getByteArray();
+                this->data_len = outFile->size();
+                return QtFastStartResult();
         }//end function
 
 
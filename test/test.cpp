@@ -1,10 +1,12 @@
 #include <iostream>
 #include <string>
 #include <getopt.h>
+#include <chrono>
 
 #include "QtFastStartCPP.hpp"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 #define VERSION_TOP     "1"
@@ -19,7 +21,398 @@
 
 #endif // defined
 
+#ifdef __linux__
+/*Watching a folder needs inotify*/
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#define WATCH_MODE
+//files waiting for a worker before the watcher stops reading events
+#define WATCH_QUEUE_SIZE        64
 
+#endif // __linux__
+
+
+
+/***************************************************************************
+* void printProgress(QtFastStartSTD::StatsPhase phase, uint64_t done, uint64_t total, void* user)
+* Description: progress callback, prints the percentage of the current phase to stderr
+*
+* Parameters:
+*        phase  I/P     QtFastStartSTD::StatsPhase      phase being reported
+*        done   I/P     uint64_t        work finished in the phase
+*        total  I/P     uint64_t        work in the phase
+*        user   I/P     void*   unused
+**************************************************************************/
+void printProgress(QtFastStartSTD::StatsPhase phase, uint64_t done, uint64_t total, void* user)
+{
+        (void)user;
+        fprintf(stderr, "\r%-5s %3u%%", QtFastStartSTD::QtFastStartStats::phaseName(phase),
+                total ? (unsigned)(done * 100 / total) : 100);
+        if(done == total)
+                fprintf(stderr, "\n");
+}
+
+/***************************************************************************
+* void stripMetadata(QtFastStartSTD::Atom &moov, void* user)
+* Description: moov edit callback, removes the udta and meta atoms of the moov
+*               and its traks, which is where cameras keep GPS positions and
+*               other tags
+*
+* Parameters:
+*        moov   I/O     QtFastStartSTD::Atom&   moov atom to edit
+*        user   I/P     void*   unused
+**************************************************************************/
+void stripMetadata(QtFastStartSTD::Atom &moov, void* user)
+{
+        (void)user;
+        moov.remove(UDTA_ATOM);
+        moov.remove(META_ATOM);
+        for(QtFastStartSTD::Atom &trak : moov.children){
+                if(trak.type == TRAK_ATOM){
+                        trak.remove(UDTA_ATOM);
+                        trak.remove(META_ATOM);
+                }
+        }
+}
+
+/***************************************************************************
+* bool readInput(FILE* input, byte** data, uint64_t* size)
+* Description: reads a whole file into a newly allocated buffer
+*
+* Parameters:
+*        input  I/O     FILE*   file to read until its end
+*        data   O/P     byte**  the contents, to be freed by the caller, NULL for an empty file
+*        size   O/P     uint64_t*       number of bytes read
+*        readInput      O/P     bool    false if the buffer could not be allocated
+**************************************************************************/
+bool readInput(FILE* input, byte** data, uint64_t* size)
+{
+        byte* totalFile = NULL;
+        uint64_t totalFileSize = 0;
+        byte tmp[1024];
+        int r;
+        while( (r = fread(tmp, sizeof(byte), 1024, input)) ){
+                byte* tmpPtr = (byte*)realloc(totalFile, r + totalFileSize);
+                if(!tmpPtr){
+                        free(totalFile);
+                        return false;
+                }
+                totalFile = tmpPtr;
+                memcpy(&totalFile[totalFileSize], tmp, r);
+                totalFileSize += r;
+        }
+        *data = totalFile;
+        *size = totalFileSize;
+        return true;
+}
+
+/***************************************************************************
+* uint64_t expectedMediaSize(const byte* in, uint64_t len, const QtFastStartSTD::QtFastStartOptions &options)
+* Description: returns the mdat payload bytes the output has to hold. Fast-start
+*               conversions move the mdat atoms unchanged, re-interleaving,
+*               dropping tracks, trimming, fragmenting and defragmenting rewrite them
+*
+* Parameters:
+*        in     I/P     const byte*     input file
+*        len    I/P     uint64_t        its size
+*        options        I/P     const QtFastStartSTD::QtFastStartOptions&       options of the conversion
+*        expectedMediaSize      O/P     uint64_t        media bytes of the output, 0 if they can not be known up front
+**************************************************************************/
+uint64_t expectedMediaSize(const byte* in, uint64_t len, const QtFastStartSTD::QtFastStartOptions &options)
+{
+        std::vector<QtFastStartSTD::AtomRange> top;
+        if(options.mode != QtFastStartSTD::MODE_FASTSTART || options.interleaveDuration
+                || !options.dropTrackIds.empty() || !options.dropHandlers.empty() || options.trimStart || options.trimLength
+                || !QtFastStartSTD::scanAtoms(in, 0, len, top))
+                return 0;
+        for(const QtFastStartSTD::AtomRange &r : top){
+                if(r.type == MOOF_ATOM)
+                        return 0;
+        }
+        return QtFastStartSTD::mediaSize(top);
+}
+
+/***************************************************************************
+* uint32_t parseChecksums(const char* list)
+* Description: parses a comma separated list of hash names
+*
+* Parameters:
+*        list   I/P     const char*     names out of xxh3, crc32c and sha256
+*        parseChecksums O/P     uint32_t        ChecksumKind bits, 0 if a name is unknown
+**************************************************************************/
+uint32_t parseChecksums(const char* list)
+{
+        uint32_t kinds = 0;
+        std::string names(list);
+        size_t start = 0;
+        while(start <= names.size()){
+                size_t end = names.find(',', start);
+                if(end == std::string::npos)
+                        end = names.size();
+                std::string name = names.substr(start, end - start);
+                if(name == "xxh3")
+                        kinds |= QtFastStartSTD::CHECKSUM_XXH3;
+                else if(name == "crc32c")
+                        kinds |= QtFastStartSTD::CHECKSUM_CRC32C;
+                else if(name == "sha256")
+                        kinds |= QtFastStartSTD::CHECKSUM_SHA256;
+                else
+                        return 0;
+                start = end + 1;
+        }
+        return kinds;
+}
+
+/***************************************************************************
+* void printChecksum(const QtFastStartSTD::ChecksumDigest &digest, uint32_t kinds, const std::string &name)
+* Description: prints the selected hashes of a range to stderr, one
+*               "hash value name" line each
+*
+* Parameters:
+*        digest I/P     const QtFastStartSTD::ChecksumDigest&   hashes of the range
+*        kinds  I/P     uint32_t        ChecksumKind bits that were computed
+*        name   I/P     const std::string&      name printed after each hash
+**************************************************************************/
+void printChecksum(const QtFastStartSTD::ChecksumDigest &digest, uint32_t kinds, const std::string &name)
+{
+        if(kinds & QtFastStartSTD::CHECKSUM_XXH3)
+                fprintf(stderr, "xxh3 %016llx %s\n", (unsigned long long)digest.xxh3, name.c_str());
+        if(kinds & QtFastStartSTD::CHECKSUM_CRC32C)
+                fprintf(stderr, "crc32c %08x %s\n", (unsigned)digest.crc32c, name.c_str());
+        if(kinds & QtFastStartSTD::CHECKSUM_SHA256){
+                fprintf(stderr, "sha256 ");
+                for(uint32_t i = 0; i < sizeof(digest.sha256); i++)
+                        fprintf(stderr, "%02x", digest.sha256[i]);
+                fprintf(stderr, " %s\n", name.c_str());
+        }
+}
+
+#ifdef WATCH_MODE
+
+/*Bounded queue of file names between the inotify reader and the workers.
+After close() the workers drain what is left and pop() then returns false*/
+class WatchQueue{
+        private:
+                std::deque<std::string> items;
+                size_t capacity;
+                bool closed = false;
+                std::mutex lock;
+                std::condition_variable notEmpty;
+                std::condition_variable notFull;
+
+        public:
+                explicit WatchQueue(size_t capacity) : capacity(capacity){}
+
+                void push(const std::string &name)
+                {
+                        std::unique_lock<std::mutex> guard(lock);
+                        notFull.wait(guard, [this]{ return items.size() < capacity || closed; });
+                        if(closed)
+                                return;
+                        items.push_back(name);
+                        notEmpty.notify_one();
+                }
+
+                bool pop(std::string *name)
+                {
+                        std::unique_lock<std::mutex> guard(lock);
+                        notEmpty.wait(guard, [this]{ return !items.empty() || closed; });
+                        if(items.empty())
+                                return false;
+                        *name = items.front();
+                        items.pop_front();
+                        notFull.notify_one();
+                        return true;
+                }
+
+                void close(void)
+                {
+                        std::lock_guard<std::mutex> guard(lock);
+                        closed = true;
+                        notEmpty.notify_all();
+                        notFull.notify_all();
+                }
+};
+
+static volatile sig_atomic_t stopWatching = 0;
+
+/***************************************************************************
+* void onStopSignal(int signal)
+* Description: SIGINT/SIGTERM handler, makes the watcher finish the queued files and exit
+*
+* Parameters:
+*        signal I/P     int     unused
+**************************************************************************/
+void onStopSignal(int signal)
+{
+        (void)signal;
+        stopWatching = 1;
+}
+
+/***************************************************************************
+* bool convertFile(const std::string &inDir, const std::string &outDir, const std::string &name, QtFastStartSTD::QtFastStartOptions options, uint64_t timeout, bool validate, bool quiet)
+* Description: converts one file of the watched folder. The output is written
+*               to a hidden temporary file in the output folder and renamed
+*               into place, so readers never see a partial file
+*
+* Parameters:
+*        inDir  I/P     const std::string&      watched folder
+*        outDir I/P     const std::string&      output folder
+*        name   I/P     const std::string&      name of the file in both folders
+*        options        I/P     QtFastStartSTD::QtFastStartOptions      options of the conversion
+*        timeout        I/P     uint64_t        deadline of the conversion in milliseconds, 0 for none
+*        validate       I/P     bool    whether to check the structure of the output before writing it
+*        quiet  I/P     bool    whether to skip printing the outcome
+*        convertFile    O/P     bool    true if the output was written
+**************************************************************************/
+bool convertFile(const std::string &inDir, const std::string &outDir, const std::string &name,
+                QtFastStartSTD::QtFastStartOptions options, uint64_t timeout, bool validate, bool quiet)
+{
+        FILE* input = fopen((inDir + "/" + name).c_str(), "rb");
+        if(!input){
+                if(!quiet)
+                        std::cerr << "Failed to open " << name << std::endl;
+                return false;
+        }
+        if(timeout)
+                options.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        byte* totalFile = NULL;
+        uint64_t totalFileSize = 0;
+        bool read = readInput(input, &totalFile, &totalFileSize);
+        fclose(input);
+        if(!read){
+                if(!quiet)
+                        std::cerr << "Failed to allocate " << name << std::endl;
+                return false;
+        }
+
+        QtFastStartSTD::QtFastStartResult result;
+        QtFastStartSTD::QtFastStart qtfs(totalFile, totalFileSize, options, &result);
+        if(result.ok() && validate)
+                result = QtFastStartSTD::validateFastStart(qtfs.getData(), qtfs.getLength(),
+                                expectedMediaSize(totalFile, totalFileSize, options));
+        bool written = false;
+        std::string temp = outDir + "/." + name + ".XXXXXX";
+        int fd = result.ok() ? mkstemp(&temp[0]) : -1;
+        if(fd >= 0){
+                const byte* out = qtfs.getData();
+                uint64_t left = qtfs.getLength();
+                while(left > 0){
+                        ssize_t q = write(fd, out, left);
+                        if(q <= 0)
+                                break;
+                        out += q;
+                        left -= q;
+                }
+                fchmod(fd, 0644);
+                written = close(fd) == 0 && left == 0 && rename(temp.c_str(), (outDir + "/" + name).c_str()) == 0;
+                if(!written)
+                        unlink(temp.c_str());
+        }
+        free(totalFile);
+
+        if(!quiet){
+                if(written)
+                        std::cerr << "Converted " << name << std::endl;
+                else if(!result.ok())
+                        std::cerr << "Failed to process " << name << " ("
+                                << QtFastStartSTD::QtFastStartResult::statusName(result.status) << "): " << result.message << std::endl;
+                else
+                        std::cerr << "Failed to write " << name << std::endl;
+        }
+        return written;
+}
+
+/***************************************************************************
+* int watchFolder(const std::string &inDir, const std::string &outDir, const QtFastStartSTD::QtFastStartOptions &options, uint64_t timeout, bool validate, unsigned jobs, bool quiet)
+* Description: converts every file that is closed after writing or moved into
+*               a folder, on a pool of worker threads, until SIGINT or SIGTERM.
+*               Hidden files are skipped, so uploads can use dot-prefixed
+*               temporary names and the output folder can be the watched one
+*
+* Parameters:
+*        inDir  I/P     const std::string&      folder to watch
+*        outDir I/P     const std::string&      folder the outputs are moved into
+*        options        I/P     const QtFastStartSTD::QtFastStartOptions&       options of every conversion
+*        timeout        I/P     uint64_t        deadline of each conversion in milliseconds, 0 for none
+*        validate       I/P     bool    whether to check the structure of each output before writing it
+*        jobs   I/P     unsigned        number of worker threads
+*        quiet  I/P     bool    whether to skip printing the outcome of each file
+*        watchFolder    O/P     int     exit code, 1 if the folder can not be watched
+**************************************************************************/
+int watchFolder(const std::string &inDir, const std::string &outDir, const QtFastStartSTD::QtFastStartOptions &options,
+                uint64_t timeout, bool validate, unsigned jobs, bool quiet)
+{
+        int fd = inotify_init1(IN_CLOEXEC);
+        if(fd < 0 || inotify_add_watch(fd, inDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0){
+                std::cerr << "Failed to watch " << inDir << ": " << strerror(errno) << std::endl;
+                if(fd >= 0)
+                        close(fd);
+                return 1;
+        }
+
+        //no SA_RESTART, so a signal interrupts the blocking read
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onStopSignal;
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+
+        //the workers inherit a mask without the stop signals, so they always reach the reader
+        sigset_t stopSignals, previous;
+        sigemptyset(&stopSignals);
+        sigaddset(&stopSignals, SIGINT);
+        sigaddset(&stopSignals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+        WatchQueue queue(WATCH_QUEUE_SIZE);
+        std::vector<std::thread> workers;
+        for(unsigned i = 0; i < jobs; i++){
+                workers.emplace_back([&]{
+                        std::string name;
+                        while(queue.pop(&name))
+                                convertFile(inDir, outDir, name, options, timeout, validate, quiet);
+                });
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+        if(!quiet)
+                std::cerr << "Watching " << inDir << " with " << jobs << " workers" << std::endl;
+
+        alignas(struct inotify_event) char events[4096];
+        while(!stopWatching){
+                ssize_t len = read(fd, events, sizeof(events));
+                if(len <= 0){
+                        if(len < 0 && errno == EINTR)
+                                continue;
+                        break;
+                }
+                for(char* p = events; p < events + len; ){
+                        const struct inotify_event* e = (const struct inotify_event*)p;
+                        p += sizeof(struct inotify_event) + e->len;
+                        if((e->mask & IN_Q_OVERFLOW) && !quiet)
+                                std::cerr << "Missed events, some files were not converted" << std::endl;
+                        if(e->len == 0 || e->name[0] == '.' || (e->mask & IN_ISDIR))
+                                continue;
+                        queue.push(e->name);
+                }
+        }
+
+        queue.close();
+        for(std::thread &t : workers)
+                t.join();
+        close(fd);
+        return 0;
+}
+
+#endif // WATCH_MODE
 
 /***************************************************************************
 * int main(int argc, char* argv[])
@@ -37,8 +430,16 @@ int main(int argc, char* argv[])
 
         FILE *input = NULL, *output = NULL;
         bool quiet = false;
-        std::string inStr, outStr;
+        bool validate = false;
+        std::string inStr, outStr, statsStr, indexStr, cacheStr, watchStr, outDirStr;
+        uint64_t cacheLimit = 256;
+        uint64_t timeout = 0;
+        unsigned jobs = 0;
         int returnValue = 0;
+        QtFastStartSTD::QtFastStartOptions options;
+        QtFastStartSTD::QtFastStartStats stats;
+        QtFastStartSTD::SeekIndex index;
+        QtFastStartSTD::Checksum checksum(0);
 
         struct option long_options[] = {
                 {"input",     required_argument, NULL, 'i'},
@@ -46,6 +447,33 @@ int main(int argc, char* argv[])
                 {"help",      no_argument,       NULL, 'h'},
                 {"quiet",     no_argument,       NULL, 'q'},
                 {"version",   no_argument,       NULL, 'v'},
+                {"fragment",  required_argument, NULL, 'f'},
+                {"strip-padding", no_argument,   NULL, 's'},
+                {"compress-moov", no_argument,   NULL, 'c'},
+                {"compact",   no_argument,       NULL, 'k'},
+                {"rechunk",   no_argument,       NULL, 'R'},
+                {"stats",     required_argument, NULL, 'S'},
+                {"progress",  no_argument,       NULL, 'p'},
+                {"timeout",   required_argument, NULL, 't'},
+                {"index",     required_argument, NULL, 'x'},
+                {"interleave", required_argument, NULL, 'I'},
+                {"cache",     required_argument, NULL, 'C'},
+                {"cache-limit", required_argument, NULL, 'L'},
+                {"watch",     required_argument, NULL, 'w'},
+                {"out",       required_argument, NULL, 'O'},
+                {"jobs",      required_argument, NULL, 'j'},
+                {"validate",  no_argument,       NULL, 'V'},
+                {"max-moov",  required_argument, NULL, 'm'},
+                {"max-ftyp",  required_argument, NULL, 'F'},
+                {"max-memory", required_argument, NULL, 'M'},
+                {"max-atoms", required_argument, NULL, 'A'},
+                {"strip-metadata", no_argument,  NULL, 'u'},
+                {"drop-track", required_argument, NULL, 'D'},
+                {"drop-handler", required_argument, NULL, 'H'},
+                {"start",     required_argument, NULL, 'B'},
+                {"length",    required_argument, NULL, 'l'},
+                {"checksum",  required_argument, NULL, 'K'},
+                {"part-size", required_argument, NULL, 'P'},
                 {NULL,      0,                   NULL, 0}
 
         };
@@ -53,7 +481,7 @@ int main(int argc, char* argv[])
 
         int ch;
         bool _exit = false;
-        while( (ch = getopt_long(argc, argv, "i:o:hqv", long_options, NULL)) != -1){
+        while( (ch = getopt_long(argc, argv, "i:o:hqvf:sckRS:pt:x:I:C:L:w:O:j:Vm:F:M:A:uD:H:B:l:K:P:", long_options, NULL)) != -1){
                 switch(ch){
                         case 'i':{
                                 input = fopen(optarg, "rb");
@@ -69,6 +497,129 @@ int main(int argc, char* argv[])
                                 quiet = true;
                                 break;
                         }
+                        case 's':{
+                                options.stripPadding = true;
+                                break;
+                        }
+                        case 'S':{
+                                statsStr = optarg;
+                                options.stats = &stats;
+                                break;
+                        }
+                        case 'c':{
+                                options.compressMoov = true;
+                                break;
+                        }
+                        case 'k':{
+                                options.compactMoov = true;
+                                break;
+                        }
+                        case 'R':{
+                                options.rechunk = true;
+                                break;
+                        }
+                        case 'x':{
+                                indexStr = optarg;
+                                options.index = &index;
+                                break;
+                        }
+                        case 'p':{
+                                options.progress = printProgress;
+                                break;
+                        }
+                        case 't':{
+                                timeout = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'w':{
+                                watchStr = optarg;
+                                break;
+                        }
+                        case 'O':{
+                                outDirStr = optarg;
+                                break;
+                        }
+                        case 'j':{
+                                jobs = strtoul(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'V':{
+                                validate = true;
+                                break;
+                        }
+                        case 'u':{
+                                options.moovEdit = stripMetadata;
+                                break;
+                        }
+                        case 'B':{
+                                options.trimStart = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'l':{
+                                options.trimLength = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'K':{
+                                checksum.kinds = parseChecksums(optarg);
+                                if(!checksum.kinds){
+                                        _exit = true;
+                                        break;
+                                }
+                                options.checksum = &checksum;
+                                break;
+                        }
+                        case 'P':{
+                                checksum.partSize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+                                break;
+                        }
+                        case 'D':{
+                                options.dropTrackIds.push_back(strtoul(optarg, NULL, 10));
+                                break;
+                        }
+                        case 'H':{
+                                //handler types are compared in the byte order they are stored in
+                                uint32_t handler = 0;
+                                if(strlen(optarg) != 4){
+                                        _exit = true;
+                                        break;
+                                }
+                                memcpy(&handler, optarg, 4);
+                                options.dropHandlers.push_back(handler);
+                                break;
+                        }
+                        case 'm':{
+                                options.limits.maxMoovSize = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'F':{
+                                options.limits.maxFtypSize = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'M':{
+                                options.limits.maxMemory = strtoull(optarg, NULL, 10) * 1024 * 1024;
+                                break;
+                        }
+                        case 'A':{
+                                options.limits.maxTopLevelAtoms = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'I':{
+                                options.interleaveDuration = strtoul(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'C':{
+                                cacheStr = optarg;
+                                break;
+                        }
+                        case 'L':{
+                                cacheLimit = strtoull(optarg, NULL, 10);
+                                break;
+                        }
+                        case 'f':{
+                                options.mode = QtFastStartSTD::MODE_FRAGMENTED;
+                                options.fragmentDuration = strtoul(optarg, NULL, 10);
+                                break;
+                        }
                         case 'v':{
                                 std::cout << argv[0] << " v" VERSION_TOP "." VERSION_MID "." VERSION_BOTTOM << std::endl;
                         }
@@ -84,11 +635,38 @@ int main(int argc, char* argv[])
                 }
         }
 
+        if(watchStr.empty() != outDirStr.empty())
+                _exit = true;
+
         if(_exit){
-                std::cerr << "Usage: " << argv[0] << " [--input -i ] INPUTFILE [--output -o ] OUTPUTFILE [--quiet -q]" << std::endl;
+                std::cerr << "Usage: " << argv[0] << " [--input -i ] INPUTFILE [--output -o ] OUTPUTFILE [--quiet -q] [--fragment -f MILLISECONDS] [--strip-padding -s] [--compress-moov -c] [--compact -k] [--rechunk -R] [--strip-metadata -u] [--drop-track -D TRACKID]... [--drop-handler -H TYPE]... [--start -B MILLISECONDS] [--length -l MILLISECONDS] [--checksum -K xxh3,crc32c,sha256 [--part-size -P MEGABYTES]] [--stats -S JSONFILE] [--progress -p] [--timeout -t MILLISECONDS] [--index -x INDEXFILE] [--interleave -I MILLISECONDS] [--cache -C DIRECTORY] [--cache-limit -L MEGABYTES] [--validate -V] [--max-moov -m BYTES] [--max-ftyp -F BYTES] [--max-memory -M MEGABYTES] [--max-atoms -A N] [--watch -w DIRECTORY --out -O DIRECTORY [--jobs -j N]]" << std::endl;
+                return 1;
+        }
+
+        QtFastStartSTD::MoovCache cache(cacheStr, cacheLimit * 1024 * 1024);
+        if(!cacheStr.empty())
+                options.moovCache = &cache;
+
+        if(!watchStr.empty()){
+#ifdef WATCH_MODE
+                //stats, index, checksums and progress describe a single conversion
+                options.stats = nullptr;
+                options.index = nullptr;
+                options.checksum = nullptr;
+                options.progress = nullptr;
+                if(jobs == 0)
+                        jobs = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+                return watchFolder(watchStr, outDirStr, options, timeout, validate, jobs, quiet);
+#else
+                std::cerr << "Watching a folder is only supported on Linux" << std::endl;
                 return 1;
+#endif // WATCH_MODE
         }
 
+        //the clock starts before the input is read
+        if(timeout)
+                options.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
         if(!input){
         //if the input was not set, then set the input to the stdin of the program
 #ifdef ___WINDOWS
@@ -117,34 +695,79 @@ int main(int argc, char* argv[])
 
         byte* totalFile = NULL;
         uint64_t totalFileSize = 0;
-        byte tmp[1024];
-        int r;
-        while( (r = fread(tmp, sizeof(byte), 1024, input)) ){
-                byte* tmpPtr = (byte*)realloc(totalFile, r + totalFileSize);
-                if(!tmpPtr){
-                        if(quiet)
-                                std::cerr << "Failed to allocate input file" << std::endl;
-                        free(totalFile);
-                        return -1;
-                }
-                totalFile = tmpPtr;
-                memcpy(&totalFile[totalFileSize], tmp, r);
-                totalFileSize += r;
+        if(!readInput(input, &totalFile, &totalFileSize)){
+                if(quiet)
+                        std::cerr << "Failed to allocate input file" << std::endl;
+                return -1;
         }
 
-        try{
-                QtFastStartSTD::QtFastStart qtfs = QtFastStartSTD::QtFastStart(totalFile, totalFileSize);
-                QtFastStartSTD::ArtificialFileStream result = qtfs.fastStart();
-
-                fwrite(result.getByteArray(), sizeof(byte), result.size(), output);
+        QtFastStartSTD::QtFastStartResult result;
+        QtFastStartSTD::QtFastStart qtfs(totalFile, totalFileSize, options, &result);
+        //a file that fails validation is not written
+        bool valid = true;
+        if(result.ok() && validate){
+                QtFastStartSTD::QtFastStartResult check = QtFastStartSTD::validateFastStart(qtfs.getData(), qtfs.getLength(),
+                                                        expectedMediaSize(totalFile, totalFileSize, options));
+                if(!check.ok()){
+                        if(!quiet){
+                                std::cerr << "Output failed validation (" << QtFastStartSTD::QtFastStartResult::statusName(check.status);
+                                if(check.offset != STATUS_NO_OFFSET)
+                                        std::cerr << " at offset " << check.offset;
+                                std::cerr << "): " << check.message << std::endl;
+                        }
+                        valid = false;
+                        returnValue = 1;
+                }
+        }
+        if(result.ok() && valid){
+                if(qtfs.noChangeNeeded() && !quiet)
+                        std::cerr << "No change needed, writing the input unchanged" << std::endl;
 
-        }catch(std::exception  const &e){
-                if(!quiet)
-                        std::cerr << "Failed to process file: " << e.what() << std::endl;
+                fwrite(qtfs.getData(), sizeof(byte), qtfs.getLength(), output);
+        }
+        else if(!result.ok()){
+                if(!quiet){
+                        std::cerr << "Failed to process file (" << QtFastStartSTD::QtFastStartResult::statusName(result.status);
+                        if(result.offset != STATUS_NO_OFFSET)
+                                std::cerr << " at offset " << result.offset;
+                        std::cerr << "): " << result.message << std::endl;
+                }
                 returnValue = 1;
         }
         fclose(input);
         fclose(output);
+        free(totalFile);
+
+        if(options.stats){
+                //"-" sends the stats to stderr, stdout may hold the output file
+                FILE* statsFile = statsStr == "-" ? stderr : fopen(statsStr.c_str(), "w");
+                if(statsFile){
+                        fprintf(statsFile, "%s\n", stats.toJson().c_str());
+                        if(statsFile != stderr)
+                                fclose(statsFile);
+                }
+                else if(!quiet)
+                        std::cerr << "Failed to open stats file: " << statsStr << std::endl;
+        }
+
+        if(options.index && result.ok() && valid){
+                std::vector<byte> sidecar = index.serialize();
+                FILE* indexFile = fopen(indexStr.c_str(), "wb");
+                if(indexFile){
+                        fwrite(sidecar.data(), sizeof(byte), sidecar.size(), indexFile);
+                        fclose(indexFile);
+                }
+                else if(!quiet)
+                        std::cerr << "Failed to open index file: " << indexStr << std::endl;
+        }
+
+        //stdout may hold the output file, the hashes go to stderr
+        if(options.checksum && result.ok() && valid){
+                std::string name = outStr.empty() ? "-" : outStr;
+                printChecksum(checksum.total, checksum.kinds, name);
+                for(const QtFastStartSTD::ChecksumDigest &part : checksum.parts)
+                        printChecksum(part, checksum.kinds, name + "@" + std::to_string(part.offset) + "+" + std::to_string(part.length));
+        }
 
         if(!quiet)
                 std::cerr << "Completed" << std::endl;